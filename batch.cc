@@ -0,0 +1,170 @@
+#include "batch.h"
+#include "builtins.h"
+#include "helper-routines.h"
+#include "pathcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define BA_STRMAX (32 * 4096)   /* MAX_ARG_STRLEN: longest single argument */
+#define BA_SLACK  2048          /* left for the exec'd program's own use */
+
+
+/***********************************************
+ * Cutting the argument list
+ **********************************************/
+
+/* ba_cost - What one argument takes out of ARG_MAX */
+static long ba_cost(const char *arg)
+{
+    return (long)strlen(arg) + 1 + (long)sizeof(char *);
+}
+
+/* ba_fixed - How many args to repeat in every piece by default */
+static int ba_fixed(char **args)
+{
+    int k = 0;
+
+    while (args[k] && args[k][0] == '-') {
+        if (!strcmp(args[k++], "--"))
+            break;
+    }
+    return k;
+}
+
+/*
+ * ba_fill - Put as many of args into piece, after its k fixed args,
+ * as fit in room bytes.  Returns how many it took.
+ */
+static int ba_fill(char **piece, int k, char **args, long room)
+{
+    int n = 0;
+
+    while (args[n] && (room -= ba_cost(args[n])) >= 0) {
+        piece[k + n] = args[n];
+        n++;
+    }
+    piece[k + n] = NULL;
+    return n;
+}
+
+
+/***********************************************
+ * Running the pieces
+ **********************************************/
+
+/* ba_reap - Wait for one piece; note a failure in *status */
+static void ba_reap(int *status, int *killed)
+{
+    int st;
+
+    while (wait(&st) < 0) {
+        if (errno != EINTR)
+            return;
+    }
+    if (WIFSIGNALED(st)) {
+        *killed = 1;
+        *status = 125;
+    }
+    else if (WEXITSTATUS(st) != 0 && *status == 0)
+        *status = 123;
+}
+
+/* ba_usage - Complain about the command line */
+static int ba_usage(void)
+{
+    printf("usage: batch [-P jobs] [-k n] [--] command [args...]\n");
+    return 2;
+}
+
+/* batch_cmd - The batch builtin (batch.h) */
+int batch_cmd(char **argv)
+{
+    const struct builtin_t *b;
+    const char *path;
+    long room;
+    int maxjobs = 1, k = -1, running = 0, status = 0, killed = 0;
+    int i, nargs, done;
+    char **cmd, **args, **piece;
+
+    for (i = 1; argv[i] && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        }
+        if ((strcmp(argv[i], "-P") && strcmp(argv[i], "-k")) || argv[i + 1] == NULL)
+            return ba_usage();
+        if (argv[i][1] == 'P')
+            maxjobs = atoi(argv[++i]);
+        else
+            k = atoi(argv[++i]);
+    }
+    if ((cmd = &argv[i])[0] == NULL || maxjobs < 0)
+        return ba_usage();
+    if (maxjobs == 0 && (maxjobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        maxjobs = 1;
+
+    /* A builtin that may run anywhere takes the whole list */
+    if ((b = builtin_find(cmd[0])) != NULL && (b->flags & BI_PIPE))
+        return b->fn(cmd);
+
+    path = pathcache_resolve(cmd[0]);
+    if (access(path, F_OK) < 0) {
+        printf("%s: Command not found\n", cmd[0]);
+        return 127;
+    }
+
+    /* The command and the fixed args go in every piece */
+    for (nargs = 1; cmd[nargs]; nargs++)
+        ;
+    if (k < 0)
+        k = ba_fixed(cmd + 1);
+    if (k > nargs - 1)
+        k = nargs - 1;
+    k++;                                            /* counting the command */
+    room = sysconf(_SC_ARG_MAX) - BA_SLACK - (long)strlen(path) - 1 - (long)sizeof(char *);
+    for (i = 0; i < k; i++)
+        room -= ba_cost(cmd[i]);
+    for (i = 0; i < nargs; i++) {
+        if (strlen(cmd[i]) >= BA_STRMAX || (i >= k && ba_cost(cmd[i]) > room)) {
+            printf("batch: argument %d is too long (%zu bytes)\n", i, strlen(cmd[i]));
+            return 1;
+        }
+    }
+
+    if ((piece = (char **)malloc((nargs + 1) * sizeof(char *))) == NULL) {
+        printf("batch: out of memory\n");
+        return 1;
+    }
+    memcpy(piece, cmd, k * sizeof(char *));
+    args = cmd + k;
+    fflush(stdout);
+    do {
+        pid_t pid;
+
+        if (running == maxjobs) {
+            ba_reap(&status, &killed);
+            running--;
+        }
+        if (killed)
+            break;
+        done = ba_fill(piece, k, args, room);
+        if ((pid = fork()) == 0)
+            Execve(path, piece, NULL);
+        if (pid < 0) {
+            printf("batch: fork: %s\n", strerror(errno));
+            status = 125;
+            break;
+        }
+        running++;
+        args += done;
+    } while (*args);
+    for (; running > 0; running--)
+        ba_reap(&status, &killed);
+    free(piece);
+    return status;
+}
@@ -0,0 +1,27 @@
+//-*-c++-*-
+#ifndef _batch_h_
+#define _batch_h_
+
+/*
+ * batch [-P jobs] [-k n] [--] command args...
+ *
+ * Runs command over args the way xargs would, without the pipe and
+ * the extra process: the argument list is cut into the fewest pieces
+ * the kernel will accept (ARG_MAX, and 128K per argument), and command
+ * is run once per piece.  The first n args (-k n; by default the ones
+ * that start with '-', up to a "--") are repeated in every piece.
+ *
+ * The pieces run one after another, or up to jobs at a time with -P
+ * (-P 0: one per CPU).  batch always runs as a job of its own, in a
+ * child, so the pieces share its process group and its jid: ctrl-c,
+ * ctrl-z, fg and bg act on all of them.  The status is 0, 123 if any
+ * piece failed, 125 if one was killed by a signal (no more are
+ * started then) and 127 if command can't be found.
+ *
+ * A builtin that runs anywhere (BI_PIPE) has no argument limit, so it
+ * gets the whole list at once.
+ */
+
+int batch_cmd(char **argv);
+
+#endif
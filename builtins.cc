@@ -0,0 +1,187 @@
+#include "builtins.h"
+#include "batch.h"
+#include "capture.h"
+#include "jobs.h"
+#include "journal.h"
+#include "history.h"
+#include "tracing.h"
+#include "tsh.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/***********************************************
+ * The builtin commands
+ **********************************************/
+
+/* bi_quit - quit: leave the shell */
+static int bi_quit(char **argv)
+{
+    exit(0);
+}
+
+/* bi_jobs - jobs [--json | --replay [file] | -o %jid]: list the jobs */
+static int bi_jobs(char **argv)
+{
+    if (argv[1] && !strcmp(argv[1], "-o")) {            /* a job's captured output */
+        if (argv[2] == NULL || atoi(argv[2] + (argv[2][0] == '%')) < 1) {
+            printf("jobs: usage: jobs -o %%jid\n");
+            return 2;
+        }
+        return capture_show(atoi(argv[2] + (argv[2][0] == '%')));
+    }
+    if (argv[1] && !strcmp(argv[1], "--replay"))        /* rebuild from the journal */
+        journal_replay(argv[2]);
+    else if (argv[1] && !strcmp(argv[1], "--json")) {   /* machine-readable list */
+        listjobs_json(stdout, jobs);
+        printf("\n");
+    }
+    else
+        listjobs(jobs);
+    return 0;
+}
+
+/* bi_bgfg - fg and bg */
+static int bi_bgfg(char **argv)
+{
+    do_bgfg(argv);
+    return 0;
+}
+
+/* bi_wait - wait [-n] [--timeout secs] [%jid|pid ...] */
+static int bi_wait(char **argv)
+{
+    return do_wait(argv);
+}
+
+/* bi_history - history [n] | history -s text */
+static int bi_history(char **argv)
+{
+    history_cmd(argv);
+    return 0;
+}
+
+#ifdef TSH_TRACE
+/* bi_trace - trace [file]: dump the trace buffer */
+static int bi_trace(char **argv)
+{
+    return trace_dump(argv[1] ? argv[1] : "tsh-trace.json") < 0;
+}
+#endif
+
+
+/***********************************************
+ * The table and its perfect hash
+ **********************************************/
+
+static constexpr struct builtin_t builtins[] = {
+    { "quit",    bi_quit,    0 },
+    { "jobs",    bi_jobs,    BI_PIPE },
+    { "fg",      bi_bgfg,    0 },
+    { "bg",      bi_bgfg,    0 },
+    { "history", bi_history, BI_PIPE },
+    { "wait",    bi_wait,    0 },
+#ifdef TSH_TRACE
+    { "trace",   bi_trace,   0 },
+#endif
+    { "echo",    util_echo,  BI_PIPE | BI_BG | BI_UTIL },
+    { "true",    util_true,  BI_PIPE | BI_BG | BI_UTIL },
+    { "false",   util_false, BI_PIPE | BI_BG | BI_UTIL },
+    { "test",    util_test,  BI_PIPE | BI_BG | BI_UTIL },
+    { "[",       util_test,  BI_PIPE | BI_BG | BI_UTIL },
+    { "sleep",   util_sleep, BI_PIPE | BI_BG | BI_UTIL },
+    { "kill",    util_kill,  BI_BG | BI_UTIL },
+    { "batch",   batch_cmd,  BI_BG | BI_JOB },
+};
+
+#define BI_COUNT ((int)(sizeof(builtins) / sizeof(builtins[0])))
+#define BI_SLOTS 32   /* hash table size, a power of two */
+#define BI_SEED  21   /* change this if the static_assert below fails */
+
+/* bi_len - strlen, usable at compile time */
+static constexpr unsigned bi_len(const char *s)
+{
+    unsigned n = 0;
+
+    while (s[n])
+        n++;
+    return n;
+}
+
+/* bi_hash - Slot of a name of length n, from its length and end characters */
+static constexpr unsigned bi_hash(const char *s, unsigned n)
+{
+    return n == 0 ? 0 : (n + (unsigned char)s[0] * BI_SEED +
+                         (unsigned char)s[n - 1] * (BI_SEED + 2)) & (BI_SLOTS - 1);
+}
+
+struct bi_index_t {            /* slot -> table index, or -1 */
+    signed char slot[BI_SLOTS];
+    bool        perfect;       /* no two names share a slot */
+};
+
+/* bi_build - Fill in the slots, noting any collision */
+static constexpr struct bi_index_t bi_build(void)
+{
+    struct bi_index_t ix = {};
+
+    for (int i = 0; i < BI_SLOTS; i++)
+        ix.slot[i] = -1;
+    ix.perfect = true;
+    for (int i = 0; i < BI_COUNT; i++) {
+        unsigned h = bi_hash(builtins[i].name, bi_len(builtins[i].name));
+
+        if (ix.slot[h] >= 0)
+            ix.perfect = false;
+        ix.slot[h] = i;
+    }
+    return ix;
+}
+
+static constexpr struct bi_index_t bi_index = bi_build();
+static_assert(bi_index.perfect, "builtin names collide in bi_hash: change BI_SEED");
+static_assert(BI_COUNT < 128, "builtin table too big for signed char slots");
+
+static int utils;   /* BI_UTIL builtins are on (tsh -u) */
+
+
+/* builtin_utils - Turn the BI_UTIL builtins on or off */
+void builtin_utils(int on)
+{
+    utils = on;
+}
+
+/*
+ * builtin_find - The builtin called name, or NULL.  Only a bare name
+ * is looked up, except that with utilities on, /bin/echo and
+ * /usr/bin/echo find echo too; any other path is a program.
+ */
+const struct builtin_t *builtin_find(const char *name)
+{
+    const char *base = name;
+    int i;
+
+    if (utils && !strncmp(name, "/bin/", 5))
+        base = name + 5;
+    else if (utils && !strncmp(name, "/usr/bin/", 9))
+        base = name + 9;
+    if (strchr(base, '/') != NULL)
+        return NULL;
+    i = bi_index.slot[bi_hash(base, strlen(base))];
+    if (i < 0 || strcmp(builtins[i].name, base))
+        return NULL;
+    if ((builtins[i].flags & BI_UTIL) ? !utils : base != name)
+        return NULL;
+    return &builtins[i];
+}
+
+/* builtin_name - Name of the ith builtin that is on, NULL past the last */
+const char *builtin_name(int i)
+{
+    for (int j = 0; j < BI_COUNT; j++)
+        if ((utils || !(builtins[j].flags & BI_UTIL)) && i-- == 0)
+            return builtins[j].name;
+    return NULL;
+}
@@ -0,0 +1,40 @@
+//-*-c++-*-
+#ifndef _builtins_h_
+#define _builtins_h_
+
+/*
+ * The shell's builtin commands.  They are listed in one table in
+ * builtins.cc; a perfect hash over the names, built and checked at
+ * compile time, makes lookup one hash and one strcmp, so external
+ * commands no longer pay for a chain of comparisons.
+ *
+ * To add a builtin, write a builtin_fn and add a line to the table.
+ * If the build then stops at the static_assert, the new name collides
+ * with another: change BI_SEED.
+ *
+ * Flags say where else a builtin may run.  Without BI_BG, a trailing
+ * & is ignored and the builtin runs in the shell as it always has;
+ * with it, "name args &" forks a background job that runs the builtin
+ * and exits.  A BI_JOB builtin is always run that way, in the
+ * foreground too, so whatever it starts belongs to one job.
+ */
+
+#define BI_PIPE 0x1   /* may run inside a pipeline (uses no shell state) */
+#define BI_BG   0x2   /* may run as a background job, in a child */
+#define BI_UTIL 0x4   /* a utility (utils.h): only with tsh -u, and also
+                         found as /bin/<name> and /usr/bin/<name> */
+#define BI_JOB  0x8   /* always runs as a job, in a child, even in the fg */
+
+typedef int builtin_fn(char **argv);   /* returns an exit status */
+
+struct builtin_t {
+    const char *name;
+    builtin_fn *fn;
+    int         flags;
+};
+
+const struct builtin_t *builtin_find(const char *name);
+const char *builtin_name(int i);
+void builtin_utils(int on);
+
+#endif
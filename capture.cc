@@ -0,0 +1,466 @@
+#include "capture.h"
+#include "evloop.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#define CA_MIN   4096       /* first size of a ring */
+#define CA_BUF   65536      /* bytes taken per read */
+#define CA_READS 16         /* reads per wakeup, so one job can't starve the loop */
+#define CA_PIPE  (1 << 20)  /* pipe size asked for in line mode */
+#define MX_IOV   1024       /* pieces per writev */
+#define MX_LINE  65536      /* a longer line is cut here */
+
+struct cap_t {              /* The captured output of one job */
+    struct cap_t *next;     /* in caps, oldest first */
+    pid_t         pid;
+    int           jid;
+    int           fd;       /* read end of the job's pipe, -1 at EOF */
+    int           spill;    /* spill file, or -1 */
+    char         *ring;
+    size_t        size;     /* bytes at ring */
+    size_t        head;     /* where the next byte goes */
+    size_t        len;      /* bytes held, ending at head */
+    unsigned long dropped;  /* bytes overwritten or never kept */
+    char         *part;     /* line mode: the unfinished last line */
+    size_t        plen, pcap;
+    char          tag[16];  /* "[jid] ", or empty */
+    int           tlen;
+};
+
+static struct cap_t *caps;          /* every capture, oldest first */
+static size_t        jobcap;        /* ring limit per job; 0 = capture is off */
+static size_t        totalcap;      /* and for all rings */
+static size_t        held;          /* bytes in all rings */
+static char         *spilldir;      /* tsh -O */
+static int           rfd = -1;      /* read end made by capture_start */
+static int           mux;           /* line mode: 1, or 2 with tags */
+static struct iovec  iov[MX_IOV];   /* lines waiting for writev */
+static int           niov;
+
+
+/***********************************************
+ * Rings
+ **********************************************/
+
+/* ca_free - Unlink and free c */
+static void ca_free(struct cap_t *c)
+{
+    struct cap_t **pp;
+
+    for (pp = &caps; *pp != c; pp = &(*pp)->next)
+        ;
+    *pp = c->next;
+    if (c->fd >= 0) {
+        evloop_del(c->fd);
+        close(c->fd);
+    }
+    if (c->spill >= 0)
+        close(c->spill);
+    held -= c->size;
+    free(c->ring);
+    free(c->part);
+    free(c);
+}
+
+/* ca_reclaim - Free the rings of finished jobs, oldest first, until n bytes fit */
+static void ca_reclaim(struct cap_t *keep, size_t n)
+{
+    struct cap_t *c, *next;
+
+    for (c = caps; c != NULL && held + n > totalcap; c = next) {
+        next = c->next;
+        if (c != keep && c->fd < 0 && getjobpid(jobs, c->pid) == NULL)
+            ca_free(c);
+    }
+}
+
+/*
+ * ca_grow - Make c's ring big enough for n more bytes if the caps
+ * allow, doubling it; whatever is held is moved to the start.
+ */
+static void ca_grow(struct cap_t *c, size_t n)
+{
+    size_t size = c->size;
+    char *ring;
+
+    while (size < jobcap && c->len + n > size)
+        size = size == 0 ? CA_MIN : 2 * size;
+    if (size > jobcap)
+        size = jobcap;
+    if (size <= c->size)
+        return;
+    if (held + size - c->size > totalcap)
+        ca_reclaim(c, size - c->size);
+    while (size > c->size && held + size - c->size > totalcap)
+        size /= 2;                      /* as much as the global cap leaves */
+    if (size <= c->size)
+        return;
+    if ((ring = (char *)malloc(size)) == NULL)
+        return;                         /* keep wrapping in the ring we have */
+    if (c->len > 0) {
+        size_t start = (c->head + c->size - c->len) % c->size;
+        size_t first = c->len < c->size - start ? c->len : c->size - start;
+
+        memcpy(ring, c->ring + start, first);
+        memcpy(ring + first, c->ring, c->len - first);
+    }
+    free(c->ring);
+    held += size - c->size;
+    c->ring = ring;
+    c->size = size;
+    c->head = c->len;
+}
+
+/* ca_put - Add n bytes to c's ring, dropping its oldest if it is full */
+static void ca_put(struct cap_t *c, const char *s, size_t n)
+{
+    if (c->len + n > c->size)
+        ca_grow(c, n);
+    if (n > c->size) {                  /* only the end of it fits */
+        c->dropped += c->len + n - c->size;
+        s += n - c->size;
+        n = c->size;
+        c->len = 0;
+    }
+    else if (c->len + n > c->size) {
+        c->dropped += c->len + n - c->size;
+        c->len = c->size - n;
+    }
+    for (size_t k; n > 0; s += k, n -= k) {
+        k = n < c->size - c->head ? n : c->size - c->head;
+        memcpy(c->ring + c->head, s, k);
+        c->head = (c->head + k) % c->size;
+        c->len += k;
+    }
+}
+
+
+/***********************************************
+ * Line mode
+ **********************************************/
+
+/* mx_flush - Write the waiting lines in one writev (or more, if it comes up short) */
+static void mx_flush(void)
+{
+    struct iovec *v = iov;
+    int n = niov;
+
+    if (n == 0)
+        return;
+    fflush(stdout);                     /* the shell's own output goes first */
+    while (n > 0) {
+        ssize_t w = writev(1, v, n);
+
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0)
+            break;
+        while (n > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    niov = 0;
+}
+
+/* mx_add - Queue n bytes at s, which must stay put until mx_flush */
+static void mx_add(const char *s, size_t n)
+{
+    if (n == 0)
+        return;
+    if (niov == MX_IOV)
+        mx_flush();
+    iov[niov].iov_base = (void *)s;
+    iov[niov].iov_len = n;
+    niov++;
+}
+
+/* mx_part - Keep n bytes of an unfinished line; -1 if there is no room */
+static int mx_part(struct cap_t *c, const char *s, size_t n)
+{
+    if (c->plen + n > c->pcap) {
+        size_t cap = c->pcap ? 2 * c->pcap : 256;
+        char *p;
+
+        while (cap < c->plen + n)
+            cap *= 2;
+        if ((p = (char *)realloc(c->part, cap)) == NULL)
+            return -1;
+        c->part = p;
+        c->pcap = cap;
+    }
+    memcpy(c->part + c->plen, s, n);
+    c->plen += n;
+    return 0;
+}
+
+/* mx_end - Write out the unfinished line as a whole one */
+static void mx_end(struct cap_t *c)
+{
+    if (c->plen == 0)
+        return;
+    mx_add(c->tag, c->tlen);
+    mx_add(c->part, c->plen);
+    mx_add("\n", 1);
+    mx_flush();
+    c->plen = 0;
+}
+
+/*
+ * mx_lines - Write the complete lines in the n bytes at s, each
+ * whole, after c's tag; the last, unfinished one waits for the rest.
+ * Untagged, a run of lines goes as one piece.
+ */
+static void mx_lines(struct cap_t *c, const char *s, size_t n)
+{
+    const char *end = s + n, *nl;
+
+    if ((nl = (const char *)memchr(s, '\n', n)) == NULL) {
+        if (c->plen + n > MX_LINE || mx_part(c, s, n) < 0) {
+            mx_end(c);                  /* too long: cut it */
+            if (mx_part(c, s, n) < 0)
+                mx_add(s, n);
+        }
+        mx_flush();
+        return;
+    }
+    mx_add(c->tag, c->tlen);            /* the line already begun */
+    mx_add(c->part, c->plen);
+    if (c->tlen == 0) {                 /* and every other complete one */
+        nl = (const char *)memrchr(s, '\n', n);
+        mx_add(s, nl + 1 - s);
+        s = nl + 1;
+    }
+    else {
+        mx_add(s, nl + 1 - s);
+        for (s = nl + 1; s < end && (nl = (const char *)memchr(s, '\n', end - s)) != NULL;
+             s = nl + 1) {
+            mx_add(c->tag, c->tlen);
+            mx_add(s, nl + 1 - s);
+        }
+    }
+    mx_flush();                         /* before part is reused */
+    c->plen = 0;
+    if (s < end && mx_part(c, s, end - s) < 0) {
+        mx_add(s, end - s);
+        mx_flush();
+    }
+}
+
+
+/***********************************************
+ * Draining the pipes
+ **********************************************/
+
+/* ca_write - Write all n bytes at s to fd, as far as it will take them */
+static void ca_write(int fd, const char *s, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, s, n);
+
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return;
+        s += w;
+        n -= w;
+    }
+}
+
+/*
+ * ca_event - Event loop handler for a job's pipe: into the ring (and
+ * the spill file), and to the terminal while the job is in the
+ * foreground, or always in line mode.  The pipe is closed at end of
+ * file.
+ */
+static void ca_event(int fd, unsigned int events, void *arg)
+{
+    static char buf[CA_BUF];
+    struct cap_t *c = (struct cap_t *)arg;
+
+    for (int i = 0; i < CA_READS; i++) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        struct job_t *job;
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return;
+        if (n <= 0) {
+            evloop_del(fd);
+            close(fd);
+            c->fd = -1;
+            if (mux)
+                mx_end(c);
+            return;
+        }
+        if (mux)
+            mx_lines(c, buf, n);
+        else if ((job = getjobpid(jobs, c->pid)) != NULL && job->state == FG) {
+            fflush(stdout);
+            ca_write(1, buf, n);
+        }
+        if (c->spill >= 0)
+            ca_write(c->spill, buf, n);
+        if (jobcap > 0)
+            ca_put(c, buf, n);
+    }
+}
+
+
+/***********************************************
+ * Jobs
+ **********************************************/
+
+/* ca_size - Parse a size with an optional K, M or G; 0 if it isn't one */
+static size_t ca_size(const char *s, char **end)
+{
+    unsigned long long n = strtoull(s, end, 10);
+
+    if (*end == s)
+        return 0;
+    switch (**end) {
+    case 'G': case 'g': n <<= 10;   /* fall through */
+    case 'M': case 'm': n <<= 10;   /* fall through */
+    case 'K': case 'k': n <<= 10; (*end)++;
+    }
+    return n > SIZE_MAX / 2 ? 0 : n;
+}
+
+/* capture_setup - tsh -o <size>[,<total>]: turn capture on; -1 if spec is bad */
+int capture_setup(const char *spec)
+{
+    char *end;
+
+    if ((jobcap = ca_size(spec, &end)) == 0)
+        return -1;
+    totalcap = 16 * jobcap;
+    if (*end == ',' && ((totalcap = ca_size(end + 1, &end)) == 0 || totalcap < jobcap))
+        return -1;
+    return *end == '\0' ? 0 : -1;
+}
+
+/* capture_lines - tsh -l (or -L, with tags): job output to the terminal by whole lines */
+void capture_lines(int tags)
+{
+    mux = tags ? 2 : 1;
+}
+
+/* capture_spill - tsh -O <dir>: also keep all of each job's output in dir */
+int capture_spill(const char *dir)
+{
+    if (access(dir, W_OK | X_OK) < 0) {
+        printf("%s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    spilldir = strdup(dir);
+    return 0;
+}
+
+/*
+ * capture_start - Before a background job is forked: the write end of
+ * a new pipe, to be its stdout and stderr, or -1 if capture is off.
+ */
+int capture_start(void)
+{
+    int fds[2];
+
+    if (jobcap == 0 && !mux)
+        return -1;
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        printf("capture: %s\n", strerror(errno));
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);     /* the job's end stays blocking */
+    if (mux)
+        fcntl(fds[0], F_SETPIPE_SZ, CA_PIPE);   /* fewer wakeups; best effort */
+    rfd = fds[0];
+    return fds[1];
+}
+
+/*
+ * capture_job - In the shell, once the job is forked: close fd (the
+ * write end from capture_start) and start draining the pipe for job
+ * pid.  A pid < 0 means the fork failed.  An older capture with the
+ * same job ID is freed.
+ */
+void capture_job(int fd, pid_t pid, int jid)
+{
+    struct cap_t *c, *next, **pp;
+
+    if (fd < 0)
+        return;
+    close(fd);
+    if (pid < 0 || (c = (struct cap_t *)calloc(1, sizeof(*c))) == NULL) {
+        close(rfd);
+        rfd = -1;
+        return;
+    }
+    for (struct cap_t *o = caps; o != NULL; o = next) {
+        next = o->next;
+        if (o->jid == jid)
+            ca_free(o);
+    }
+    c->pid = pid;
+    c->jid = jid;
+    c->fd = rfd;
+    c->spill = -1;
+    if (mux == 2)
+        c->tlen = snprintf(c->tag, sizeof(c->tag), "[%d] ", jid);
+    rfd = -1;
+    if (spilldir != NULL) {
+        char path[PATH_MAX];
+
+        snprintf(path, sizeof(path), "%s/tsh-%d-%d.out", spilldir, (int)getpid(), (int)pid);
+        if ((c->spill = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0)
+            printf("%s: %s\n", path, strerror(errno));
+    }
+    for (pp = &caps; *pp != NULL; pp = &(*pp)->next)
+        ;
+    *pp = c;
+    if (evloop_add(c->fd, EPOLLIN, ca_event, c) < 0)
+        unix_error("epoll_ctl error");
+}
+
+/* capture_show - jobs -o %N: print what job N wrote, oldest first */
+int capture_show(int jid)
+{
+    struct cap_t *c, *found = NULL;
+
+    for (c = caps; c != NULL; c = c->next)
+        if (c->jid == jid)
+            found = c;
+    if ((c = found) == NULL) {
+        printf("jobs: %%%d: no output captured\n", jid);
+        return 1;
+    }
+    if (c->fd >= 0)
+        ca_event(c->fd, EPOLLIN, c);        /* whatever is in the pipe now */
+    if (c->dropped > 0) {
+        printf("[%d] (%d) ... %lu earlier bytes dropped", c->jid, (int)c->pid, c->dropped);
+        if (c->spill >= 0)
+            printf(", all in %s/tsh-%d-%d.out", spilldir, (int)getpid(), (int)c->pid);
+        printf("\n");
+    }
+    if (c->len > 0) {
+        size_t start = (c->head + c->size - c->len) % c->size;
+        size_t first = c->len < c->size - start ? c->len : c->size - start;
+
+        fwrite(c->ring + start, 1, first, stdout);
+        fwrite(c->ring, 1, c->len - first, stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+//-*-c++-*-
+#ifndef _capture_h_
+#define _capture_h_
+
+#include <sys/types.h>
+
+/*
+ * Output capture for background jobs (tsh -o <size>[,<total>]).  A job
+ * started in the background gets a pipe for its stdout and stderr in
+ * place of the shell's, and the event loop drains it into a ring
+ * buffer, so the last <size> bytes the job wrote are kept however long
+ * nobody looks.  "jobs -o %N" prints them.  While the job is in the
+ * foreground (fg), its output also goes through to the terminal.
+ *
+ * Rings grow as output arrives, up to <size> each and <total> (16
+ * times <size> unless given) for all of them.  At the global cap the
+ * rings of jobs that have finished are freed, oldest first; if that is
+ * not enough, the ring stops growing and wraps.  Either way, the bytes
+ * a ring drops are counted and reported.  Sizes take a K, M or G.
+ *
+ * With "tsh -O <dir>", everything a job writes is also appended to
+ * <dir>/tsh-<shell pid>-<job pid>.out, so nothing is lost.
+ *
+ * A capture outlives its job until the job ID is used again.
+ *
+ * Line mode (tsh -l, or -L to tag each line "[jid] ") uses the same
+ * pipes to keep concurrent jobs from tearing each other's lines: the
+ * shell writes a job's output to its own stdout only in whole lines,
+ * keeping an unfinished one until its newline comes (or the job ends,
+ * or it passes 64K, where it is cut).  The lines of each read go out
+ * in one writev, straight from the read buffer; untagged, a run of
+ * lines is a single piece.
+ */
+
+int  capture_setup(const char *spec);
+void capture_lines(int tags);
+int  capture_spill(const char *dir);
+int  capture_start(void);
+void capture_job(int fd, pid_t pid, int jid);
+int  capture_show(int jid);
+
+#endif
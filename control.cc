@@ -0,0 +1,394 @@
+#include "control.h"
+#include "evloop.h"
+#include "jobs.h"
+#include "journal.h"
+#include "helper-routines.h"
+#include "tsh.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "expand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/***********************************************
+ * Remote control socket
+ **********************************************/
+
+#define CC_INBUF  65536       /* longest request line */
+#define CC_OUTMAX (1 << 20)   /* stop reading while this much is unsent */
+
+struct ccwait_t {           /* A deferred "fg" reply */
+    pid_t pid;
+    int   jid;
+};
+
+struct cclient_t {          /* A connected client */
+    int     fd;
+    int     eof;            /* client shut down its side */
+    unsigned int events;    /* events currently watched */
+    char    in[CC_INBUF];   /* partial request line */
+    int     inlen;
+    char   *out;            /* replies not yet sent */
+    size_t  outlen, outoff, outcap;
+    struct ccwait_t *waits; /* jobs with a deferred reply */
+    int     nwaits, capwaits;
+    struct cclient_t *next;
+};
+
+static struct cclient_t *clients;   /* all connected clients */
+
+
+/* cc_printf - Queue a reply */
+static void cc_printf(struct cclient_t *c, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(c->out + c->outlen, c->outcap - c->outlen, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if (c->outlen + n < c->outcap)
+            break;
+        c->outcap = c->outcap ? 2 * c->outcap : 4096;
+        while (c->outcap <= c->outlen + n)
+            c->outcap *= 2;
+        if ((c->out = (char *)realloc(c->out, c->outcap)) == NULL)
+            unix_error("realloc error");
+    }
+    c->outlen += n;
+}
+
+/* cc_close - Disconnect a client */
+static void cc_close(struct cclient_t *c)
+{
+    struct cclient_t **pp;
+
+    for (pp = &clients; *pp != c; pp = &(*pp)->next)
+        ;
+    *pp = c->next;
+    evloop_del(c->fd);
+    close(c->fd);
+    free(c->out);
+    free(c->waits);
+    free(c);
+}
+
+/*
+ * cc_flush - Send queued replies, then watch for whatever the client
+ * needs next.  A client that has hung up and is owed nothing is closed.
+ */
+static void cc_flush(struct cclient_t *c)
+{
+    unsigned int events = 0;
+
+    while (c->outoff < c->outlen) {
+        ssize_t n = send(c->fd, c->out + c->outoff, c->outlen - c->outoff,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n < 0) {
+            cc_close(c);
+            return;
+        }
+        c->outoff += n;
+    }
+    if (c->outoff == c->outlen)
+        c->outoff = c->outlen = 0;
+
+    if (!c->eof && c->outlen - c->outoff < CC_OUTMAX)
+        events |= EPOLLIN;
+    if (c->outoff < c->outlen)
+        events |= EPOLLOUT;
+    if (events == 0 && c->nwaits == 0) {
+        cc_close(c);
+        return;
+    }
+    if (events != c->events) {
+        evloop_mod(c->fd, events);
+        c->events = events;
+    }
+}
+
+/* cc_job - Find the job named by a %jid or pid argument */
+static struct job_t *cc_job(const char *arg)
+{
+    if (arg == NULL)
+        return NULL;
+    if (arg[0] == '%')
+        return getjobjid(jobs, atoi(arg + 1));
+    if (isdigit(arg[0]))
+        return getjobpid(jobs, atoi(arg));
+    return NULL;
+}
+
+/*
+ * cc_run - Handle "run <cmdline>".  The line is expanded the way eval
+ * expands one typed in, quotes, substitutions, globs and all, so there
+ * is no limit on its words.  A here-document's body would have to come
+ * from the shell's own input, so one is refused.
+ */
+static void cc_run(struct cclient_t *c, const char *cmd)
+{
+    char cmdline[MAXLINE];
+    char **argv;
+    const struct builtin_t *b;
+    size_t len = strlen(cmd);
+    const char *h;
+    int i, used = 0;
+    pid_t pid;
+
+    if (len + 2 > MAXLINE) {
+        cc_printf(c, "err command line too long\n");
+        return;
+    }
+    for (h = cmd; (h = strstr(h, "<<")) != NULL; h += 3)
+        if (h[2] != '<') {
+            cc_printf(c, "err here-documents need the shell's input\n");
+            return;
+        }
+    memcpy(cmdline, cmd, len);
+    strcpy(cmdline + len, "\n");
+    expand_line(cmdline, &argv);
+    if (argv[0] == NULL) {
+        cc_printf(c, "err empty command\n");
+        return;
+    }
+    if ((b = builtin_find(argv[0])) != NULL && !(b->flags & BI_BG)) {
+        cc_printf(c, "err %s: builtin, send it as a request\n", argv[0]);
+        expand_psubs_drop();
+        return;
+    }
+    if (b == NULL)
+        argv[0] = (char *)pathcache_resolve(argv[0]);
+    if (b == NULL && access(argv[0], F_OK) < 0) {
+        cc_printf(c, "err %s: Command not found\n", argv[0]);
+        expand_psubs_drop();
+        return;
+    }
+    for (i = 0; jobs != NULL && i < MAXJOBS; i++)
+        used += jobs[i].pid != 0;
+    if (used == MAXJOBS) {
+        cc_printf(c, "err too many jobs\n");
+        expand_psubs_drop();
+        return;
+    }
+    if ((pid = launch(argv, BG, cmdline, expand_stdin())) <= 0) {
+        if (pid < 0)
+            cc_printf(c, "err fork: %s\n", strerror(errno));
+        else
+            cc_printf(c, "err too many jobs\n");
+        return;
+    }
+    cc_printf(c, "ok %d %d\n", pid2jid(pid), pid);
+}
+
+/* cc_request - Handle one request line */
+static void cc_request(struct cclient_t *c, char *line)
+{
+    char *verb, *arg, *arg2, *rest;
+    struct job_t *job;
+
+    while (*line == ' ')
+        line++;
+    rest = line + strcspn(line, " ");
+    if (*rest)
+        *rest++ = '\0';
+    verb = line;
+
+    if (!strcmp(verb, "run")) {
+        cc_run(c, rest);
+        return;
+    }
+    if (!strcmp(verb, "ping")) {
+        cc_printf(c, "ok\n");
+        return;
+    }
+    if (!strcmp(verb, "jobs")) {
+        char *buf = NULL;
+        size_t len = 0;
+        FILE *fp = open_memstream(&buf, &len);
+
+        if (fp == NULL)
+            unix_error("open_memstream error");
+        listjobs_json(fp, jobs);
+        fclose(fp);
+        cc_printf(c, "ok %s\n", buf);
+        free(buf);
+        return;
+    }
+
+    arg = strtok(rest, " ");
+    arg2 = strtok(NULL, " ");
+    if (strcmp(verb, "fg") && strcmp(verb, "bg") && strcmp(verb, "kill")) {
+        cc_printf(c, "err %s: unknown request\n", verb);
+        return;
+    }
+    if ((job = cc_job(arg)) == NULL) {
+        cc_printf(c, "err %s: No such job\n", arg ? arg : "");
+        return;
+    }
+    if (!strcmp(verb, "kill")) {
+        int sig = arg2 ? atoi(arg2) : SIGTERM;
+
+        if (sig < 0 || sig >= NSIG || kill(-job->pid, sig) < 0)
+            cc_printf(c, "err kill: %s\n", strerror(sig < 0 || sig >= NSIG ? EINVAL : errno));
+        else
+            cc_printf(c, "ok\n");
+        return;
+    }
+
+    /* fg and bg both continue the job; it never gets the terminal */
+    if (job->state != BG) {
+        job->state = BG;
+        journal_state(job);
+    }
+    kill(-job->pid, SIGCONT);
+    if (!strcmp(verb, "bg")) {
+        cc_printf(c, "ok\n");
+        return;
+    }
+    if (c->nwaits == c->capwaits) {
+        c->capwaits = c->capwaits ? 2 * c->capwaits : 4;
+        c->waits = (struct ccwait_t *)realloc(c->waits, c->capwaits * sizeof(*c->waits));
+        if (c->waits == NULL)
+            unix_error("realloc error");
+    }
+    c->waits[c->nwaits].pid = job->pid;
+    c->waits[c->nwaits].jid = job->jid;
+    c->nwaits++;
+}
+
+/* cc_lines - Handle every complete request line in the input buffer */
+static void cc_lines(struct cclient_t *c)
+{
+    char *p = c->in, *end = c->in + c->inlen, *nl;
+
+    while ((nl = (char *)memchr(p, '\n', end - p)) != NULL) {
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r')
+            nl[-1] = '\0';
+        cc_request(c, p);
+        p = nl + 1;
+    }
+    c->inlen = end - p;
+    memmove(c->in, p, c->inlen);
+    if (c->inlen == CC_INBUF) {
+        cc_printf(c, "err request too long\n");
+        c->inlen = 0;
+    }
+}
+
+/* cc_event - Event loop handler for a client */
+static void cc_event(int fd, unsigned int events, void *arg)
+{
+    struct cclient_t *c = (struct cclient_t *)arg;
+
+    if (c->eof && (events & (EPOLLHUP | EPOLLERR))) {
+        cc_close(c);            /* gone for good; drop deferred replies */
+        return;
+    }
+    while (!c->eof && c->outlen - c->outoff < CC_OUTMAX) {
+        ssize_t n = recv(fd, c->in + c->inlen, CC_INBUF - c->inlen, MSG_DONTWAIT);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0) {
+            c->eof = 1;
+            break;
+        }
+        c->inlen += n;
+        cc_lines(c);
+    }
+    cc_flush(c);
+}
+
+/* cc_accept - Event loop handler for the listening socket */
+static void cc_accept(int lfd, unsigned int events, void *arg)
+{
+    int fd;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct cclient_t *c = (struct cclient_t *)calloc(1, sizeof(*c));
+
+        if (c == NULL || evloop_add(fd, EPOLLIN, cc_event, c) < 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        c->next = clients;
+        clients = c;
+    }
+}
+
+/*
+ * control_poll - Send the deferred replies for "fg" requests whose
+ * job has exited or stopped.  Runs whenever the event loop wakes.
+ */
+void control_poll(void)
+{
+    struct cclient_t *c, *next;
+    int i;
+
+    for (c = clients; c != NULL; c = next) {
+        int sent = 0;
+
+        next = c->next;
+        for (i = 0; i < c->nwaits; ) {
+            struct job_t *job = getjobpid(jobs, c->waits[i].pid);
+
+            if (job != NULL && job->state != ST) {
+                i++;
+                continue;
+            }
+            cc_printf(c, "ok %d %s\n", c->waits[i].jid, job ? "stopped" : "done");
+            c->waits[i] = c->waits[--c->nwaits];
+            sent = 1;
+        }
+        if (sent)
+            cc_flush(c);
+    }
+}
+
+/* control_listen - Accept control clients on the Unix socket at path */
+int control_listen(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        printf("control: %s: path too long\n", path);
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+        bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        listen(fd, 128) < 0 ||
+        evloop_add(fd, EPOLLIN, cc_accept, NULL) < 0) {
+        printf("control: %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return 0;
+}
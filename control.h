@@ -0,0 +1,30 @@
+//-*-c++-*-
+#ifndef _control_h_
+#define _control_h_
+
+/*
+ * Remote control socket.  "tsh -c <path>" accepts any number of local
+ * clients on a Unix socket, multiplexed in the same event loop that
+ * reads stdin.  Each request is one line and gets one reply line:
+ *
+ *     run <cmdline>            start cmdline as a background job
+ *                              -> ok <jid> <pid>
+ *     jobs                     -> ok <JSON array, as jobs --json>
+ *     bg <%jid|pid>            continue a job in the background -> ok
+ *     fg <%jid|pid>            continue a job and reply once it exits
+ *                              or stops -> ok <jid> done|stopped
+ *     kill <%jid|pid> [sig]    signal the job's process group -> ok
+ *     ping                     -> ok
+ *
+ * The cmdline of "run" is expanded as a typed-in line is (expand.h),
+ * except that it can't have a here-document.
+ *
+ * Failures reply "err <message>".  A client may send thousands of
+ * requests in one write; they are all handled in a single pass and
+ * the replies go back in one send.
+ */
+
+int  control_listen(const char *path);
+void control_poll(void);
+
+#endif
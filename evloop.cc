@@ -0,0 +1,135 @@
+#include "evloop.h"
+#include "helper-routines.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+
+/***********************************************
+ * epoll-based event loop
+ **********************************************/
+
+#define EV_BATCH 64   /* events taken per epoll_pwait */
+
+struct evsrc_t {            /* A registered descriptor */
+    evhandler_t *handler;   /* NULL if the slot is free */
+    void        *arg;
+};
+
+static int             epfd = -1;   /* epoll instance, created lazily */
+static struct evsrc_t *srcs;        /* indexed by descriptor */
+static int             nsrcs;       /* slots in srcs */
+static int             nactive;     /* registered descriptors */
+static void          (*wakefn)(void);
+
+
+/*
+ * evloop_add - Watch fd for events, calling handler when any occur.
+ * Returns -1 with errno set if epoll refuses the descriptor (EPERM
+ * for regular files, which are always ready).
+ */
+int evloop_add(int fd, unsigned int events, evhandler_t *handler, void *arg)
+{
+    struct epoll_event ev;
+
+    if (epfd < 0 && (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        unix_error("epoll_create error");
+    if (fd >= nsrcs) {
+        int n = nsrcs ? nsrcs : 16;
+
+        while (n <= fd)
+            n *= 2;
+        srcs = (struct evsrc_t *)realloc(srcs, n * sizeof(*srcs));
+        if (srcs == NULL)
+            unix_error("realloc error");
+        memset(srcs + nsrcs, 0, (n - nsrcs) * sizeof(*srcs));
+        nsrcs = n;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return -1;
+    srcs[fd].handler = handler;
+    srcs[fd].arg = arg;
+    nactive++;
+    return 0;
+}
+
+/* evloop_mod - Change the events watched on fd */
+void evloop_mod(int fd, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+        unix_error("epoll_ctl error");
+}
+
+/* evloop_del - Stop watching fd.  Call before closing it. */
+void evloop_del(int fd)
+{
+    if (fd >= nsrcs || srcs[fd].handler == NULL)
+        return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    srcs[fd].handler = NULL;
+    srcs[fd].arg = NULL;
+    nactive--;
+}
+
+/* evloop_busy - Is any descriptor registered? */
+int evloop_busy(void)
+{
+    return nactive > 0;
+}
+
+/* evloop_on_wake - Run fn every time evloop_wait returns */
+void evloop_on_wake(void (*fn)(void))
+{
+    wakefn = fn;
+}
+
+/*
+ * evloop_wait - Sleep until a watched descriptor is ready, a signal
+ * arrives or timeout milliseconds pass (-1 = forever), then run the
+ * handlers of the ready descriptors.  SIGCHLD is unblocked for the
+ * duration of the wait only.  Returns the number of events handled.
+ */
+int evloop_wait(int timeout)
+{
+    struct epoll_event evs[EV_BATCH];
+    sigset_t mask;
+    int i, n = 0;
+
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    sigdelset(&mask, SIGCHLD);
+
+    if (nactive == 0) {
+        struct timespec ts;
+
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        ppoll(NULL, 0, timeout < 0 ? NULL : &ts, &mask);
+    }
+    else if ((n = epoll_pwait(epfd, evs, EV_BATCH, timeout, &mask)) < 0) {
+        if (errno != EINTR)
+            unix_error("epoll_wait error");
+        n = 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        int fd = evs[i].data.fd;
+
+        if (fd < nsrcs && srcs[fd].handler != NULL)
+            srcs[fd].handler(fd, evs[i].events, srcs[fd].arg);
+    }
+    if (wakefn)
+        wakefn();
+    return n;
+}
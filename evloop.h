@@ -0,0 +1,28 @@
+//-*-c++-*-
+#ifndef _evloop_h_
+#define _evloop_h_
+
+#include <sys/epoll.h>
+
+/*
+ * The shell's event loop.  Everything the main loop waits for (the
+ * next command line, a foreground job, control sockets) goes through
+ * evloop_wait, which sleeps in epoll_pwait with SIGCHLD unblocked so
+ * that a child changing state always wakes it.  Callers block SIGCHLD
+ * while they test their wakeup condition, which closes the race
+ * between the test and the wait.
+ *
+ * The epoll instance is created the first time a descriptor is added;
+ * until then evloop_wait is just sigsuspend.
+ */
+
+typedef void evhandler_t(int fd, unsigned int events, void *arg);
+
+int  evloop_add(int fd, unsigned int events, evhandler_t *handler, void *arg);
+void evloop_mod(int fd, unsigned int events);
+void evloop_del(int fd);
+int  evloop_busy(void);
+int  evloop_wait(int timeout);
+void evloop_on_wake(void (*fn)(void));
+
+#endif
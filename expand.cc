@@ -0,0 +1,1029 @@
+#include "expand.h"
+#include "builtins.h"
+#include "pathcache.h"
+#include "wildcard.h"
+#include "heredoc.h"
+#include "vars.h"
+#include "script.h"
+#include "tsh.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include "tracing.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio_ext.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+/***********************************************
+ * The word arena
+ **********************************************/
+
+#define AR_CHUNK 65536      /* bytes in a chunk, unless one word needs more */
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+#define IS_HERE(p)  ((p)[0] == '<' && (p)[1] == '<')   /* <<WORD or <<<word */
+#define IS_PSUB(p)  (((p)[0] == '<' || (p)[0] == '>') && (p)[1] == '(')   /* <(cmd) or >(cmd) */
+
+struct chunk_t {            /* A block of word storage */
+    struct chunk_t *next;
+    size_t          size;   /* bytes at data */
+    char           *data;
+};
+
+struct map_t {              /* A mapped substitution output */
+    void  *addr;
+    size_t len;
+};
+
+struct psub_t {             /* A process substitution waiting for its job */
+    const char *cmd;        /* the command, in the line being expanded */
+    size_t      len;
+    int         jobfd;      /* the job's end of the pipe, as /dev/fd/N */
+    int         fd;         /* the command's end */
+    int         out;        /* <(cmd): the command writes */
+};
+
+static struct chunk_t *chunks;      /* every chunk, in the order they fill */
+static struct chunk_t *cur;         /* the chunk being filled */
+static size_t          used;        /* bytes used in cur */
+static size_t          wstart;      /* offset in cur of the word being built */
+static int             wquoted;     /* it had quotes, so keep it even if empty */
+static int             wpattern;    /* it is a glob pattern, with quoted text escaped */
+static int             nosplit;     /* expand_value: one word, as if quoted */
+
+static char          **av;          /* the words */
+static int             ac, acap;
+static struct map_t   *maps;        /* unmapped by the next expand_line */
+static int             nmaps, capmaps;
+static int             infd = -1;   /* here-document for stdin, closed likewise */
+static int             dynamic;     /* the line had something that can change */
+static struct psub_t   psubs[MAXPSUBS];   /* closed likewise, unless a job took them */
+static int             npsubs;
+
+
+/* ar_reset - Forget the last line's words, keeping the memory */
+static void ar_reset(void)
+{
+    while (nmaps > 0) {
+        nmaps--;
+        munmap(maps[nmaps].addr, maps[nmaps].len);
+    }
+    if (infd >= 0)
+        close(infd);
+    infd = -1;
+    expand_psubs_drop();
+    cur = chunks;
+    used = wstart = 0;
+    ac = 0;
+}
+
+/*
+ * ar_room - Make room for n more bytes of the word being built.  If
+ * the chunk is full, the start of the word moves to the next one that
+ * can hold it, so every word is contiguous and no pointer handed out
+ * ever moves.
+ */
+static void ar_room(size_t n)
+{
+    size_t wlen = used - wstart;
+    struct chunk_t *c;
+
+    if (cur != NULL && used + n <= cur->size)
+        return;
+    c = cur != NULL ? cur->next : chunks;
+    if (c == NULL || c->size < wlen + n) {
+        size_t size = wlen + n > AR_CHUNK / 2 ? 2 * (wlen + n) : AR_CHUNK;
+
+        if ((c = (struct chunk_t *)malloc(sizeof(*c) + size)) == NULL)
+            unix_error("malloc error");
+        c->size = size;
+        c->data = (char *)(c + 1);
+        if (cur == NULL) {
+            c->next = chunks;
+            chunks = c;
+        } else {
+            c->next = cur->next;
+            cur->next = c;
+        }
+    }
+    if (wlen > 0)
+        memcpy(c->data, cur->data + wstart, wlen);
+    cur = c;
+    wstart = 0;
+    used = wlen;
+}
+
+/* av_push - Append a word to argv */
+static void av_push(char *w)
+{
+    if (ac + 1 >= acap) {
+        acap = acap ? 2 * acap : MAXARGS;
+        if ((av = (char **)realloc(av, acap * sizeof(*av))) == NULL)
+            unix_error("realloc error");
+    }
+    av[ac++] = w;
+}
+
+/* map_add - Remember a mapping to undo at the next reset */
+static void map_add(void *addr, size_t len)
+{
+    if (nmaps == capmaps) {
+        capmaps = capmaps ? 2 * capmaps : 8;
+        if ((maps = (struct map_t *)realloc(maps, capmaps * sizeof(*maps))) == NULL)
+            unix_error("realloc error");
+    }
+    maps[nmaps].addr = addr;
+    maps[nmaps].len = len;
+    nmaps++;
+}
+
+/* word_begin - Start a new, empty word */
+static void word_begin(void)
+{
+    ar_room(1);
+    wstart = used;
+    wquoted = 0;
+}
+
+/* word_add - Append n bytes to the word being built */
+static void word_add(const char *s, size_t n)
+{
+    ar_room(n + 1);                 /* and its '\0' */
+    memcpy(cur->data + used, s, n);
+    used += n;
+}
+
+/* word_addq - Append quoted text, escaped if the word is a pattern */
+static void word_addq(const char *s, size_t n)
+{
+    if (!wpattern) {
+        word_add(s, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (strchr("*?[]\\", s[i]) != NULL && s[i] != '\0')
+            word_add("\\", 1);
+        word_add(s + i, 1);
+    }
+}
+
+/* word_end - Finish the word; an empty one counts only if quoted */
+static void word_end(void)
+{
+    if (used == wstart && !wquoted)
+        return;
+    ar_room(1);
+    cur->data[used++] = '\0';
+    av_push(cur->data + wstart);
+    wstart = used;
+}
+
+
+/***********************************************
+ * Command substitution
+ **********************************************/
+
+/* cs_close - The ')' that ends a $( whose body starts at p, or NULL */
+static const char *cs_close(const char *p)
+{
+    int depth = 0;
+
+    for ( ; *p; p++) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            if ((p = strchr(p + 1, *p)) == NULL)
+                return NULL;
+        }
+        else if (*p == '(')
+            depth++;
+        else if (*p == ')' && depth-- == 0)
+            return p;
+    }
+    return NULL;
+}
+
+/*
+ * cs_child - In the substitution child: run the command line with fd
+ * as its stdout (or with to, as fd to).  Builtins run here without an
+ * exec, like a job's.
+ */
+static void cs_child(char *line, int fd, int to)
+{
+    const struct builtin_t *b;
+    sigset_t mask;
+    char **argv;
+    int status;
+
+    __fpurge(stdout);               /* the shell's unwritten output isn't ours */
+    dup2(fd, to);
+    close(fd);
+    child_signals();
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    if (script_wants(line)) {       /* $(for ...; done) */
+        status = script_line(line, 0);
+        fflush(stdout);
+        _exit(status);
+    }
+    expand_line(line, &argv);
+    if (argv[0] == NULL)
+        _exit(0);
+    if (expand_stdin() >= 0)
+        dup2(expand_stdin(), 0);
+    if ((status = script_call(argv)) < 0 && (b = builtin_find(argv[0])) != NULL)
+        status = b->fn(argv);       /* a function or builtin runs right here */
+    if (status >= 0) {
+        fflush(stdout);
+        _exit(status);
+    }
+    execve(pathcache_resolve(argv[0]), argv, NULL);
+    fprintf(stderr, "%s: Command not found\n", argv[0]);
+    _exit(127);
+}
+
+/*
+ * cs_capture - Run the n bytes at cmd as a command line and return its
+ * output, mapped writable and less trailing newlines, with its length
+ * in *lenp; NULL if there was none.  The byte after the output is
+ * always mapped, so the last word can be ended in place.  The body is
+ * copied whole, however many script lines it spans.  The shell waits
+ * for the command with waitpid, so the event loop doesn't run (no
+ * socket is served, no job reaped) until it exits.
+ */
+static char *cs_capture(const char *cmd, size_t n, size_t *lenp)
+{
+    struct stat st;
+    size_t len;
+    char *line, *out;
+    pid_t pid;
+    int fd, status;
+
+    if ((line = (char *)malloc(n + 2)) == NULL) {
+        printf("command substitution: %s\n", strerror(errno));
+        return NULL;
+    }
+    memcpy(line, cmd, n);
+    strcpy(line + n, "\n");
+    if ((fd = memfd_create("tsh-subst", MFD_CLOEXEC)) < 0) {
+        printf("command substitution: %s\n", strerror(errno));
+        free(line);
+        return NULL;
+    }
+    TRACE_BEGIN("subst");
+    if ((pid = fork()) == 0)
+        cs_child(line, fd, 1);
+    free(line);
+    if (pid < 0) {
+        printf("Fork error: %s\n", strerror(errno));
+        close(fd);
+        TRACE_END("subst");
+        return NULL;
+    }
+    /* reaped here, before the event loop runs, so it never looks like a job */
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    TRACE_END("subst");
+
+    if (fstat(fd, &st) < 0 || (len = st.st_size) == 0 ||
+        ftruncate(fd, len + 1) < 0 ||
+        (out = (char *)mmap(NULL, len + 1, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    map_add(out, len + 1);
+    while (len > 0 && out[len - 1] == '\n')
+        len--;
+    *lenp = len;
+    return out;
+}
+
+/*
+ * cs_split - Split substitution output (or a variable's value) into
+ * words.  The first part joins the word being built and, unless ends
+ * says the word finishes with the substitution, so does the last.
+ * With inplace, the other words are ended in place in the output and
+ * used as they are; otherwise they are copied.
+ */
+static void cs_split(char *s, size_t len, int ends, int inplace)
+{
+    char *e = s + len;
+
+    while (s < e) {
+        if (IS_BLANK(*s)) {
+            word_end();
+            word_begin();
+            while (s < e && IS_BLANK(*s))
+                s++;
+            continue;
+        }
+
+        char *f = s;
+        while (s < e && !IS_BLANK(*s))
+            s++;
+        if (inplace && used == wstart && !wquoted && (s < e || ends)) {
+            *s = '\0';
+            av_push(f);
+            if (s < e)
+                s++;
+        }
+        else
+            word_add(f, s - f);
+    }
+}
+
+/* ex_subst - Expand the $(...) or `...` at p; returns what follows it */
+static const char *ex_subst(const char *p, int quoted)
+{
+    const char *body, *end;
+    size_t len;
+    char *out;
+
+    dynamic = 1;
+    if (*p == '`') {
+        body = p + 1;
+        end = strchr(body, '`');
+    } else {
+        body = p + 2;
+        end = cs_close(body);
+    }
+    if (end == NULL) {              /* unterminated: just text */
+        word_add(p, 1);
+        return p + 1;
+    }
+    out = cs_capture(body, end - body, &len);
+    p = end + 1;
+    if (out == NULL)
+        return p;
+    if (quoted)
+        word_add(out, len);
+    else
+        cs_split(out, len, *p == '\0' || IS_BLANK(*p), 1);
+    return p;
+}
+
+
+/***********************************************
+ * Process substitution
+ **********************************************/
+
+/*
+ * ex_psub - Expand the <(cmd) or >(cmd) at p to /dev/fd/N, the job's
+ * end of a new pipe; cmd is started by expand_psubs_start once the
+ * job has a process group.  Returns what follows it.
+ */
+static const char *ex_psub(const char *p)
+{
+    const char *end = cs_close(p + 2);
+    struct psub_t *s;
+    char buf[32];
+    int fds[2];
+
+    dynamic = 1;
+    if (end == NULL) {              /* unterminated: just text */
+        word_add(p, 1);
+        return p + 1;
+    }
+    if (npsubs == MAXPSUBS) {
+        printf("Too many process substitutions\n");
+        return end + 1;
+    }
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        printf("process substitution: %s\n", strerror(errno));
+        return end + 1;
+    }
+    s = &psubs[npsubs++];
+    s->cmd = p + 2;
+    s->len = end - (p + 2);
+    s->out = *p == '<';
+    s->jobfd = fds[s->out ? 0 : 1];
+    s->fd = fds[s->out ? 1 : 0];
+    word_add(buf, snprintf(buf, sizeof(buf), "/dev/fd/%d", s->jobfd));
+    return end + 1;
+}
+
+/* expand_psubs_child - In the job's child: keep its ends across exec, close the rest */
+void expand_psubs_child(void)
+{
+    for (int i = 0; i < npsubs; i++) {
+        fcntl(psubs[i].jobfd, F_SETFD, 0);
+        close(psubs[i].fd);
+    }
+}
+
+/*
+ * expand_psubs_start - Start the commands of the last line's process
+ * substitutions in process group pgid, each with its end of the pipe
+ * as stdout (<(cmd)) or stdin (>(cmd)), and close the shell's ends.
+ * Their pids go in pids (room for MAXPSUBS); returns how many.
+ */
+int expand_psubs_start(pid_t pgid, pid_t *pids)
+{
+    int n = 0;
+
+    for (int i = 0; i < npsubs; i++) {
+        struct psub_t *s = &psubs[i];
+        char *line = (char *)malloc(s->len + 2);
+        pid_t pid;
+
+        if (line == NULL) {
+            printf("process substitution: %s\n", strerror(errno));
+            continue;
+        }
+        memcpy(line, s->cmd, s->len);
+        strcpy(line + s->len, "\n");
+        if ((pid = fork()) == 0) {
+            int fd = s->fd;
+
+            setpgid(0, pgid);
+            for (int j = 0; j < npsubs; j++) {  /* only its own end stays */
+                close(psubs[j].jobfd);
+                if (j != i)
+                    close(psubs[j].fd);
+            }
+            npsubs = 0;
+            cs_child(line, fd, s->out ? 1 : 0);
+        }
+        free(line);
+        if (pid < 0) {
+            printf("Fork error: %s\n", strerror(errno));
+            continue;
+        }
+        setpgid(pid, pgid);         /* also here, as launch does */
+        pids[n++] = pid;
+    }
+    expand_psubs_drop();
+    return n;
+}
+
+/* expand_psubs_drop - Close the pipes of process substitutions no job took */
+void expand_psubs_drop(void)
+{
+    while (npsubs > 0) {
+        npsubs--;
+        close(psubs[npsubs].jobfd);
+        close(psubs[npsubs].fd);
+    }
+}
+
+
+/***********************************************
+ * Parameters and arithmetic
+ **********************************************/
+
+/*
+ * ex_is_expansion - Does p start a $-expansion or `...`?  Any other
+ * '$' is just a character.
+ */
+static int ex_is_expansion(const char *p)
+{
+    if (*p == '`')
+        return 1;
+    if (*p != '$' || p[1] == '\0')
+        return 0;
+    return strchr("({?#@*0123456789", p[1]) != NULL || var_name(p + 1) > 0;
+}
+
+/* ex_value - Add a parameter's value to the word; unquoted, it is split */
+static void ex_value(const char *v, size_t len, int quoted, const char *next)
+{
+    if (quoted || nosplit)
+        word_add(v, len);
+    else
+        cs_split((char *)v, len, *next == '\0' || IS_BLANK(*next), 0);
+}
+
+/* ex_arith_close - The "))" that ends a $(( whose body starts at p, or NULL */
+static const char *ex_arith_close(const char *p)
+{
+    int depth = 0;
+
+    for ( ; *p && *p != '\n'; p++) {
+        if (*p == '(')
+            depth++;
+        else if (*p == ')' && depth-- == 0)
+            return p[1] == ')' ? p : NULL;
+    }
+    return NULL;
+}
+
+/* ex_param - Expand the $name, ${name}, $?... or $((expr)) at p */
+static const char *ex_param(const char *p, int quoted)
+{
+    char buf[32], **params = var_param_list();
+    const char *name, *end, *v;
+    size_t n;
+
+    dynamic = 1;
+    if (p[1] == '(' && p[2] == '(' && (end = ex_arith_close(p + 3)) != NULL) {
+        long long x;
+
+        if (var_arith(p + 3, end - (p + 3), &x) == 0)
+            word_add(buf, snprintf(buf, sizeof(buf), "%lld", x));
+        return end + 2;
+    }
+    if (p[1] == '(')
+        return ex_subst(p, quoted || nosplit);
+
+    if (p[1] == '{') {                      /* ${name} */
+        name = p + 2;
+        if ((end = strchr(name, '}')) == NULL) {
+            word_add(p, 1);
+            return p + 1;
+        }
+        n = end - name;
+        end++;
+    } else {
+        name = p + 1;
+        n = var_name(name);
+        if (n == 0)
+            n = 1;                          /* $?, $1 and the like */
+        end = name + n;
+    }
+
+    if (n == 1 && (*name == '@' || *name == '*')) {
+        for (int i = 0; params[i]; i++) {
+            if (i > 0 && quoted && *name == '@') {  /* "$@": a word each */
+                word_end();
+                word_begin();
+                wquoted = 1;
+            }
+            else if (i > 0)
+                ex_value(" ", 1, quoted, end);
+            ex_value(params[i], strlen(params[i]), quoted, end);
+        }
+        return end;
+    }
+    if (n == 1 && *name == '?')
+        v = buf, snprintf(buf, sizeof(buf), "%d", var_last_status());
+    else if (n == 1 && *name == '#') {
+        int i = 0;
+
+        while (params[i])
+            i++;
+        v = buf, snprintf(buf, sizeof(buf), "%d", i);
+    }
+    else if (n == 1 && *name == '0')
+        v = "tsh";
+    else if (*name >= '1' && *name <= '9' && strspn(name, "0123456789") >= n) {
+        int i = atoi(name), k = 0;
+
+        while (k < i && params[k])
+            k++;
+        v = k == i ? params[i - 1] : NULL;
+    }
+    else
+        v = var_get(name, n);
+    if (v != NULL)
+        ex_value(v, strlen(v), quoted, end);
+    return end;
+}
+
+
+/***********************************************
+ * Words
+ **********************************************/
+
+/* ex_dquote - Add the inside of "..." to the word; p follows the '"' */
+static const char *ex_dquote(const char *p)
+{
+    while (*p && *p != '"' && *p != '\n') {
+        if (*p == '`')
+            p = ex_subst(p, 1);
+        else if (ex_is_expansion(p))
+            p = ex_param(p, 1);
+        else {
+            size_t n = strcspn(p + 1, "\"$`\n") + 1;
+
+            word_addq(p, n);
+            p += n;
+        }
+    }
+    return *p == '"' ? p + 1 : p;
+}
+
+/*
+ * ex_is_pattern - Is the word at p a glob pattern: an unquoted *, ?
+ * or [, and no substitution?
+ */
+static int ex_is_pattern(const char *p)
+{
+    int meta = 0;
+
+    for ( ; *p && !IS_BLANK(*p) && !IS_HERE(p); p++) {
+        if (ex_is_expansion(p) || IS_PSUB(p))
+            return 0;
+        if (*p == '\'' || *p == '"') {
+            char q = *p;
+
+            while (*++p && *p != q && *p != '\n')
+                if (q == '"' && ex_is_expansion(p))
+                    return 0;
+            if (*p != q)
+                break;
+        }
+        else if (*p == '*' || *p == '?')
+            meta = 1;
+        else if (*p == '[' && p[1 + strcspn(p + 1, " \t\n]")] == ']')   /* a lone [ is just a [ */
+            meta = 1;
+    }
+    return meta;
+}
+
+/* glob_emit - wildcard_expand callback: each path is a word */
+static void glob_emit(const char *path, size_t len)
+{
+    word_add(path, len);
+    word_end();
+}
+
+/* ex_cmp - qsort comparison of two words */
+static int ex_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * word_glob - Replace the pattern being built with the paths that
+ * match it, sorted, or if none do, with itself less the escapes.
+ */
+static void word_glob(void)
+{
+    char pat[2 * MAXLINE + 1];
+    size_t n = used - wstart;
+    int first = ac;
+
+    wpattern = 0;
+    dynamic = 1;
+    if (n >= sizeof(pat))
+        n = sizeof(pat) - 1;
+    memcpy(pat, cur->data + wstart, n);
+    pat[n] = '\0';
+    used = wstart;                  /* the matches go where it was */
+    if (wildcard_expand(pat, glob_emit) > 0) {
+        qsort(av + first, ac - first, sizeof(*av), ex_cmp);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (pat[i] == '\\' && i + 1 < n)
+            i++;
+        word_add(pat + i, 1);
+    }
+    word_end();
+}
+
+/* ex_word - Expand the word at p into zero or more words; glob says if it may be a pattern */
+static const char *ex_word(const char *p, int glob)
+{
+    word_begin();
+    wpattern = glob && ex_is_pattern(p);
+    while (*p && !IS_BLANK(*p) && !IS_HERE(p)) {
+        if (*p == '\'') {
+            const char *q = p + 1 + strcspn(p + 1, "'\n");
+
+            word_addq(p + 1, q - p - 1);
+            wquoted = 1;
+            p = *q == '\'' ? q + 1 : q;
+        }
+        else if (*p == '"') {
+            wquoted = 1;
+            p = ex_dquote(p + 1);
+        }
+        else if (*p == '`')
+            p = ex_subst(p, nosplit);
+        else if (ex_is_expansion(p))
+            p = ex_param(p, 0);
+        else if (IS_PSUB(p))
+            p = ex_psub(p);
+        else if (*p == '\\' && wpattern) {   /* the shell has no escapes: literal */
+            word_add("\\\\", 2);
+            p++;
+        }
+        else
+            word_add(p++, 1);
+    }
+    if (wpattern)
+        word_glob();
+    else
+        word_end();
+    return p;
+}
+
+/*
+ * ex_here - Make the here-document or here-string at p stdin; returns
+ * what follows it.  A here-document's body was read by heredoc_read,
+ * which skipped the word after << the same way.
+ */
+static const char *ex_here(const char *p)
+{
+    int fd = -1;
+
+    dynamic = 1;
+    if (p[2] == '<') {                      /* <<<word: one line, not globbed */
+        int first = ac;
+        size_t len = 0;
+        char *s;
+
+        p += 3;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p && !IS_BLANK(*p))
+            p = ex_word(p, 0);
+        for (int i = first; i < ac; i++)
+            len += strlen(av[i]) + 1;
+        if ((s = (char *)malloc(len + 1)) == NULL)
+            unix_error("malloc error");
+        for (int i = first, n = 0; i < ac; i++) {
+            strcpy(s + n, av[i]);
+            n += strlen(av[i]);
+            s[n++] = i + 1 < ac ? ' ' : '\n';
+        }
+        fd = heredoc_string(s, len);
+        ac = first;
+        free(s);
+    }
+    else {                                  /* <<WORD or <<-WORD */
+        const char *w;
+
+        p += 2 + (p[2] == '-');
+        while (*p == ' ' || *p == '\t')
+            p++;
+        w = p;
+        if ((p = heredoc_word(p)) == w)
+            return p;
+        if ((fd = heredoc_take()) < 0)      /* none was read: empty */
+            fd = heredoc_string("", 0);
+    }
+    if (infd >= 0)
+        close(infd);
+    infd = fd;
+    return p;
+}
+
+/* expand_stdin - The stdin the last line's here-document gave, or -1 */
+int expand_stdin(void)
+{
+    return infd;
+}
+
+
+/***********************************************
+ * The parse cache
+ **********************************************/
+
+#define PC_SLOTS   1024     /* hash chains, a power of two */
+#define PC_ENTRIES 512      /* lines kept; the least recently used goes */
+
+struct pline_t {            /* A line whose words can't change */
+    struct pline_t *next;           /* in its chain */
+    struct pline_t *newer, *older;  /* in the LRU list */
+    uint64_t        hash;
+    size_t          llen;           /* bytes of line */
+    size_t          size;           /* bytes of words, '\0'-terminated */
+    int             argc;
+    int             bg;             /* what expand_line returns */
+    size_t         *off;            /* argc offsets of words in words */
+    char           *line;           /* the raw line */
+    char           *words;
+};
+
+static struct pline_t *plines[PC_SLOTS];
+static struct pline_t *newest, *oldest;
+static int             npline;
+static int             pc_off;              /* expand_cache(0) */
+static unsigned long   pc_hits, pc_misses;
+
+/* pc_hash - 64-bit FNV-1a of the n bytes at s */
+static uint64_t pc_hash(const char *s, size_t n)
+{
+    uint64_t h = 14695981039346656037ull;
+
+    while (n-- > 0)
+        h = (h ^ (unsigned char)*s++) * 1099511628211ull;
+    return h;
+}
+
+/* pc_unlink - Take e out of the LRU list */
+static void pc_unlink(struct pline_t *e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        newest = e->older;
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        oldest = e->newer;
+}
+
+/* pc_front - Make e the most recently used */
+static void pc_front(struct pline_t *e)
+{
+    e->newer = NULL;
+    e->older = newest;
+    if (newest != NULL)
+        newest->newer = e;
+    else
+        oldest = e;
+    newest = e;
+}
+
+/* pc_evict - Forget the least recently used line */
+static void pc_evict(void)
+{
+    struct pline_t *e = oldest, **pp;
+
+    pc_unlink(e);
+    for (pp = &plines[e->hash & (PC_SLOTS - 1)]; *pp != e; pp = &(*pp)->next)
+        ;
+    *pp = e->next;
+    free(e);
+    npline--;
+}
+
+/*
+ * pc_find - Put the words of the len-byte line into av, copied into the
+ * arena in one piece, if it is cached; returns the entry or NULL.
+ */
+static struct pline_t *pc_find(const char *line, size_t len, uint64_t h)
+{
+    struct pline_t *e;
+    char *base;
+
+    for (e = plines[h & (PC_SLOTS - 1)]; e != NULL; e = e->next)
+        if (e->hash == h && e->llen == len && !memcmp(e->line, line, len))
+            break;
+    if (e == NULL) {
+        pc_misses++;
+        return NULL;
+    }
+    pc_hits++;
+    if (e != newest) {
+        pc_unlink(e);
+        pc_front(e);
+    }
+    ar_room(e->size);
+    base = cur->data + used;
+    memcpy(base, e->words, e->size);
+    used += e->size;
+    wstart = used;
+    for (int i = 0; i < e->argc; i++)
+        av_push(base + e->off[i]);
+    return e;
+}
+
+/* pc_add - Remember the len-byte line's words, now in av, and bg */
+static void pc_add(const char *line, size_t len, uint64_t h, int bg)
+{
+    struct pline_t *e;
+    size_t size = 0, n = 0;
+
+    for (int i = 0; i < ac; i++)
+        size += strlen(av[i]) + 1;
+    if (npline == PC_ENTRIES)
+        pc_evict();
+    e = (struct pline_t *)malloc(sizeof(*e) + ac * sizeof(size_t) + len + size);
+    if (e == NULL)
+        unix_error("malloc error");
+    e->off = (size_t *)(e + 1);
+    e->line = (char *)(e->off + ac);
+    e->words = e->line + len;
+    memcpy(e->line, line, len);
+    for (int i = 0; i < ac; i++) {
+        size_t wlen = strlen(av[i]) + 1;
+
+        e->off[i] = n;
+        memcpy(e->words + n, av[i], wlen);
+        n += wlen;
+    }
+    e->hash = h;
+    e->llen = len;
+    e->size = size;
+    e->argc = ac;
+    e->bg = bg;
+    e->next = plines[h & (PC_SLOTS - 1)];
+    plines[h & (PC_SLOTS - 1)] = e;
+    pc_front(e);
+    npline++;
+}
+
+/* expand_cache - Turn the parse cache on or off (it starts on) */
+void expand_cache(int on)
+{
+    pc_off = !on;
+    while (pc_off && npline > 0)
+        pc_evict();
+}
+
+/* expand_cache_stats - Lines found in the parse cache, and not */
+void expand_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    *hits = pc_hits;
+    *misses = pc_misses;
+}
+
+/*
+ * expand_line - Expand cmdline into *argvp.  Like parseline, returns
+ * true if the last word starts with '&' (which is dropped) or the line
+ * is blank.  A line with nothing to expand is parsed once and then
+ * found in the parse cache.
+ */
+int expand_line(const char *cmdline, char ***argvp)
+{
+    const char *p = cmdline;
+    int amp = -1;                   /* index of the last word written with & */
+    size_t len = 0;
+    uint64_t h = 0;
+    struct pline_t *e;
+    int bg;
+
+    TRACE_BEGIN("expand");
+    ar_reset();
+    if (!pc_off) {
+        len = strlen(cmdline);
+        h = pc_hash(cmdline, len);
+        if ((e = pc_find(cmdline, len, h)) != NULL) {
+            av_push(NULL);
+            ac--;
+            *argvp = av;
+            TRACE_END("expand");
+            return e->bg;
+        }
+    }
+    dynamic = 0;
+    for (;;) {
+        while (IS_BLANK(*p))
+            p++;
+        if (*p == '\0')
+            break;
+        if (IS_HERE(p)) {
+            p = ex_here(p);
+            continue;
+        }
+        if (*p == '&')
+            amp = ac;
+        p = ex_word(p, 1);
+    }
+    av_push(NULL);
+    ac--;
+    *argvp = av;
+
+    bg = 0;
+    if (ac == 0)                    /* ignore blank line */
+        bg = 1;
+    else if (amp == ac - 1) {       /* should the job run in the background? */
+        av[--ac] = NULL;
+        bg = 1;
+    }
+    if (!pc_off && !dynamic)
+        pc_add(cmdline, len, h, bg);
+    TRACE_END("expand");
+    return bg;
+}
+
+/*
+ * expand_words - Expand words already split out of a line (script.h)
+ * into *argvp; returns how many there are.  Words with nothing to
+ * expand are used as they are.
+ */
+int expand_words(char **words, int n, char ***argvp)
+{
+    TRACE_BEGIN("expand");
+    ar_reset();
+    for (int i = 0; i < n; i++) {
+        if (strpbrk(words[i], "'\"$`*?[\\(") == NULL)
+            av_push(words[i]);
+        else
+            ex_word(words[i], 1);
+    }
+    av_push(NULL);
+    ac--;
+    *argvp = av;
+    TRACE_END("expand");
+    return ac;
+}
+
+/*
+ * expand_value - Expand word into one string, unsplit and not globbed,
+ * as the value of an assignment is.  Valid until the next expansion.
+ */
+char *expand_value(const char *word)
+{
+    if (strpbrk(word, "'\"$`\\") == NULL)
+        return (char *)word;
+    ar_reset();
+    nosplit = 1;
+    ex_word(word, 0);
+    nosplit = 0;
+    return ac > 0 ? av[0] : (char *)"";
+}
@@ -0,0 +1,67 @@
+//-*-c++-*-
+#ifndef _expand_h_
+#define _expand_h_
+
+#include <sys/types.h>
+
+/*
+ * Word expansion.  expand_line splits a command line into words the
+ * way parseline does, blanks between words and '...' quoting, and
+ * also understands
+ *
+ *     "..."             one word; substitutions inside are not split
+ *     $(cmd) or `cmd`   command substitution: the output of cmd, less
+ *                       trailing newlines, split at blanks and newlines;
+ *                       the shell waits for cmd outside the event loop
+ *     *, ?, [...], **   pathname expansion (wildcard.h) of a word with
+ *                       any of these unquoted, and no substitution; the
+ *                       matches are sorted, and a word matching nothing
+ *                       is left as it is
+ *     $name, ${name}    a variable (vars.h), or $?, $#, $1...$9, $@, $*;
+ *                       unquoted, the value is split at blanks
+ *     $((expr))         integer arithmetic (var_arith)
+ *     <<WORD, <<<word   here-documents and here-strings (heredoc.h); the
+ *                       last one's memfd is expand_stdin until the next
+ *                       call, which closes it
+ *     <(cmd), >(cmd)    process substitution: /dev/fd/N, one end of a
+ *                       pipe whose other end is cmd's stdout (or stdin)
+ *
+ * expand_words does the same for words a script has already split out
+ * (script.h), and expand_value expands one word the way the value of
+ * an assignment is: not split and not globbed.
+ *
+ * The words are kept in an arena that the next call reuses, so argv
+ * stays valid until then, and there is no limit on their number.
+ *
+ * A line with nothing that can expand differently next time (no $,
+ * substitution, pattern or here-document) is parsed once: its words
+ * are kept, keyed by a hash of the raw line, in a parse cache of the
+ * last 512 such lines, and a hit is copied into the arena in one
+ * memcpy.  "tsh -C" turns the cache off; its hits and misses are in
+ * the metrics (tsh -m).
+ *
+ * A process substitution's pipe is made during expansion, but cmd is
+ * only started once there is a job to run it with: launch calls
+ * expand_psubs_child in the job's child, so it keeps its ends across
+ * the exec, and expand_psubs_start in the shell, which starts each cmd
+ * in the job's process group.  For a builtin or function the shell
+ * runs itself, the pipes are just closed.
+ *
+ * A substituted command runs in a child of the shell whose stdout is
+ * a memfd: nothing touches the disk, and once the child has exited
+ * its output is mapped and cut into words in place, so unquoted
+ * substitutions cost no copy at all.  The shell waits for that child
+ * itself; it is never on the job list.
+ */
+
+int   expand_line(const char *cmdline, char ***argvp);
+int   expand_stdin(void);
+int   expand_words(char **words, int n, char ***argvp);
+char *expand_value(const char *word);
+void  expand_psubs_child(void);
+int   expand_psubs_start(pid_t pgid, pid_t *pids);
+void  expand_psubs_drop(void);
+void  expand_cache(int on);
+void  expand_cache_stats(unsigned long *hits, unsigned long *misses);
+
+#endif
@@ -6,6 +6,7 @@
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
 #define MAXJOBS      16   /* max jobs at any point in time */
+#define MAXPSUBS      8   /* max process substitutions in a job */
 #define MAXJID    1<<16   /* max job ID */
 
 /* Global variables */
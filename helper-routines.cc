@@ -1,5 +1,7 @@
 #include "helper-routines.h"
 #include "globals.h"
+#include "tracing.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <strings.h>
 #include <memory.h> // strcpy and memcpy
@@ -7,6 +9,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
 
 
 pid_t Fork(void)
@@ -21,8 +24,21 @@ pid_t Fork(void)
 
 void Execve(const char *filename, char *const argv[], char *const envp[])
 {
-    if (execve(filename, argv, envp) < 0)
-	unix_error("Command not found: " + *filename);
+    if (execve(filename, argv, envp) < 0) {
+	metrics_note_exec_failure();	/* the shell counts these (tsh -m) */
+	if (errno == E2BIG) {	/* say how far over, and what to do about it */
+	    long len = 0;
+	    int i;
+
+	    for (i = 0; argv[i]; i++)
+		len += strlen(argv[i]) + 1 + sizeof(char *);
+	    fprintf(stdout, "%s: Argument list too long (%d args, %ld bytes, limit %ld); "
+		    "try: batch %s ...\n", filename, i, len, sysconf(_SC_ARG_MAX), argv[0]);
+	    exit(127);
+	}
+	fprintf(stdout, "%s: %s\n", filename, strerror(errno));
+	exit(127);
+    }
 }
 
 /* $begin wait */
@@ -143,10 +159,21 @@ int Sigismember(const sigset_t *set, int signum)
  */
 void usage(void)
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpuClL] [-j <journal>] [-m <socket>] [-c <socket>] [-H <history>]\n"
+           "             [-o <size>[,<total>]] [-O <dir>] [-w <threads>]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -u   run echo, true, false, test, sleep and kill in the shell\n");
+    printf("   -C   do not cache the words of repeated command lines\n");
+    printf("   -j   record job events in <journal> (see jobs --replay)\n");
+    printf("   -m   serve Prometheus metrics on Unix socket <socket>\n");
+    printf("   -c   accept remote control requests on Unix socket <socket>\n");
+    printf("   -H   keep command history in <history> (interactive: ~/.tsh_history)\n");
+    printf("   -o   capture background jobs' output, <size> per job (jobs -o %%N)\n");
+    printf("   -O   also keep all captured output in files in <dir>\n");
+    printf("   -l   write background jobs' output by whole lines (-L: tagged [jid])\n");
+    printf("   -w   walk ** patterns with <threads> threads (default: one per CPU)\n");
     exit(1);
 }
 
@@ -209,6 +236,7 @@ int parseline(const char *cmdline, char **argv)
     int argc;                   /* number of args */
     int bg;                     /* background job? */
 
+    TRACE_BEGIN("parseline");
     strcpy(buf, cmdline);
     buf[strlen(buf)-1] = ' ';  /* replace trailing '\n' with space */
     while (*buf && (*buf == ' ')) /* ignore leading spaces */
@@ -241,6 +269,7 @@ int parseline(const char *cmdline, char **argv)
     }
     argv[argc] = NULL;
 
+    TRACE_END("parseline");
     if (argc == 0)  /* ignore blank line */
 	return 1;
 
@@ -0,0 +1,286 @@
+#include "heredoc.h"
+#include "input.h"
+#include "globals.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define HD_MAX   64         /* here-documents in one command line or script */
+#define HD_BUF   65536      /* body bytes gathered per write */
+#define HD_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+static int pending[HD_MAX];         /* bodies read for the current line */
+static int npending, ntaken;
+static const int *given;            /* heredoc_give's, in their place */
+static int ngiven;
+
+
+/***********************************************
+ * Sealed memfds
+ **********************************************/
+
+/* hd_open - A new memfd for a body, or -1 */
+static int hd_open(void)
+{
+    int fd = memfd_create("tsh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd < 0)
+        printf("here-document: %s\n", strerror(errno));
+    return fd;
+}
+
+/* hd_write - Write all n bytes at s to fd; -1 on an error */
+static int hd_write(int fd, const char *s, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, s, n);
+
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0) {
+            printf("here-document: %s\n", strerror(errno));
+            return -1;
+        }
+        s += w;
+        n -= w;
+    }
+    return 0;
+}
+
+/*
+ * hd_seal - Rewind fd and seal it, so the body the job reads is the
+ * one that was written.  Returns fd, or -1 (and closes it) if failed.
+ */
+static int hd_seal(int fd, int failed)
+{
+    if (!failed && lseek(fd, 0, SEEK_SET) == 0 && fcntl(fd, F_ADD_SEALS, HD_SEALS) == 0)
+        return fd;
+    if (!failed)
+        printf("here-document: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+}
+
+/* heredoc_string - A sealed memfd holding the len bytes at s, or -1 */
+int heredoc_string(const char *s, size_t len)
+{
+    int fd = hd_open();
+
+    if (fd < 0)
+        return -1;
+    return hd_seal(fd, hd_write(fd, s, len) < 0);
+}
+
+
+/***********************************************
+ * Reading bodies
+ **********************************************/
+
+/*
+ * hd_body - Read lines up to one that is just delim into a sealed
+ * memfd; with strip, leading tabs are dropped first.  The lines are
+ * read even if the memfd can't be made, so they never run as commands.
+ */
+static int hd_body(const char *delim, int strip)
+{
+    static char buf[HD_BUF];
+    char line[MAXLINE];
+    size_t dlen = strlen(delim), n = 0;
+    int fd = hd_open(), failed = fd < 0, bol = 1;
+
+    for (;;) {
+        char *s = line;
+        size_t len;
+
+        if (readcmd(line, MAXLINE) == NULL) {
+            printf("warning: here-document delimited by end-of-file (wanted '%s')\n", delim);
+            break;
+        }
+        if (bol && strip)
+            s += strspn(s, "\t");
+        if ((len = strlen(s)) == 0)         /* all tabs, and more to come */
+            continue;
+        if (bol && len == dlen + 1 && s[dlen] == '\n' && !memcmp(s, delim, dlen))
+            break;
+        bol = s[len - 1] == '\n';   /* otherwise the line goes on in the next piece */
+
+        if (n + len > sizeof(buf)) {
+            failed = failed || hd_write(fd, buf, n) < 0;
+            n = 0;
+        }
+        memcpy(buf + n, s, len);
+        n += len;
+    }
+    if (fd < 0)
+        return -1;
+    return hd_seal(fd, failed || hd_write(fd, buf, n) < 0);
+}
+
+/*
+ * heredoc_word - The end of the delimiter word at p: it runs up to a
+ * blank or an operator, and a quoted part of it may hold either.
+ */
+const char *heredoc_word(const char *p)
+{
+    while (*p && !strchr(" \t\n<>&;|()", *p)) {
+        if (*p == '\'' || *p == '"') {
+            const char *q = strchr(p + 1, *p);
+
+            if (q == NULL)
+                return p + strlen(p);
+            p = q;
+        }
+        p++;
+    }
+    return p;
+}
+
+/*
+ * hd_delim - The delimiter of the <<WORD at p (which follows the <<),
+ * unquoted, into delim; sets *strip for <<-.  Returns what follows.
+ */
+static const char *hd_delim(const char *p, char *delim, int *strip)
+{
+    const char *end;
+    size_t n = 0;
+
+    if ((*strip = *p == '-'))
+        p++;
+    p += strspn(p, " \t");
+    for (end = heredoc_word(p); p < end; p++) {
+        if (*p == '\'' || *p == '"') {
+            const char *q = strchr(p + 1, *p);
+
+            if (q == NULL)
+                q = end;
+            while (++p < q && n < MAXLINE - 1)
+                delim[n++] = *p;
+        }
+        else if (n < MAXLINE - 1)
+            delim[n++] = *p;
+    }
+    delim[n] = '\0';
+    return end;
+}
+
+/*
+ * hd_find - Find the next here-document at or after p, skipping quotes,
+ * $(...) and here-strings.  Its delimiter goes in delim and *strip is
+ * set for <<-.  Returns what follows its word, or NULL if there is none.
+ */
+static const char *hd_find(const char *p, char *delim, int *strip)
+{
+    while (*p) {
+        if (*p == '\'' || *p == '"') {          /* no << inside quotes */
+            const char *q = strchr(p + 1, *p);
+            p = q != NULL ? q + 1 : p + strlen(p);
+        }
+        else if (p[0] == '$' && p[1] == '(') {  /* or $(...) and $((...)) */
+            int depth = 0;
+
+            for (p++; *p && (*p != ')' || --depth > 0); p++)
+                depth += *p == '(';
+            if (*p)
+                p++;
+        }
+        else if (p[0] == '<' && p[1] == '<' && p[2] == '<')
+            p += 3;                             /* a here-string */
+        else if (p[0] == '<' && p[1] == '<') {
+            const char *w = p + 2 + (p[2] == '-');
+
+            w += strspn(w, " \t");
+            if ((p = hd_delim(p + 2, delim, strip)) != w)
+                return p;
+        }                                       /* no word: not one */
+        else
+            p++;
+    }
+    return NULL;
+}
+
+/*
+ * heredoc_more - Read the bodies of the here-documents on line, in
+ * order, after those already read for the command: line goes on a
+ * script that needed more input.  Returns -1 if one couldn't be kept,
+ * when the command shouldn't run.
+ */
+int heredoc_more(const char *line)
+{
+    char delim[MAXLINE];
+    const char *p = line;
+    int ok = 0, strip, fd;
+
+    while ((p = hd_find(p, delim, &strip)) != NULL) {
+        if ((fd = hd_body(delim, strip)) < 0)
+            ok = -1;
+        else if (npending < HD_MAX)
+            pending[npending++] = fd;
+        else
+            close(fd);
+    }
+    return ok;
+}
+
+/*
+ * heredoc_read - Read the bodies of the here-documents on a new command
+ * line, as heredoc_more does.  Bodies left over from the last line are
+ * dropped first.
+ */
+int heredoc_read(const char *cmdline)
+{
+    while (ntaken < npending)
+        close(pending[ntaken++]);
+    npending = ntaken = 0;
+    return heredoc_more(cmdline);
+}
+
+/* heredoc_count - How many here-documents text has */
+int heredoc_count(const char *text)
+{
+    char delim[MAXLINE];
+    int n = 0, strip;
+
+    while ((text = hd_find(text, delim, &strip)) != NULL)
+        n++;
+    return n;
+}
+
+/*
+ * heredoc_take - The next body of the line, in order; -1 if none.
+ * While heredoc_give has handed out a command's bodies, it returns a
+ * new reading of the next of those instead, from its start.
+ */
+int heredoc_take(void)
+{
+    if (given != NULL) {
+        char path[64];
+        int fd = -1;
+
+        if (ngiven == 0)
+            return -1;
+        if (*given >= 0) {          /* its own offset, unlike a dup */
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", *given);
+            if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+                printf("here-document: %s\n", strerror(errno));
+        }
+        given++;
+        ngiven--;
+        return fd;
+    }
+    return ntaken < npending ? pending[ntaken++] : -1;
+}
+
+/*
+ * heredoc_give - Have heredoc_take hand out the n bodies at fds, which
+ * the caller keeps, until the next call; with NULL, go back to the
+ * line's.  A script's command keeps its bodies this way and reads each
+ * afresh every time it runs.
+ */
+void heredoc_give(const int *fds, int n)
+{
+    given = fds;
+    ngiven = n;
+}
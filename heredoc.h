@@ -0,0 +1,41 @@
+//-*-c++-*-
+#ifndef _heredoc_h_
+#define _heredoc_h_
+
+#include <stddef.h>
+
+/*
+ * Here-documents and here-strings.
+ *
+ *     cmd <<WORD        the lines that follow, up to one that is just
+ *                       WORD, are cmd's stdin (<<-WORD: less leading
+ *                       tabs).  WORD may be quoted; the body is taken
+ *                       as it is either way.
+ *     cmd <<<word       word, expanded, and a newline are cmd's stdin
+ *
+ * Each body is written once into a memfd that is then sealed against
+ * any change and given to the job as fd 0.  There are no temp files,
+ * nothing has to feed a pipe while the job runs, and the job can seek
+ * in its input or mmap it.
+ *
+ * The main loop calls heredoc_read after reading a command line: it
+ * reads the bodies of the line's here-documents from the input, in
+ * order, and expand_line takes them with heredoc_take as it reaches
+ * each <<WORD.  Both find the end of WORD with heredoc_word.
+ *
+ * A script reads the bodies of each further line it needs with
+ * heredoc_more.  When it is compiled, each command takes its own
+ * (heredoc_count of them), and before it is expanded heredoc_give
+ * lends them to heredoc_take, which opens each anew: a loop's command
+ * reads its whole here-document every time round.
+ */
+
+int heredoc_read(const char *cmdline);
+int heredoc_more(const char *line);
+int heredoc_count(const char *text);
+int heredoc_take(void);
+void heredoc_give(const int *fds, int n);
+int heredoc_string(const char *s, size_t len);
+const char *heredoc_word(const char *p);
+
+#endif
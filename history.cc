@@ -0,0 +1,340 @@
+#include "history.h"
+#include "helper-routines.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+
+/***********************************************
+ * Memory-mapped history file and offset index
+ **********************************************/
+
+#define HI_MAGIC  "TSHHIDX1"  /* first 8 bytes of the index */
+#define HI_BATCH  4096        /* offsets written at a time by hi_rebuild */
+
+static int             hfd = -1;  /* history text, one entry per line */
+static int             ifd = -1;  /* index: magic, then one offset per entry */
+static char           *hpath;     /* name of the text file */
+static const char     *hdata;     /* mapping of the text */
+static size_t          hsize;     /* its length */
+static const char     *ibase;     /* mapping of the index */
+static const uint64_t *hidx;      /* the offsets in it, past the magic */
+static size_t          isize;     /* length of the index file */
+
+
+/* hi_remap - Map fd again if its size differs from *size */
+static int hi_remap(int fd, const void **map, size_t *size)
+{
+    struct stat st;
+    void *p = NULL;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if ((size_t)st.st_size == *size)
+        return 0;
+    if (st.st_size > 0) {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return -1;
+    }
+    if (*map != NULL)
+        munmap((void *)*map, *size);
+    *map = p;
+    *size = st.st_size;
+    return 0;
+}
+
+/*
+ * hi_sync - Pick up entries appended by this or any other shell.  The
+ * index is looked at before the text, so every offset it holds points
+ * into text we can see.
+ */
+static void hi_sync(void)
+{
+    if (hfd < 0)
+        return;
+    if (hi_remap(ifd, (const void **)&ibase, &isize) < 0 ||
+        hi_remap(hfd, (const void **)&hdata, &hsize) < 0)
+        return;
+    hidx = isize >= 8 ? (const uint64_t *)(ibase + 8) : NULL;
+}
+
+/*
+ * hi_rebuild - Recreate a missing or damaged index by scanning the
+ * text.  The only time the whole file is read; the caller holds the
+ * lock.
+ */
+static int hi_rebuild(void)
+{
+    uint64_t batch[HI_BATCH];
+    size_t off, n = 0;
+
+    if (hi_remap(hfd, (const void **)&hdata, &hsize) < 0 ||
+        ftruncate(ifd, 0) < 0 || write(ifd, HI_MAGIC, 8) != 8)
+        return -1;
+    for (off = 0; off < hsize; ) {
+        const char *nl = (const char *)memchr(hdata + off, '\n', hsize - off);
+
+        if (nl == NULL)
+            break;              /* torn last line */
+        batch[n++] = off;
+        if (n == HI_BATCH) {
+            if (write(ifd, batch, sizeof(batch)) != (ssize_t)sizeof(batch))
+                return -1;
+            n = 0;
+        }
+        off = nl - hdata + 1;
+    }
+    if (n && write(ifd, batch, n * 8) != (ssize_t)(n * 8))
+        return -1;
+    return 0;
+}
+
+/*
+ * hi_check - Make sure the index describes the text: right magic,
+ * whole offsets only, and a last entry that exists.  Only the ends of
+ * the files are looked at.
+ */
+static int hi_check(void)
+{
+    char magic[8];
+    int n;
+
+    hi_sync();
+    if (isize < 8 || pread(ifd, magic, 8, 0) != 8 || memcmp(magic, HI_MAGIC, 8))
+        return hi_rebuild();
+    if ((isize - 8) % 8 && ftruncate(ifd, isize - (isize - 8) % 8) < 0)
+        return -1;
+    hi_sync();
+    n = history_count();
+    if (n > 0 && (hidx[n - 1] >= hsize || (hidx[n - 1] > 0 && hdata[hidx[n - 1] - 1] != '\n')))
+        return hi_rebuild();
+    if (n == 0 && hsize > 0)
+        return hi_rebuild();
+    return 0;
+}
+
+/*
+ * history_open - Use the history in path (and path.idx), creating
+ * them if needed.
+ */
+int history_open(const char *path)
+{
+    char *ipath = (char *)malloc(strlen(path) + 5);
+    int ok;
+
+    if (ipath == NULL)
+        unix_error("malloc error");
+    sprintf(ipath, "%s.idx", path);
+    if ((hfd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) < 0 ||
+        (ifd = open(ipath, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) < 0 ||
+        flock(hfd, LOCK_EX) < 0) {
+        printf("history: %s: %s\n", hfd < 0 ? path : ipath, strerror(errno));
+        goto fail;
+    }
+    ok = hi_check();
+    flock(hfd, LOCK_UN);
+    if (ok < 0) {
+        printf("history: %s: %s\n", ipath, strerror(errno));
+        goto fail;
+    }
+    hi_sync();
+    hpath = strdup(path);
+    free(ipath);
+    return 0;
+
+fail:
+    if (hfd >= 0)
+        close(hfd);
+    if (ifd >= 0)
+        close(ifd);
+    hfd = ifd = -1;
+    free(ipath);
+    return -1;
+}
+
+/* history_count - Number of entries */
+int history_count(void)
+{
+    size_t n;
+
+    if (hidx == NULL)
+        return 0;
+    n = (isize - 8) / 8;
+    while (n > 0 && hidx[n - 1] >= hsize)
+        n--;                    /* not yet visible in our text mapping */
+    return n;
+}
+
+/* history_get - Entry n (1-based) and its length, without the newline */
+const char *history_get(int n, int *len)
+{
+    const char *p, *nl;
+
+    if (n < 1 || n > history_count())
+        return NULL;
+    p = hdata + hidx[n - 1];
+    nl = (const char *)memchr(p, '\n', hdata + hsize - p);
+    *len = (nl ? nl : hdata + hsize) - p;
+    return p;
+}
+
+/*
+ * history_search - Newest entry at or before entry from that contains
+ * text (or starts with it, if prefix is set).  Returns 0 if none does.
+ */
+int history_search(const char *text, int from, int prefix)
+{
+    size_t tlen = strlen(text);
+    int n, len;
+
+    hi_sync();
+    if (from > history_count())
+        from = history_count();
+    for (n = from; n >= 1; n--) {
+        const char *p = history_get(n, &len);
+
+        if (prefix ? (len >= (int)tlen && !memcmp(p, text, tlen))
+                   : memmem(p, len, text, tlen) != NULL)
+            return n;
+    }
+    return 0;
+}
+
+/*
+ * history_add - Append a command line.  Blank lines are not kept.  The
+ * lock makes the text line and its offset one step for other shells.
+ */
+void history_add(const char *cmdline)
+{
+    size_t len = strcspn(cmdline, "\n");
+    uint64_t off;
+    struct stat st;
+    char *line;
+    char last;
+
+    if (hfd < 0 || cmdline[strspn(cmdline, " \t\n")] == '\0')
+        return;
+    if ((line = (char *)malloc(len + 2)) == NULL)
+        unix_error("malloc error");
+    memcpy(line + 1, cmdline, len);
+    line[0] = '\n';
+    line[len + 1] = '\n';
+
+    flock(hfd, LOCK_EX);
+    if (fstat(hfd, &st) == 0) {
+        /* after a torn write, start the entry on a fresh line */
+        int torn = st.st_size > 0 && pread(hfd, &last, 1, st.st_size - 1) == 1 && last != '\n';
+
+        off = st.st_size + torn;
+        if (write(hfd, line + !torn, len + 1 + torn) == (ssize_t)(len + 1 + torn))
+            if (write(ifd, &off, 8) != 8)
+                printf("history: %s.idx: %s\n", hpath, strerror(errno));
+    }
+    flock(hfd, LOCK_UN);
+    free(line);
+    hi_sync();
+}
+
+/*
+ * history_expand - Replace a leading !!, !n, !-n or !prefix event in
+ * cmdline by the entry it names, keeping the rest of the line, and
+ * echo the result.  Returns 1 if the line changed, 0 if it had no
+ * event, and -1 (after a message) if the event doesn't exist.
+ */
+int history_expand(char *cmdline, int size)
+{
+    char *p = cmdline + strspn(cmdline, " \t");
+    char *end, *rest, word[MAXLINE];
+    const char *entry;
+    int n, len;
+
+    if (hfd < 0 || p[0] != '!' || strchr(" \t\n=(", p[1]) != NULL)
+        return 0;
+    end = p + 1 + strcspn(p + 1, " \t\n");
+    snprintf(word, sizeof(word), "%.*s", (int)(end - p - 1), p + 1);
+
+    hi_sync();
+    if (!strcmp(word, "!"))
+        n = history_count();
+    else if (isdigit(word[0]))
+        n = atoi(word);
+    else if (word[0] == '-' && isdigit(word[1]))
+        n = history_count() + 1 - atoi(word + 1);
+    else
+        n = history_search(word, history_count(), 1);
+    if ((entry = history_get(n, &len)) == NULL) {
+        printf("!%s: event not found\n", word);
+        return -1;
+    }
+
+    rest = end;
+    if ((p - cmdline) + len + strlen(rest) + 2 > (size_t)size) {
+        printf("!%s: expanded line too long\n", word);
+        return -1;
+    }
+    memmove(p + len, rest, strlen(rest) + 1);
+    memcpy(p, entry, len);
+    if (cmdline[strlen(cmdline) - 1] != '\n')
+        strcat(cmdline, "\n");
+    printf("%s", cmdline);
+    fflush(stdout);
+    return 1;
+}
+
+/* hi_print - List one entry */
+static void hi_print(int n)
+{
+    int len;
+    const char *p = history_get(n, &len);
+
+    if (p != NULL)
+        printf("%6d  %.*s\n", n, len, p);
+}
+
+/* history_cmd - The history builtin */
+void history_cmd(char **argv)
+{
+    int n, count;
+
+    if (hfd < 0) {
+        printf("history: no history file (use -H <file>)\n");
+        return;
+    }
+    hi_sync();
+    count = history_count();
+
+    if (argv[1] != NULL && !strcmp(argv[1], "-s")) {
+        char text[MAXLINE] = "";
+        int i;
+
+        if (argv[2] == NULL) {
+            printf("history: -s requires search text\n");
+            return;
+        }
+        for (i = 2; argv[i] != NULL; i++) {
+            if (i > 2)
+                strncat(text, " ", sizeof(text) - strlen(text) - 1);
+            strncat(text, argv[i], sizeof(text) - strlen(text) - 1);
+        }
+        for (n = history_search(text, count, 0); n > 0; n = history_search(text, n - 1, 0))
+            hi_print(n);
+        return;
+    }
+    if (argv[1] != NULL && !isdigit(argv[1][0])) {
+        printf("history: usage: history [n] | history -s <text>\n");
+        return;
+    }
+    n = argv[1] ? atoi(argv[1]) : count;
+    for (n = n < count ? count - n + 1 : 1; n <= count; n++)
+        hi_print(n);
+}
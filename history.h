@@ -0,0 +1,30 @@
+//-*-c++-*-
+#ifndef _history_h_
+#define _history_h_
+
+/*
+ * Command history.  Entries live in an append-only text file, one per
+ * line, next to an index file of 64-bit offsets into it (<file>.idx).
+ * Both are memory-mapped, so opening a history of millions of entries
+ * costs the same as opening an empty one, and entry n is found
+ * without reading the ones before it.
+ *
+ * Several shells may share one history: each append takes an flock on
+ * the text file, writes the line and then its offset, so entries from
+ * different shells interleave whole and stay numbered in file order.
+ *
+ *     history [n]          list all entries, or the last n
+ *     history -s <text>    list entries containing text, newest first
+ *     !!  !n  !-n          rerun the last, the nth, the nth-last entry
+ *     !prefix              rerun the newest entry starting with prefix
+ */
+
+int  history_open(const char *path);
+void history_add(const char *cmdline);
+int  history_expand(char *cmdline, int size);
+int  history_count(void);
+const char *history_get(int n, int *len);
+int  history_search(const char *text, int from, int prefix);
+void history_cmd(char **argv);
+
+#endif
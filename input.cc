@@ -0,0 +1,133 @@
+#include "input.h"
+#include "evloop.h"
+#include "lineedit.h"
+#include "globals.h"
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+/***********************************************
+ * Line input from stdin
+ **********************************************/
+
+static char ibuf[4 * MAXLINE];  /* bytes read but not yet returned */
+static int  ilen;               /* valid bytes in ibuf */
+static int  ipos;               /* start of the next line */
+static int  ieof;               /* read returned 0 */
+static int  ierr;               /* read failed */
+static int  polled;             /* 1: stdin is in the event loop, -1: can't be */
+static int  ready;              /* set by the event loop handler */
+static int  waiting;            /* wait_stdin is in the event loop */
+
+
+/*
+ * stdin_ready - Event loop handler for fd 0.  Input typed ahead while
+ * a job runs would wake every wait until it is read, so stdin is
+ * dropped from the loop until the shell next asks for a line.
+ */
+static void stdin_ready(int fd, unsigned int events, void *arg)
+{
+    ready = 1;
+    if (!waiting) {
+        evloop_del(0);
+        polled = 0;
+    }
+}
+
+/*
+ * wait_stdin - Run the event loop until stdin is readable.  Regular
+ * files can't be watched by epoll, but they never block either.
+ */
+static void wait_stdin(void)
+{
+    if (ready) {                /* seen while we weren't waiting */
+        ready = 0;
+        return;
+    }
+    if (polled == 0)
+        polled = evloop_add(0, EPOLLIN, stdin_ready, NULL) < 0 ? -1 : 1;
+    if (polled < 0)
+        return;
+    waiting = 1;
+    while (!ready)
+        evloop_wait(-1);
+    waiting = 0;
+    ready = 0;
+}
+
+/*
+ * readcmd - Read the next line from stdin into cmdline, including its
+ * newline.  Returns NULL at end of file; a final line with no newline
+ * is dropped, as the shell has always done.  On a terminal the line
+ * comes from the line editor instead.
+ */
+char *readcmd(char *cmdline, int size)
+{
+    if (lineedit_active())
+        return lineedit_read(cmdline, size);
+    for (;;) {
+        char *nl = (char *)memchr(ibuf + ipos, '\n', ilen - ipos);
+        int n;
+
+        if (nl != NULL || ilen - ipos >= size - 1) {
+            n = nl != NULL ? nl - (ibuf + ipos) + 1 : size - 1;
+            if (n > size - 1)
+                n = size - 1;
+            memcpy(cmdline, ibuf + ipos, n);
+            cmdline[n] = '\0';
+            ipos += n;
+            return cmdline;
+        }
+        if (ieof || ierr)
+            return NULL;
+
+        /* make room after the partial line, then read more */
+        memmove(ibuf, ibuf + ipos, ilen - ipos);
+        ilen -= ipos;
+        ipos = 0;
+        if (evloop_busy() || polled > 0)
+            wait_stdin();
+        if ((n = read(0, ibuf + ilen, sizeof(ibuf) - ilen)) < 0) {
+            if (errno != EINTR)
+                ierr = errno;
+            continue;
+        }
+        if (n == 0)
+            ieof = 1;
+        ilen += n;
+    }
+}
+
+/*
+ * readchar - Read one byte from stdin, serving the event loop while
+ * none is available.  Returns -1 at end of file or on an error.  The
+ * line editor reads keys through here.
+ */
+int readchar(void)
+{
+    int n;
+
+    while (ipos == ilen) {
+        if (ieof || ierr)
+            return -1;
+        ipos = ilen = 0;
+        if (evloop_busy() || polled > 0)
+            wait_stdin();
+        if ((n = read(0, ibuf, sizeof(ibuf))) < 0) {
+            if (errno != EINTR)
+                ierr = errno;
+            continue;
+        }
+        if (n == 0)
+            ieof = 1;
+        ilen = n;
+    }
+    return (unsigned char)ibuf[ipos++];
+}
+
+/* readcmd_error - errno of the read that ended input, 0 at EOF */
+int readcmd_error(void)
+{
+    return ierr;
+}
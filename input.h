@@ -0,0 +1,14 @@
+//-*-c++-*-
+#ifndef _input_h_
+#define _input_h_
+
+/*
+ * Command-line input.  readcmd behaves like fgets on stdin, but while
+ * it waits for a line it keeps the event loop running, so sockets and
+ * job notifications are served between commands.
+ */
+char *readcmd(char *cmdline, int size);
+int   readcmd_error(void);
+int   readchar(void);
+
+#endif
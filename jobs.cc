@@ -1,5 +1,8 @@
 #include "jobs.h"
+#include "tracing.h"
+#include "helper-routines.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <strings.h>
 #include <memory.h> // strcpy and memcpy
 
@@ -8,9 +11,80 @@
  * Helper routines that manipulate the job list
  **********************************************/
 
-struct job_t jobs[MAXJOBS]; /* The job list */
+struct job_t *jobs;         /* The job list, allocated by jobtable */
 static int nextjid = 1;            /* next job ID to allocate */
 
+#define MAXDONE 64          /* finished jobs whose status wait can still get */
+static struct {
+    pid_t pid;
+    int jid;
+    int status;
+} done[MAXDONE];                   /* oldest first */
+static int ndone;
+
+/*
+ * The reaper looks a job up by pid for every child event, so pids are
+ * hashed.  Each slot holds a job's index plus one (0 = empty); clashes
+ * probe forward, and deletion shifts later entries back so a probe
+ * never needs tombstones.
+ */
+#define PIDSLOTS 64         /* a power of two, well over MAXJOBS */
+static signed char pidslot[PIDSLOTS];
+
+/* pidhash - Home slot of pid (Fibonacci hashing) */
+static unsigned pidhash(pid_t pid) {
+    return ((unsigned)pid * 2654435761u) >> 26;
+}
+
+/* pidfind - Slot holding pid's job, or -1 */
+static int pidfind(pid_t pid) {
+    unsigned h;
+
+    for (h = pidhash(pid); pidslot[h]; h = (h + 1) & (PIDSLOTS - 1))
+	if (jobs[pidslot[h] - 1].pid == pid)
+	    return h;
+    return -1;
+}
+
+/* pidinsert - Hash jobs[i] by its pid */
+static void pidinsert(int i) {
+    unsigned h;
+
+    for (h = pidhash(jobs[i].pid); pidslot[h]; h = (h + 1) & (PIDSLOTS - 1))
+	;
+    pidslot[h] = i + 1;
+}
+
+/* pidremove - Empty slot h, moving back entries that probed past it */
+static void pidremove(unsigned h) {
+    unsigned j = h, k;
+
+    for (;;) {
+	j = (j + 1) & (PIDSLOTS - 1);
+	if (!pidslot[j])
+	    break;
+	k = pidhash(jobs[pidslot[j] - 1].pid);
+	if (j > h ? (h < k && k <= j) : (h < k || k <= j))
+	    continue;       /* its home is in (h, j]: it stays */
+	pidslot[h] = pidslot[j];
+	h = j;
+    }
+    pidslot[h] = 0;
+}
+
+
+/*
+ * jobtable - Return the job list, allocating it the first time.  A
+ * shell that never starts a job never touches its pages; calloc
+ * leaves every entry as clearjob would.  Each routine below treats
+ * a NULL list as empty.
+ */
+struct job_t *jobtable(void) {
+    if (jobs == NULL && (jobs = (struct job_t *)calloc(MAXJOBS, sizeof(*jobs))) == NULL)
+	unix_error("calloc error");
+    return jobs;
+}
+
 
 /* clearjob - Clear the entries in a job struct */
 void clearjob(struct job_t *job) {
@@ -18,14 +92,20 @@ void clearjob(struct job_t *job) {
     job->jid = 0;
     job->state = UNDEF;
     job->cmdline[0] = '\0';
+    job->has_tmodes = 0;
+    job->nsubs = 0;
+    job->exited = 0;
 }
 
 /* initjobs - Initialize the job list */
 void initjobs(struct job_t *jobs) {
     int i;
 
+    if (jobs == NULL)
+	return;
     for (i = 0; i < MAXJOBS; i++)
 	clearjob(&jobs[i]);
+    memset(pidslot, 0, sizeof(pidslot));
 }
 
 /* maxjid - Returns largest allocated job ID */
@@ -33,6 +113,8 @@ int maxjid(struct job_t *jobs)
 {
     int i, max=0;
 
+    if (jobs == NULL)
+	return 0;
     for (i = 0; i < MAXJOBS; i++)
 	if (jobs[i].jid > max)
 	    max = jobs[i].jid;
@@ -46,6 +128,10 @@ int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline)
     
     if (pid < 1)
 	return 0;
+    if (jobs == NULL)
+	jobs = jobtable();
+
+    TRACE_BEGIN("addjob");
 
     for (i = 0; i < MAXJOBS; i++) {
 	if (jobs[i].pid == 0) {
@@ -54,39 +140,115 @@ int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline)
 	    jobs[i].jid = nextjid++;
 	    if (nextjid > MAXJOBS)
 		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
+	    strncpy(jobs[i].cmdline, cmdline, MAXLINE - 1); /* a script's command may be longer */
+	    jobs[i].cmdline[MAXLINE - 1] = '\0';
+	    pidinsert(i);
   	    if(verbose){
 	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
             }
+	    TRACE_END("addjob");
             return 1;
 	}
     }
     printf("Tried to create too many jobs\n");
+    TRACE_END("addjob");
     return 0;
 }
 
 /* deletejob - Delete a job whose PID=pid from the job list */
 int deletejob(struct job_t *jobs, pid_t pid) 
 {
-    int i;
+    int i, h;
 
-    if (pid < 1)
+    if (pid < 1 || jobs == NULL)
 	return 0;
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == pid) {
-	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
-	    return 1;
+    TRACE_INSTANT("deletejob", pid);
+    if ((h = pidfind(pid)) < 0)
+	return 0;
+    i = pidslot[h] - 1;
+    pidremove(h);
+    clearjob(&jobs[i]);
+    nextjid = maxjid(jobs)+1;
+    return 1;
+}
+
+/*
+ * addjobsub - Record a process substitution started for job.  The job
+ * is over once its own process and all of these have exited.
+ */
+void addjobsub(struct job_t *job, pid_t pid)
+{
+    if (job != NULL && job->nsubs < MAXPSUBS)
+	job->subs[job->nsubs++] = pid;
+}
+
+/* deletejobsub - Forget a process substitution; returns how many are left */
+int deletejobsub(struct job_t *job, pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < job->nsubs; i++)
+	if (job->subs[i] == pid) {
+	    job->subs[i] = job->subs[--job->nsubs];
+	    break;
 	}
-    }
-    return 0;
+    return job->nsubs;
+}
+
+/* getjobsub - Find the job a process substitution (by PID) belongs to */
+struct job_t *getjobsub(struct job_t *jobs, pid_t pid)
+{
+    int i, j;
+
+    if (pid < 1 || jobs == NULL)
+	return NULL;
+    for (i = 0; i < MAXJOBS; i++)
+	for (j = 0; j < jobs[i].nsubs; j++)
+	    if (jobs[i].subs[j] == pid)
+		return &jobs[i];
+    return NULL;
+}
+
+/*
+ * notejobdone - Keep the status ($? style) of a finished background
+ * job for wait.  The oldest is forgotten when there are too many.
+ */
+void notejobdone(pid_t pid, int jid, int status)
+{
+    if (ndone == MAXDONE)
+	memmove(&done[0], &done[1], --ndone * sizeof(done[0]));
+    done[ndone].pid = pid;
+    done[ndone].jid = jid;
+    done[ndone].status = status;
+    ndone++;
+}
+
+/*
+ * jobdone - The status of the finished job pid (or, if pid is 0, the
+ * latest with job ID jid, and if both are 0 the oldest of all), which
+ * is then forgotten; -1 if none.
+ */
+int jobdone(pid_t pid, int jid)
+{
+    int i, status;
+
+    for (i = ndone - 1; i >= 0; i--)
+	if (pid ? done[i].pid == pid : !jid ? i == 0 : done[i].jid == jid)
+	    break;
+    if (i < 0)
+	return -1;
+    status = done[i].status;
+    memmove(&done[i], &done[i + 1], (--ndone - i) * sizeof(done[0]));
+    return status;
 }
 
 /* fgpid - Return PID of current foreground job, 0 if no such job */
 pid_t fgpid(struct job_t *jobs) {
     int i;
 
+    if (jobs == NULL)
+	return 0;
     for (i = 0; i < MAXJOBS; i++)
 	if (jobs[i].state == FG)
 	    return jobs[i].pid;
@@ -95,14 +257,11 @@ pid_t fgpid(struct job_t *jobs) {
 
 /* getjobpid  - Find a job (by PID) on the job list */
 struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
-    int i;
+    int h;
 
-    if (pid < 1)
+    if (pid < 1 || jobs == NULL || (h = pidfind(pid)) < 0)
 	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid)
-	    return &jobs[i];
-    return NULL;
+    return &jobs[pidslot[h] - 1];
 }
 
 /* getjobjid  - Find a job (by JID) on the job list */
@@ -110,7 +269,7 @@ struct job_t *getjobjid(struct job_t *jobs, int jid)
 {
     int i;
 
-    if (jid < 1)
+    if (jid < 1 || jobs == NULL)
 	return NULL;
     for (i = 0; i < MAXJOBS; i++)
 	if (jobs[i].jid == jid)
@@ -121,15 +280,9 @@ struct job_t *getjobjid(struct job_t *jobs, int jid)
 /* pid2jid - Map process ID to job ID */
 int pid2jid(pid_t pid) 
 {
-    int i;
+    struct job_t *job = getjobpid(jobs, pid);
 
-    if (pid < 1)
-	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
+    return job != NULL ? job->jid : 0;
 }
 
 /* listjobs - Print the job list */
@@ -137,6 +290,8 @@ void listjobs(struct job_t *jobs)
 {
     int i;
     
+    if (jobs == NULL)
+	return;
     for (i = 0; i < MAXJOBS; i++) {
 	if (jobs[i].pid != 0) {
 	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
@@ -158,6 +313,34 @@ void listjobs(struct job_t *jobs)
 	}
     }
 }
+
+/* listjobs_json - Print the job list to fp as a JSON array */
+void listjobs_json(FILE *fp, struct job_t *jobs) 
+{
+    static const char *names[] = { "undefined", "foreground", "running", "stopped" };
+    int i, first = 1;
+    char *p;
+
+    fputc('[', fp);
+    for (i = 0; jobs != NULL && i < MAXJOBS; i++) {
+	if (jobs[i].pid == 0)
+	    continue;
+	fprintf(fp, "%s{\"jid\":%d,\"pid\":%d,\"state\":\"%s\",\"cmdline\":\"",
+		first ? "" : ",", jobs[i].jid, jobs[i].pid,
+		jobs[i].state >= UNDEF && jobs[i].state <= ST ? names[jobs[i].state] : "undefined");
+	for (p = jobs[i].cmdline; *p && *p != '\n'; p++) {
+	    if (*p == '"' || *p == '\\')
+		fprintf(fp, "\\%c", *p);
+	    else if ((unsigned char)*p < 0x20)
+		fprintf(fp, "\\u%04x", *p);
+	    else
+		fputc(*p, fp);
+	}
+	fputs("\"}", fp);
+	first = 0;
+    }
+    fputc(']', fp);
+}
 /******************************
  * end job list helper routines
  ******************************/
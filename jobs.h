@@ -3,6 +3,8 @@
 #define _jobs_h_
 
 #include <sys/types.h> // needed for pid_t
+#include <stdio.h>     // FILE for listjobs_json
+#include <termios.h>   // terminal modes of a stopped job
 #include "globals.h"
 
 /* Job states */
@@ -26,20 +28,32 @@ struct job_t {              /* The job struct */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
     char cmdline[MAXLINE];  /* command line */
+    int has_tmodes;         /* tmodes saved when the job stopped */
+    struct termios tmodes;  /* its terminal modes, restored by fg */
+    int nsubs;              /* process substitutions still running */
+    pid_t subs[MAXPSUBS];   /* their pids, in the job's process group */
+    int exited;             /* pid is gone, but not all of subs */
 };
-extern struct job_t jobs[MAXJOBS]; /* The job list */
+extern struct job_t *jobs; /* The job list (NULL until the first job) */
 
 
+struct job_t *jobtable(void);
 void clearjob(struct job_t *job);
 void initjobs(struct job_t *jobs);
 int maxjid(struct job_t *jobs); 
 int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
 int deletejob(struct job_t *jobs, pid_t pid); 
+void addjobsub(struct job_t *job, pid_t pid);
+int deletejobsub(struct job_t *job, pid_t pid);
+struct job_t *getjobsub(struct job_t *jobs, pid_t pid);
+void notejobdone(pid_t pid, int jid, int status);
+int jobdone(pid_t pid, int jid);
 pid_t fgpid(struct job_t *jobs);
 struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
 struct job_t *getjobjid(struct job_t *jobs, int jid); 
 int pid2jid(pid_t pid); 
 void listjobs(struct job_t *jobs);
+void listjobs_json(FILE *fp, struct job_t *jobs);
 
 
 #endif
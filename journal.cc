@@ -0,0 +1,355 @@
+#include "journal.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+
+/***********************************************
+ * Append-only, memory-mapped job journal
+ **********************************************/
+
+#define JR_MAGIC   "TSHJRNL1"
+#define JR_CHUNK   8192   /* records added each time the file grows (1 MB) */
+
+struct jhdr_t {             /* Record 0 of the file */
+    char     magic[8];
+    uint32_t recsize;
+    uint32_t version;
+    char     pad[sizeof(struct jrec_t) - 16];
+};
+
+static_assert(sizeof(struct jrec_t) == 128, "journal record must be 128 bytes");
+static_assert(sizeof(struct jhdr_t) == sizeof(struct jrec_t), "bad journal header");
+
+static int            jfd = -1;       /* journal file */
+static char          *jpath;          /* its name, for "jobs --replay" */
+static struct jrec_t *jbase;          /* mapping of the whole file */
+static size_t         jnrec;          /* records (slots) in the mapping */
+static size_t         jnext;          /* next free slot */
+static uint32_t       jseq;           /* last sequence number written */
+
+
+/* jr_now - Current time in nanoseconds */
+static int64_t jr_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* jr_cmdline - Copy a command line into a record, dropping the newline */
+static void jr_cmdline(struct jrec_t *r, const char *cmdline)
+{
+    size_t n = strcspn(cmdline, "\n");
+
+    if (n > JR_CMDLEN - 1)
+        n = JR_CMDLEN - 1;
+    memcpy(r->cmdline, cmdline, n);
+    r->cmdline[n] = '\0';
+}
+
+/* jr_grow - Extend the file and the mapping by JR_CHUNK records */
+static int jr_grow(void)
+{
+    size_t oldsize = jnrec * sizeof(struct jrec_t);
+    size_t newsize = oldsize + JR_CHUNK * sizeof(struct jrec_t);
+    void *p;
+
+    if (ftruncate(jfd, newsize) < 0)
+        return -1;
+    p = mremap(jbase, oldsize, newsize, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+        return -1;
+    jbase = (struct jrec_t *)p;
+    jnrec += JR_CHUNK;
+    return 0;
+}
+
+/* jr_detach - Unmap and close the journal without writing anything */
+static void jr_detach(void)
+{
+    munmap(jbase, jnrec * sizeof(struct jrec_t));
+    close(jfd);
+    jbase = NULL;
+    jfd = -1;
+}
+
+/*
+ * jr_append - Copy a record into the next free slot.  The sequence
+ * number is stored last so a crash mid-write leaves an empty slot
+ * rather than a torn record.
+ */
+static void jr_append(const struct jrec_t *r)
+{
+    struct jrec_t *slot;
+
+    if (jnext == jnrec && jr_grow() < 0) {
+        fprintf(stdout, "journal: %s: %s\n", jpath, strerror(errno));
+        jr_detach();
+        return;
+    }
+    slot = &jbase[jnext++];
+    memcpy((char *)slot + sizeof(slot->seq), (const char *)r + sizeof(r->seq),
+           sizeof(*r) - sizeof(r->seq));
+    __atomic_store_n(&slot->seq, ++jseq, __ATOMIC_RELEASE);
+}
+
+/* jr_event - Build and append a record for a job on the list */
+static void jr_event(int type, struct job_t *job)
+{
+    struct jrec_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.type = type;
+    r.state = job->state;
+    r.pid = job->pid;
+    r.jid = job->jid;
+    r.shell = getpid();
+    r.time_ns = jr_now();
+    jr_cmdline(&r, job->cmdline);
+    jr_append(&r);
+}
+
+/* jr_find_end - Binary search for the first empty slot */
+static size_t jr_find_end(void)
+{
+    size_t lo = 1, hi = jnrec;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (jbase[mid].seq != 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* jr_map - Map a journal file and check its header; returns record count */
+static struct jrec_t *jr_map(int fd, int prot, size_t *nrec)
+{
+    struct stat st;
+    struct jrec_t *p;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct jrec_t))
+        return NULL;
+    p = (struct jrec_t *)mmap(NULL, st.st_size, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    if (memcmp(((struct jhdr_t *)p)->magic, JR_MAGIC, 8) != 0 ||
+        ((struct jhdr_t *)p)->recsize != sizeof(struct jrec_t)) {
+        munmap(p, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    *nrec = st.st_size / sizeof(struct jrec_t);
+    return p;
+}
+
+/*
+ * journal_open - Attach the shell to the journal in path, creating it
+ * if needed.  Only one shell may write a journal at a time.
+ */
+int journal_open(const char *path)
+{
+    struct stat st;
+    struct job_t self;
+
+    if ((jfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+        goto fail;
+    if (flock(jfd, LOCK_EX | LOCK_NB) < 0)
+        goto fail;
+    if (fstat(jfd, &st) < 0)
+        goto fail;
+    if (st.st_size == 0) {
+        struct jhdr_t h;
+
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, JR_MAGIC, 8);
+        h.recsize = sizeof(struct jrec_t);
+        h.version = 1;
+        if (ftruncate(jfd, JR_CHUNK * sizeof(struct jrec_t)) < 0 ||
+            pwrite(jfd, &h, sizeof(h), 0) != (ssize_t)sizeof(h))
+            goto fail;
+    }
+    if ((jbase = jr_map(jfd, PROT_READ | PROT_WRITE, &jnrec)) == NULL)
+        goto fail;
+    jnext = jr_find_end();
+    jseq = jnext > 1 ? jbase[jnext - 1].seq : 0;
+    jpath = strdup(path);
+
+    memset(&self, 0, sizeof(self));
+    self.pid = getpid();
+    jr_event(JR_START, &self);
+    atexit(journal_close);
+    return 0;
+
+fail:
+    fprintf(stdout, "journal: %s: %s\n", path, strerror(errno));
+    if (jfd >= 0)
+        close(jfd);
+    jfd = -1;
+    jbase = NULL;
+    return -1;
+}
+
+/* journal_close - Detach from the journal */
+void journal_close(void)
+{
+    if (jbase != NULL)
+        jr_detach();
+}
+
+/* journal_add - Record a job that was just added to the list */
+void journal_add(struct job_t *job)
+{
+    if (jbase == NULL || job == NULL)
+        return;
+    jr_event(JR_ADD, job);
+}
+
+/* journal_state - Record a state change made by the main loop */
+void journal_state(struct job_t *job)
+{
+    if (jbase == NULL)
+        return;
+    jr_event(JR_STATE, job);
+}
+
+/*
+ * journal_note - Record a child event the reaper saw, with its wait
+ * status and, for a reap, its resource usage.
+ */
+void journal_note(int type, pid_t pid, int jid, int state, int status,
+                  const struct rusage *ru)
+{
+    struct jrec_t r;
+
+    if (jbase == NULL)
+        return;
+    memset(&r, 0, sizeof(r));
+    r.type = type;
+    r.state = state;
+    r.pid = pid;
+    r.jid = jid;
+    r.status = status;
+    r.shell = getpid();
+    r.time_ns = jr_now();
+    if (ru != NULL) {
+        r.utime_us = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+        r.stime_us = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+        r.maxrss_kb = ru->ru_maxrss;
+    }
+    jr_append(&r);
+}
+
+
+/***********************************************
+ * Replay
+ **********************************************/
+
+struct rjob_t {             /* A job rebuilt from the journal */
+    pid_t pid;
+    pid_t shell;
+    int   jid;
+    int   state;
+    char  cmdline[JR_CMDLEN];
+};
+
+/* rj_find - Find a rebuilt job by shell and PID */
+static struct rjob_t *rj_find(struct rjob_t *rj, int n, pid_t shell, pid_t pid)
+{
+    int i;
+
+    for (i = n - 1; i >= 0; i--)
+        if (rj[i].pid == pid && rj[i].shell == shell)
+            return &rj[i];
+    return NULL;
+}
+
+/* rj_alive - Does process pid still exist? */
+static int rj_alive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/*
+ * journal_replay - Rebuild the job list from a journal and print it
+ * in the same format as listjobs.  Jobs whose shell is no longer
+ * running are flagged as orphaned, or as gone if the process itself
+ * has also disappeared.
+ */
+int journal_replay(const char *path)
+{
+    struct jrec_t *base;
+    struct rjob_t *rj = NULL, *j;
+    size_t nrec, i;
+    int fd, n = 0, cap = 0;
+    pid_t self = getpid();
+
+    if (path == NULL && (path = jpath) == NULL) {
+        printf("jobs: no journal (use -j <file> or jobs --replay <file>)\n");
+        return -1;
+    }
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+        (base = jr_map(fd, PROT_READ, &nrec)) == NULL) {
+        printf("jobs: %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    for (i = 1; i < nrec && base[i].seq != 0; i++) {
+        const struct jrec_t *r = &base[i];
+
+        switch (r->type) {
+        case JR_ADD:
+            if (n == cap) {
+                cap = cap ? 2 * cap : MAXJOBS;
+                rj = (struct rjob_t *)realloc(rj, cap * sizeof(*rj));
+                if (rj == NULL)
+                    unix_error("realloc error");
+            }
+            rj[n].pid = r->pid;
+            rj[n].shell = r->shell;
+            rj[n].jid = r->jid;
+            rj[n].state = r->state;
+            memcpy(rj[n].cmdline, r->cmdline, JR_CMDLEN);
+            n++;
+            break;
+        case JR_STATE:
+            if ((j = rj_find(rj, n, r->shell, r->pid)) != NULL)
+                j->state = r->state;
+            break;
+        case JR_REAP:
+            if ((j = rj_find(rj, n, r->shell, r->pid)) != NULL)
+                *j = rj[--n];
+            break;
+        }
+    }
+
+    for (j = rj; j < rj + n; j++) {
+        const char *st = j->state == ST ? "Stopped" :
+                         j->state == FG ? "Foreground" : "Running";
+        const char *note = "";
+
+        if (j->shell != self && !rj_alive(j->shell))
+            note = rj_alive(j->pid) ? " (orphaned)" : " (gone)";
+        printf("[%d] (%d) %s %s%s\n", j->jid, j->pid, st, j->cmdline, note);
+    }
+
+    free(rj);
+    munmap(base, nrec * sizeof(struct jrec_t));
+    close(fd);
+    return 0;
+}
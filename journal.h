@@ -0,0 +1,53 @@
+//-*-c++-*-
+#ifndef _journal_h_
+#define _journal_h_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "jobs.h"
+
+/*
+ * The job journal is an append-only, memory-mapped file of fixed-size
+ * records describing the lifecycle of every job: when it was added,
+ * each state change, and when it was reaped (with its wait status and
+ * resource usage).  If the shell dies, "jobs --replay" rebuilds the
+ * job list from the file.
+ *
+ * Records are only ever written from the main loop: the reaper runs
+ * there (woken through the SIGCHLD self-pipe) and records child events
+ * with journal_note().
+ */
+
+/* Journal record types */
+#define JR_START  1   /* a shell attached to the journal (pid = shell) */
+#define JR_ADD    2   /* job added to the job list */
+#define JR_STATE  3   /* job changed state */
+#define JR_REAP   4   /* job reaped; status and rusage are valid */
+
+#define JR_CMDLEN 72  /* bytes of the command line kept per record */
+
+struct jrec_t {             /* One journal record (128 bytes) */
+    uint32_t seq;           /* 1, 2, ...; written last, 0 = empty slot */
+    uint16_t type;          /* JR_START, JR_ADD, ... */
+    uint16_t state;         /* job state after the event */
+    int32_t  pid;           /* job PID */
+    int32_t  jid;           /* job ID */
+    int32_t  status;        /* wait status (JR_REAP) */
+    int32_t  shell;         /* PID of the shell that wrote the record */
+    int64_t  time_ns;       /* CLOCK_REALTIME of the event */
+    int64_t  utime_us;      /* user time of the job (JR_REAP) */
+    int64_t  stime_us;      /* system time of the job (JR_REAP) */
+    int64_t  maxrss_kb;     /* peak resident size (JR_REAP) */
+    char     cmdline[JR_CMDLEN]; /* truncated, no trailing newline */
+};
+
+int  journal_open(const char *path);
+void journal_close(void);
+void journal_add(struct job_t *job);
+void journal_state(struct job_t *job);
+void journal_note(int type, pid_t pid, int jid, int state, int status,
+                  const struct rusage *ru);
+int  journal_replay(const char *path);
+
+#endif
@@ -0,0 +1,545 @@
+#include "lineedit.h"
+#include "input.h"
+#include "history.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "helper-routines.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+
+/***********************************************
+ * Raw-mode line editor
+ **********************************************/
+
+#define LE_ASK  100     /* list more completions than this only if asked */
+
+static struct termios cooked;   /* terminal mode to restore */
+static int            active;   /* editor in use (stdin is a tty) */
+static const char    *prompt;
+
+static char  line[MAXLINE];     /* the line being edited */
+static int   len, pos;          /* its length and the cursor */
+static char  saved[MAXLINE];    /* the edit line while browsing history */
+static int   hpos;              /* entries back from the newest, 0 = editing */
+
+static char  obuf[4 * MAXLINE]; /* output for one screen update */
+static int   olen;
+
+
+/* put - Write to the terminal, giving up quietly on errors */
+static void put(const char *s, int n)
+{
+    while (n > 0) {
+        ssize_t w = write(1, s, n);
+        if (w <= 0)
+            return;
+        s += w;
+        n -= w;
+    }
+}
+
+/* out - Queue output for the terminal */
+static void out(const char *s, int n)
+{
+    if (olen + n > (int)sizeof(obuf)) {
+        put(obuf, olen);
+        olen = 0;
+    }
+    if (n > (int)sizeof(obuf)) {
+        put(s, n);
+        return;
+    }
+    memcpy(obuf + olen, s, n);
+    olen += n;
+}
+
+/* outs - Queue a string */
+static void outs(const char *s)
+{
+    out(s, strlen(s));
+}
+
+/* flush - Send queued output */
+static void flush(void)
+{
+    put(obuf, olen);
+    olen = 0;
+}
+
+/* refresh - Redraw the prompt and line and place the cursor */
+static void refresh(void)
+{
+    char move[32];
+
+    outs("\r");
+    outs(prompt);
+    out(line, len);
+    outs("\x1b[K");
+    if (pos < len) {
+        snprintf(move, sizeof(move), "\x1b[%dD", len - pos);
+        outs(move);
+    }
+    flush();
+}
+
+/* raw - Put the terminal in raw mode for editing */
+static void raw(void)
+{
+    struct termios t = cooked;
+
+    t.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    t.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    t.c_cflag |= CS8;
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(0, TCSADRAIN, &t);
+}
+
+/* restore - Put the terminal back the way we found it */
+static void restore(void)
+{
+    if (active)
+        tcsetattr(0, TCSADRAIN, &cooked);
+}
+
+/* set_line - Replace the whole line */
+static void set_line(const char *s, int n)
+{
+    if (n > (int)sizeof(line) - 2)
+        n = sizeof(line) - 2;
+    memcpy(line, s, n);
+    len = pos = n;
+}
+
+/* insert - Insert n bytes at the cursor */
+static void insert(const char *s, int n)
+{
+    if (len + n > (int)sizeof(line) - 2)
+        n = sizeof(line) - 2 - len;
+    if (n <= 0)
+        return;
+    memmove(line + pos + n, line + pos, len - pos);
+    memcpy(line + pos, s, n);
+    len += n;
+    pos += n;
+}
+
+/* erase - Delete n bytes starting at from */
+static void erase(int from, int n)
+{
+    memmove(line + from, line + from + n, len - from - n);
+    len -= n;
+    if (pos > from + n)
+        pos -= n;
+    else if (pos > from)
+        pos = from;
+}
+
+/* browse - Step through the history: dir 1 = older, -1 = newer */
+static void browse(int dir)
+{
+    int count = history_count(), n;
+    const char *p;
+
+    if (hpos + dir < 0 || hpos + dir > count)
+        return;
+    if (hpos == 0) {
+        memcpy(saved, line, len);
+        saved[len] = '\0';
+    }
+    hpos += dir;
+    if (hpos == 0) {
+        set_line(saved, strlen(saved));
+        return;
+    }
+    if ((p = history_get(count + 1 - hpos, &n)) != NULL)
+        set_line(p, n);
+}
+
+/*
+ * search - Incremental reverse search through the history (^R).
+ * Returns the key that ended it, to be handled by the caller, or 0.
+ */
+static int search(void)
+{
+    char text[MAXLINE] = "";
+    int tlen = 0, match = 0, c, n;
+    const char *p;
+
+    for (;;) {
+        outs("\r(reverse-i-search)`");
+        outs(text);
+        outs("': ");
+        if (match && (p = history_get(match, &n)) != NULL)
+            out(p, n);
+        outs("\x1b[K");
+        flush();
+
+        if ((c = readchar()) < 0)
+            return 0;
+        if (c == CTRL('R') && tlen > 0) {
+            int older = history_search(text, (match ? match : history_count() + 1) - 1, 0);
+            match = older ? older : match;
+            continue;
+        }
+        if (c == 127 || c == CTRL('H')) {
+            if (tlen > 0)
+                text[--tlen] = '\0';
+            match = tlen ? history_search(text, history_count(), 0) : 0;
+            continue;
+        }
+        if (c >= ' ' && c < 127 && tlen < (int)sizeof(text) - 1) {
+            text[tlen++] = c;
+            text[tlen] = '\0';
+            match = history_search(text, match ? match : history_count(), 0);
+            continue;
+        }
+        if (c == CTRL('G') || c == CTRL('C')) {
+            refresh();
+            return 0;
+        }
+        if (match && (p = history_get(match, &n)) != NULL) {
+            set_line(p, n);
+            hpos = 0;
+        }
+        refresh();
+        return c == 27 ? 0 : c;     /* ESC just accepts the match */
+    }
+}
+
+
+/***********************************************
+ * Completion
+ **********************************************/
+
+struct cands_t {            /* Candidates for the word being completed */
+    const char **v;
+    char       **owned;     /* strings to free (file names) */
+    int          n, cap, nowned;
+};
+
+/* cand_add - Add a candidate; owned ones are freed with the list */
+static void cand_add(struct cands_t *c, const char *s, int owned)
+{
+    if (c->n == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 64;
+        c->v = (const char **)realloc(c->v, c->cap * sizeof(*c->v));
+        c->owned = (char **)realloc(c->owned, c->cap * sizeof(*c->owned));
+        if (c->v == NULL || c->owned == NULL)
+            unix_error("realloc error");
+    }
+    c->v[c->n++] = s;
+    if (owned)
+        c->owned[c->nowned++] = (char *)s;
+}
+
+/* cand_free - Release a candidate list */
+static void cand_free(struct cands_t *c)
+{
+    int i;
+
+    for (i = 0; i < c->nowned; i++)
+        free(c->owned[i]);
+    free(c->v);
+    free(c->owned);
+}
+
+/* cand_cmp - qsort comparison for candidates */
+static int cand_cmp(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* complete_cmd - Builtins and PATH commands starting with prefix */
+static void complete_cmd(struct cands_t *c, const char *prefix)
+{
+    int first, n, i;
+
+    for (i = 0; builtin_name(i) != NULL; i++)
+        if (!strncmp(builtin_name(i), prefix, strlen(prefix)))
+            cand_add(c, builtin_name(i), 0);
+    n = pathcache_range(prefix, &first);
+    for (i = 0; i < n; i++)
+        cand_add(c, pathcache_name(first + i), 0);
+}
+
+/*
+ * complete_file - Files matching word.  Candidates are whole words
+ * (directory part included); directories end in a slash.
+ */
+static void complete_file(struct cands_t *c, const char *word)
+{
+    const char *slash = strrchr(word, '/');
+    const char *base = slash ? slash + 1 : word;
+    char dir[MAXLINE];
+    size_t dlen = slash ? slash - word + 1 : 0, blen = strlen(base);
+    struct dirent *de;
+    DIR *dp;
+
+    snprintf(dir, sizeof(dir), "%.*s", (int)dlen, word);
+    if ((dp = opendir(dlen ? dir : ".")) == NULL)
+        return;
+    while ((de = readdir(dp)) != NULL) {
+        struct stat st;
+        char *s;
+
+        if (strncmp(de->d_name, base, blen) != 0)
+            continue;
+        if (de->d_name[0] == '.' && (base[0] != '.' ||
+            !strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")))
+            continue;
+        if ((s = (char *)malloc(dlen + strlen(de->d_name) + 2)) == NULL)
+            unix_error("malloc error");
+        sprintf(s, "%s%s", dir, de->d_name);
+        if (fstatat(dirfd(dp), de->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode))
+            strcat(s, "/");
+        cand_add(c, s, 1);
+    }
+    closedir(dp);
+}
+
+/* list - Show the candidates in columns below the line */
+static void list(struct cands_t *c)
+{
+    struct winsize ws;
+    int width = 80, colw = 0, cols, i;
+    char buf[64];
+
+    if (ioctl(1, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        width = ws.ws_col;
+    outs("\n");
+    if (c->n > LE_ASK) {
+        snprintf(buf, sizeof(buf), "Display all %d possibilities? (y or n)", c->n);
+        outs(buf);
+        flush();
+        if (readchar() != 'y') {
+            outs("\n");
+            refresh();
+            return;
+        }
+        outs("\n");
+    }
+    for (i = 0; i < c->n; i++)
+        if ((int)strlen(c->v[i]) + 2 > colw)
+            colw = strlen(c->v[i]) + 2;
+    cols = width / colw > 0 ? width / colw : 1;
+    for (i = 0; i < c->n; i++) {
+        int w = strlen(c->v[i]);
+
+        outs(c->v[i]);
+        if ((i + 1) % cols == 0 || i == c->n - 1)
+            outs("\n");
+        else
+            while (w++ < colw)
+                outs(" ");
+    }
+    refresh();
+}
+
+/* complete - Handle Tab; again is set when the last key was Tab too */
+static void complete(int again)
+{
+    struct cands_t c;
+    char word[MAXLINE];
+    int start = pos, wlen, common, i;
+
+    while (start > 0 && line[start - 1] != ' ' && line[start - 1] != '\t')
+        start--;
+    wlen = pos - start;
+    snprintf(word, sizeof(word), "%.*s", wlen, line + start);
+
+    for (i = 0; i < start && (line[i] == ' ' || line[i] == '\t'); i++)
+        ;
+    memset(&c, 0, sizeof(c));
+    if (i == start && !strchr(word, '/'))
+        complete_cmd(&c, word);
+    else
+        complete_file(&c, word);
+
+    if (c.n == 0) {
+        outs("\a");
+        flush();
+        cand_free(&c);
+        return;
+    }
+    qsort(c.v, c.n, sizeof(*c.v), cand_cmp);
+    for (i = 1, common = 1; i < c.n; i++)      /* builtins may be on PATH too */
+        if (strcmp(c.v[i], c.v[common - 1]))
+            c.v[common++] = c.v[i];
+    c.n = common;
+    for (i = 1, common = strlen(c.v[0]); i < c.n; i++) {
+        int k = 0;
+
+        while (k < common && c.v[i][k] == c.v[0][k])
+            k++;
+        common = k;
+    }
+
+    if (common > wlen) {
+        insert(c.v[0] + wlen, common - wlen);
+        if (c.n == 1 && c.v[0][common - 1] != '/')
+            insert(" ", 1);
+        refresh();
+    }
+    else if (c.n == 1) {
+        if (c.v[0][common - 1] != '/')
+            insert(" ", 1);
+        refresh();
+    }
+    else if (again) {
+        list(&c);
+    }
+    else {
+        outs("\a");
+        flush();
+    }
+    cand_free(&c);
+}
+
+
+/***********************************************
+ * The editor
+ **********************************************/
+
+/* lineedit_open - Edit command lines when stdin is a terminal */
+int lineedit_open(const char *p)
+{
+    if (!isatty(0) || !isatty(1) || tcgetattr(0, &cooked) < 0)
+        return -1;
+    prompt = p;
+    active = 1;
+    atexit(restore);
+    return 0;
+}
+
+/* lineedit_active - Is the editor reading the command lines? */
+int lineedit_active(void)
+{
+    return active;
+}
+
+/* key_escape - Handle the rest of an escape sequence */
+static void key_escape(void)
+{
+    int c = readchar(), d;
+
+    if (c != '[' && c != 'O')
+        return;
+    switch (d = readchar()) {
+    case 'A': browse(1); break;
+    case 'B': browse(-1); break;
+    case 'C': if (pos < len) pos++; break;
+    case 'D': if (pos > 0) pos--; break;
+    case 'H': pos = 0; break;
+    case 'F': pos = len; break;
+    default:
+        if (d >= '0' && d <= '9') {
+            int e = readchar();     /* ESC [ n ~ */
+
+            if (e != '~')
+                break;
+            if (d == '3' && pos < len)
+                erase(pos, 1);
+            else if (d == '1' || d == '7')
+                pos = 0;
+            else if (d == '4' || d == '8')
+                pos = len;
+        }
+    }
+}
+
+/*
+ * lineedit_read - Read and edit one command line.  Returns it with a
+ * trailing newline, like readcmd, or NULL at end of file.
+ */
+char *lineedit_read(char *cmdline, int size)
+{
+    int c, last = 0;
+
+    fflush(stdout);
+    raw();
+    len = pos = hpos = 0;
+    for (;;) {
+        c = readchar();
+    again:
+        switch (c) {
+        case -1:
+            restore();
+            return NULL;
+        case '\r':
+        case '\n':
+            outs("\n");
+            flush();
+            restore();
+            if (len > size - 2)
+                len = size - 2;
+            memcpy(cmdline, line, len);
+            strcpy(cmdline + len, "\n");
+            return cmdline;
+        case CTRL('D'):
+            if (len == 0) {
+                outs("\n");
+                flush();
+                restore();
+                return NULL;
+            }
+            if (pos < len)
+                erase(pos, 1);
+            break;
+        case CTRL('C'):
+            outs("^C\n");
+            len = pos = hpos = 0;
+            break;
+        case 127:
+        case CTRL('H'):
+            if (pos > 0)
+                erase(pos - 1, 1);
+            break;
+        case CTRL('A'): pos = 0; break;
+        case CTRL('E'): pos = len; break;
+        case CTRL('B'): if (pos > 0) pos--; break;
+        case CTRL('F'): if (pos < len) pos++; break;
+        case CTRL('K'): len = pos; break;
+        case CTRL('U'): erase(0, pos); break;
+        case CTRL('W'): {
+            int from = pos;
+
+            while (from > 0 && line[from - 1] == ' ')
+                from--;
+            while (from > 0 && line[from - 1] != ' ')
+                from--;
+            erase(from, pos - from);
+            break;
+        }
+        case CTRL('P'): browse(1); break;
+        case CTRL('N'): browse(-1); break;
+        case CTRL('L'): outs("\x1b[H\x1b[2J"); break;
+        case CTRL('R'):
+            if ((c = search()) != 0)
+                goto again;
+            break;
+        case '\t':
+            complete(last == '\t');
+            last = c;
+            continue;
+        case 27:
+            key_escape();
+            break;
+        default:
+            if (c >= ' ') {
+                char ch = c;
+                insert(&ch, 1);
+            }
+        }
+        last = c;
+        refresh();
+    }
+}
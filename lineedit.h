@@ -0,0 +1,24 @@
+//-*-c++-*-
+#ifndef _lineedit_h_
+#define _lineedit_h_
+
+/*
+ * Line editor for interactive shells.  While a command line is being
+ * typed the terminal is in raw mode and the editor handles the keys;
+ * it is back in its original mode before the line is returned, so
+ * jobs always start on a normal terminal.
+ *
+ *     Left/Right ^B/^F     move a character      Home/End ^A/^E
+ *     Backspace, Del ^D    delete (^D on an empty line is end of file)
+ *     ^K ^U ^W             kill to end / to start / previous word
+ *     Up/Down ^P/^N        walk the history      ^R  reverse search
+ *     Tab                  complete a command (from the PATH index) or
+ *                          a file name; twice lists the choices
+ *     ^C                   abandon the line      ^L  clear the screen
+ */
+
+int   lineedit_open(const char *prompt);
+int   lineedit_active(void);
+char *lineedit_read(char *cmdline, int size);
+
+#endif
@@ -0,0 +1,328 @@
+#include "metrics.h"
+#include "evloop.h"
+#include "jobs.h"
+#include "expand.h"
+#include "helper-routines.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+
+/***********************************************
+ * Counters and the reap latency histogram
+ **********************************************/
+
+#define HBUCKETS  256   /* log-linear buckets, 4 per power of two (ns) */
+#define RATE_SECS 10    /* window for tsh_spawn_rate */
+
+static unsigned long spawns;          /* children started */
+static unsigned long fork_failures;   /* fork() returned -1 */
+static unsigned long reaps;           /* children reaped */
+static unsigned long *exec_failures;  /* shared: children whose exec failed */
+
+static uint64_t hist[HBUCKETS];       /* reap latency histogram */
+static uint64_t hcount;
+static double   hsum;                 /* seconds */
+
+static int64_t  sigchld_ns;           /* first SIGCHLD since the last reap pass */
+static int64_t  pass_ns;              /* the one the current pass answers */
+
+static int64_t  rate_sec[RATE_SECS];  /* second each slot counts */
+static unsigned rate_cnt[RATE_SECS];  /* spawns in that second */
+
+
+/* m_now - Monotonic clock in nanoseconds (async-signal-safe) */
+static int64_t m_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* hbucket - Histogram bucket for a latency of ns nanoseconds */
+static int hbucket(uint64_t ns)
+{
+    int msb;
+
+    if (ns < 4)
+        return ns;
+    msb = 63 - __builtin_clzll(ns);
+    return 4 * (msb - 1) + ((ns >> (msb - 2)) & 3);
+}
+
+/* hvalue - Midpoint of a histogram bucket, in nanoseconds */
+static double hvalue(int b)
+{
+    int msb, sub;
+
+    if (b < 4)
+        return b;
+    msb = b / 4 + 1;
+    sub = b % 4;
+    return (double)(1ULL << msb) + (sub + 0.5) * (double)(1ULL << (msb - 2));
+}
+
+/* hquantile - Estimate quantile q of the reap latency, in seconds */
+static double hquantile(double q)
+{
+    uint64_t want = (uint64_t)(q * hcount + 0.5), seen = 0;
+    int b;
+
+    if (hcount == 0)
+        return 0;
+    if (want == 0)
+        want = 1;
+    for (b = 0; b < HBUCKETS; b++)
+        if ((seen += hist[b]) >= want)
+            break;
+    return hvalue(b < HBUCKETS ? b : HBUCKETS - 1) / 1e9;
+}
+
+/* metrics_note_spawn - Count a child started by the shell */
+void metrics_note_spawn(void)
+{
+    int64_t sec = m_now() / 1000000000;
+    int slot = sec % RATE_SECS;
+
+    spawns++;
+    if (rate_sec[slot] != sec) {
+        rate_sec[slot] = sec;
+        rate_cnt[slot] = 0;
+    }
+    rate_cnt[slot]++;
+}
+
+/* metrics_note_fork_failure - Count a failed fork */
+void metrics_note_fork_failure(void)
+{
+    fork_failures++;
+}
+
+/*
+ * metrics_note_exec_failure - Called by a child whose exec failed, just
+ * before it exits.  The counter is in a page shared with the shell, so
+ * a program that exits with 127 itself is not counted.
+ */
+void metrics_note_exec_failure(void)
+{
+    if (exec_failures != NULL)
+        __atomic_fetch_add(exec_failures, 1, __ATOMIC_RELAXED);
+}
+
+/* metrics_note_sigchld - Called from the SIGCHLD handler: start the clock */
+void metrics_note_sigchld(void)
+{
+    if (__atomic_load_n(&sigchld_ns, __ATOMIC_RELAXED) == 0)
+        __atomic_store_n(&sigchld_ns, m_now(), __ATOMIC_RELAXED);
+}
+
+/*
+ * metrics_note_pass - Called as the reaper starts a pass: every reap
+ * in it is timed from the first SIGCHLD since the last pass.  Taking
+ * the stamp also clears it, so a SIGCHLD that reaps nothing (a stop,
+ * a continue, a $(...) child waited for by cs_capture) doesn't date
+ * the next real reap.
+ */
+void metrics_note_pass(void)
+{
+    pass_ns = __atomic_exchange_n(&sigchld_ns, 0, __ATOMIC_RELAXED);
+}
+
+/* metrics_note_reap - Called by the reaper for each child that exited or was killed */
+void metrics_note_reap(void)
+{
+    int64_t ns = pass_ns ? m_now() - pass_ns : 0;
+
+    reaps++;
+    hist[hbucket(ns > 0 ? ns : 0)]++;
+    hcount++;
+    hsum += ns / 1e9;
+}
+
+/* metrics_write - Print all metrics in Prometheus text format */
+void metrics_write(FILE *fp)
+{
+    int nstate[4] = { 0, 0, 0, 0 };
+    int64_t now = m_now() / 1000000000;
+    unsigned long recent = 0, hits, misses;
+    int i;
+
+    for (i = 0; jobs != NULL && i < MAXJOBS; i++)
+        if (jobs[i].pid != 0 && jobs[i].state > UNDEF && jobs[i].state <= ST)
+            nstate[jobs[i].state]++;
+    for (i = 0; i < RATE_SECS; i++)
+        if (rate_sec[i] > now - RATE_SECS && rate_sec[i] <= now)
+            recent += rate_cnt[i];
+
+    fprintf(fp, "# HELP tsh_jobs Jobs on the job list by state.\n"
+                "# TYPE tsh_jobs gauge\n"
+                "tsh_jobs{state=\"foreground\"} %d\n"
+                "tsh_jobs{state=\"background\"} %d\n"
+                "tsh_jobs{state=\"stopped\"} %d\n",
+            nstate[FG], nstate[BG], nstate[ST]);
+    fprintf(fp, "# HELP tsh_spawns_total Child processes started.\n"
+                "# TYPE tsh_spawns_total counter\n"
+                "tsh_spawns_total %lu\n", spawns);
+    fprintf(fp, "# HELP tsh_spawn_rate Children started per second over the last %d seconds.\n"
+                "# TYPE tsh_spawn_rate gauge\n"
+                "tsh_spawn_rate %g\n", RATE_SECS, (double)recent / RATE_SECS);
+    fprintf(fp, "# HELP tsh_fork_failures_total Failed calls to fork.\n"
+                "# TYPE tsh_fork_failures_total counter\n"
+                "tsh_fork_failures_total %lu\n", fork_failures);
+    fprintf(fp, "# HELP tsh_exec_failures_total Children that could not exec their program.\n"
+                "# TYPE tsh_exec_failures_total counter\n"
+                "tsh_exec_failures_total %lu\n",
+                exec_failures ? __atomic_load_n(exec_failures, __ATOMIC_RELAXED) : 0);
+    fprintf(fp, "# HELP tsh_reaps_total Children reaped.\n"
+                "# TYPE tsh_reaps_total counter\n"
+                "tsh_reaps_total %lu\n", reaps);
+    fprintf(fp, "# HELP tsh_reap_latency_seconds Delay from SIGCHLD to the main loop reaping the child.\n"
+                "# TYPE tsh_reap_latency_seconds summary\n"
+                "tsh_reap_latency_seconds{quantile=\"0.5\"} %g\n"
+                "tsh_reap_latency_seconds{quantile=\"0.9\"} %g\n"
+                "tsh_reap_latency_seconds{quantile=\"0.99\"} %g\n"
+                "tsh_reap_latency_seconds_sum %g\n"
+                "tsh_reap_latency_seconds_count %lu\n",
+            hquantile(0.5), hquantile(0.9), hquantile(0.99), hsum,
+            (unsigned long)hcount);
+    expand_cache_stats(&hits, &misses);
+    fprintf(fp, "# HELP tsh_parse_cache_hits_total Command lines found in the parse cache.\n"
+                "# TYPE tsh_parse_cache_hits_total counter\n"
+                "tsh_parse_cache_hits_total %lu\n"
+                "# HELP tsh_parse_cache_misses_total Command lines parsed anew.\n"
+                "# TYPE tsh_parse_cache_misses_total counter\n"
+                "tsh_parse_cache_misses_total %lu\n", hits, misses);
+}
+
+
+/***********************************************
+ * Unix-domain metrics socket
+ **********************************************/
+
+struct mclient_t {          /* A connection being served */
+    char  *out;             /* response */
+    size_t len;             /* its length */
+    size_t off;             /* bytes already sent */
+};
+
+/* mc_close - Drop a client connection */
+static void mc_close(int fd, struct mclient_t *c)
+{
+    evloop_del(fd);
+    close(fd);
+    free(c->out);
+    free(c);
+}
+
+/*
+ * mc_respond - Render the metrics for a client.  A request starting
+ * with "GET" gets an HTTP/1.0 response so Prometheus can scrape the
+ * socket directly; anything else gets the bare text.
+ */
+static void mc_respond(struct mclient_t *c, int http)
+{
+    char *body = NULL;
+    size_t blen = 0;
+    FILE *fp = open_memstream(&body, &blen);
+
+    if (fp == NULL)
+        unix_error("open_memstream error");
+    metrics_write(fp);
+    fclose(fp);
+    if (!http) {
+        c->out = body;
+        c->len = blen;
+        return;
+    }
+    fp = open_memstream(&c->out, &c->len);
+    if (fp == NULL)
+        unix_error("open_memstream error");
+    fprintf(fp, "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %lu\r\n\r\n", (unsigned long)blen);
+    fwrite(body, 1, blen, fp);
+    fclose(fp);
+    free(body);
+}
+
+/* mc_event - Event loop handler for a client connection */
+static void mc_event(int fd, unsigned int events, void *arg)
+{
+    struct mclient_t *c = (struct mclient_t *)arg;
+    ssize_t n;
+
+    if (c->out == NULL) {
+        char req[512];
+
+        n = recv(fd, req, sizeof(req), MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (n < 0) {
+            mc_close(fd, c);
+            return;
+        }
+        mc_respond(c, n >= 3 && !memcmp(req, "GET", 3));
+        evloop_mod(fd, EPOLLOUT);
+    }
+    while (c->off < c->len) {
+        n = send(fd, c->out + c->off, c->len - c->off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            return;            /* wait for EPOLLOUT */
+        if (n < 0)
+            break;
+        c->off += n;
+    }
+    mc_close(fd, c);
+}
+
+/* mc_accept - Event loop handler for the listening socket */
+static void mc_accept(int lfd, unsigned int events, void *arg)
+{
+    int fd;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct mclient_t *c = (struct mclient_t *)calloc(1, sizeof(*c));
+
+        if (c == NULL || evloop_add(fd, EPOLLIN, mc_event, c) < 0) {
+            free(c);
+            close(fd);
+        }
+    }
+}
+
+/* metrics_listen - Serve metrics on the Unix socket at path */
+int metrics_listen(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        printf("metrics: %s: path too long\n", path);
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    exec_failures = (unsigned long *)mmap(NULL, sizeof(*exec_failures), PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (exec_failures == MAP_FAILED)
+        exec_failures = NULL;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+        bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        listen(fd, 64) < 0 ||
+        evloop_add(fd, EPOLLIN, mc_accept, NULL) < 0) {
+        printf("metrics: %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+//-*-c++-*-
+#ifndef _metrics_h_
+#define _metrics_h_
+
+#include <stdio.h>
+
+/*
+ * Shell metrics: jobs by state, spawn rate, fork/exec failures and
+ * reap latency (the delay between SIGCHLD and the main loop reaping
+ * the child).  "tsh -m <path>" serves them in Prometheus text format
+ * on a Unix-domain socket from the event loop; requests never block
+ * the command loop.
+ */
+
+void metrics_note_spawn(void);
+void metrics_note_fork_failure(void);
+void metrics_note_exec_failure(void);  /* in the child */
+void metrics_note_sigchld(void);        /* async-signal-safe */
+void metrics_note_pass(void);
+void metrics_note_reap(void);
+void metrics_write(FILE *fp);
+int  metrics_listen(const char *path);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * mylines.c - A handy program for benchmarking your tiny shell
+ *
+ * usage: mylines <mb> [<len>]
+ * Writes <mb> megabytes of <len>-byte lines (default 80) to stdout in
+ * 64K writes, which don't end on line boundaries.  Each line starts
+ * with the program's pid, so a line torn by another writer shows.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+    static char buf[65536 + 4096];
+    long total, done = 0;
+    int len, n = 0;
+    char line[4096];
+
+    if (argc < 2) {
+	fprintf(stderr, "Usage: %s <mb> [<len>]\n", argv[0]);
+	exit(1);
+    }
+    total = atol(argv[1]) << 20;
+    len = argc > 2 ? atoi(argv[2]) : 80;
+    if (len < 16 || len > (int)sizeof(line))
+	len = 80;
+    snprintf(line, sizeof(line), "%d:", (int)getpid());
+    memset(line + strlen(line), 'x', len - 1 - strlen(line));
+    line[len - 1] = '\n';
+
+    while (done < total) {
+	while (n < 65536) {
+	    memcpy(buf + n, line, len);
+	    n += len;
+	}
+	if (write(1, buf, 65536) != 65536)
+	    exit(1);
+	done += 65536;
+	memmove(buf, buf + 65536, n - 65536);
+	n -= 65536;
+    }
+    if (n > 0 && write(1, buf, n) != n)     /* the last line, finished */
+	exit(1);
+    exit(0);
+}
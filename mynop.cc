@@ -0,0 +1,13 @@
+/* 
+ * mynop.c - A handy program for benchmarking your tiny shell
+ * 
+ * usage: mynop
+ * Exits immediately, so running it measures the shell's own
+ * fork/exec/reap overhead.
+ */
+#include <stdlib.h>
+
+int main(int argc, char **argv) 
+{
+    exit(0);
+}
@@ -0,0 +1,51 @@
+/*
+ * mysock.c - A handy program for testing your tiny shell's sockets
+ *
+ * usage: mysock <socket> <request>
+ * Connects to the Unix socket (retrying for up to a second, while the
+ * shell starts), sends the request as one line, and prints the reply
+ * line.  Exits with 1 if there is no reply.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un sa;
+    char buf[65536];
+    int fd, i, n = 0;
+    ssize_t r;
+
+    if (argc != 3 || strlen(argv[1]) >= sizeof(sa.sun_path)) {
+	fprintf(stderr, "Usage: %s <socket> <request>\n", argv[0]);
+	exit(1);
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, argv[1]);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	exit(1);
+    for (i = 0; connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0; i++) {
+	if (i == 100) {
+	    perror(argv[1]);
+	    exit(1);
+	}
+	usleep(10000);
+    }
+    if (write(fd, argv[2], strlen(argv[2])) < 0 || write(fd, "\n", 1) < 0)
+	exit(1);
+
+    while (n < (int)sizeof(buf) && (r = read(fd, buf + n, sizeof(buf) - n)) > 0) {
+	n += r;
+	if (memchr(buf, '\n', n) != NULL)
+	    break;
+    }
+    if (n == 0 || memchr(buf, '\n', n) == NULL)
+	exit(1);
+    fwrite(buf, 1, (char *)memchr(buf, '\n', n) - buf + 1, stdout);
+    exit(0);
+}
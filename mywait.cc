@@ -0,0 +1,30 @@
+/* 
+ * mywait.c - A handy program for benchmarking your tiny shell
+ * 
+ * usage: mywait <fifo>
+ * Blocks until every writer of <fifo> has closed it, then exits.
+ * Many copies started against the same fifo all exit at once when
+ * the benchmark closes its end.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+int main(int argc, char **argv) 
+{
+    char buf[64];
+    int fd;
+
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s <fifo>\n", argv[0]);
+	exit(0);
+    }
+    if ((fd = open(argv[1], O_RDONLY)) < 0) {
+	perror(argv[1]);
+	exit(1);
+    }
+    while (read(fd, buf, sizeof(buf)) > 0)
+	;
+    exit(0);
+}
@@ -0,0 +1,289 @@
+#include "pathcache.h"
+#include "evloop.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+
+/***********************************************
+ * Sorted, inotify-maintained index of $PATH
+ **********************************************/
+
+#define PC_MAXDIRS 64   /* PATH directories indexed (one bit each) */
+#define PC_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct pcent_t {            /* One command name */
+    char    *name;
+    uint64_t dirs;          /* bit d: found in dirs[d] */
+};
+
+static char           *dirs[PC_MAXDIRS];   /* PATH, in search order */
+static int             wds[PC_MAXDIRS];    /* inotify watch of each dir */
+static int             ndirs;
+static struct pcent_t *ents;               /* sorted by name */
+static int             nents, capents;
+static int             infd = -1;          /* inotify instance */
+static int             built;              /* index is valid */
+
+
+/* pc_find - Index of the first entry not less than name */
+static int pc_find(const char *name)
+{
+    int lo = 0, hi = nents;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(ents[mid].name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* pc_append - Add an entry at the end, leaving the array unsorted */
+static void pc_append(const char *name, int d)
+{
+    if (nents == capents) {
+        capents = capents ? 2 * capents : 1024;
+        ents = (struct pcent_t *)realloc(ents, capents * sizeof(*ents));
+        if (ents == NULL)
+            unix_error("realloc error");
+    }
+    ents[nents].name = strdup(name);
+    ents[nents].dirs = 1ULL << d;
+    nents++;
+}
+
+/* pc_set - Record whether dirs[d] holds an executable called name */
+static void pc_set(const char *name, int d, int present)
+{
+    int i = pc_find(name);
+    int have = i < nents && !strcmp(ents[i].name, name);
+
+    if (present) {
+        if (!have) {
+            struct pcent_t e;
+
+            pc_append(name, d);             /* then move it into place */
+            e = ents[nents - 1];
+            memmove(ents + i + 1, ents + i, (nents - 1 - i) * sizeof(*ents));
+            ents[i] = e;
+        }
+        ents[i].dirs |= 1ULL << d;
+    }
+    else if (have && (ents[i].dirs &= ~(1ULL << d)) == 0) {
+        free(ents[i].name);
+        memmove(ents + i, ents + i + 1, (nents - i - 1) * sizeof(*ents));
+        nents--;
+    }
+}
+
+/* pc_executable - Is dir/name a file we could run? */
+static int pc_executable(int dfd, const char *name)
+{
+    struct stat st;
+
+    return fstatat(dfd, name, &st, 0) == 0 && S_ISREG(st.st_mode) &&
+           faccessat(dfd, name, X_OK, AT_EACCESS) == 0;
+}
+
+/* pc_cmp - qsort comparison for entries */
+static int pc_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct pcent_t *)a)->name, ((const struct pcent_t *)b)->name);
+}
+
+/* pc_sort - Sort appended entries and merge names found in several dirs */
+static void pc_sort(void)
+{
+    int i, n = 0;
+
+    qsort(ents, nents, sizeof(*ents), pc_cmp);
+    for (i = 0; i < nents; i++) {
+        if (n > 0 && !strcmp(ents[n - 1].name, ents[i].name)) {
+            ents[n - 1].dirs |= ents[i].dirs;
+            free(ents[i].name);
+        }
+        else
+            ents[n++] = ents[i];
+    }
+    nents = n;
+}
+
+/* pc_scan - Append every command in dirs[d]; pc_sort must follow */
+static void pc_scan(int d)
+{
+    DIR *dp = opendir(dirs[d]);
+    struct dirent *de;
+
+    if (dp == NULL)
+        return;
+    while ((de = readdir(dp)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        if (de->d_type != DT_REG && de->d_type != DT_LNK && de->d_type != DT_UNKNOWN)
+            continue;
+        if (pc_executable(dirfd(dp), de->d_name))
+            pc_append(de->d_name, d);
+    }
+    closedir(dp);
+}
+
+/* pc_drop_dir - Forget everything dirs[d] contributed */
+static void pc_drop_dir(int d)
+{
+    int i;
+
+    for (i = nents - 1; i >= 0; i--)
+        if (ents[i].dirs & (1ULL << d))
+            pc_set(ents[i].name, d, 0);
+}
+
+/* pc_notify - Event loop handler: apply directory changes to the index */
+static void pc_notify(int fd, unsigned int events, void *arg)
+{
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        char *p;
+
+        for (p = buf; p < buf + n; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            int d;
+
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {     /* lost track: start over */
+                while (nents > 0)
+                    free(ents[--nents].name);
+                for (d = 0; d < ndirs; d++)
+                    if (wds[d] >= 0)
+                        pc_scan(d);
+                pc_sort();
+                continue;
+            }
+            for (d = 0; d < ndirs && wds[d] != ev->wd; d++)
+                ;
+            if (d == ndirs)
+                continue;
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                pc_drop_dir(d);
+                wds[d] = -1;
+            }
+            else if (ev->len > 0 && ev->name[0] != '.') {
+                int dfd = open(dirs[d], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                int present = !(ev->mask & (IN_DELETE | IN_MOVED_FROM)) &&
+                              dfd >= 0 && pc_executable(dfd, ev->name);
+
+                pc_set(ev->name, d, present);
+                if (dfd >= 0)
+                    close(dfd);
+            }
+        }
+    }
+}
+
+/* pc_parse_path - Split $PATH into dirs */
+static void pc_parse_path(void)
+{
+    const char *path = getenv("PATH");
+    char *copy, *dir, *save;
+
+    if (ndirs || path == NULL)
+        return;
+    copy = strdup(path);
+    for (dir = strtok_r(copy, ":", &save); dir && ndirs < PC_MAXDIRS;
+         dir = strtok_r(NULL, ":", &save))
+        dirs[ndirs++] = strdup(*dir ? dir : ".");
+    free(copy);
+}
+
+/*
+ * pathcache_build - Scan PATH and start watching it.  Only the first
+ * call does any work.
+ */
+int pathcache_build(void)
+{
+    int d;
+
+    if (built)
+        return 0;
+    pc_parse_path();
+    infd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (infd >= 0 && evloop_add(infd, EPOLLIN, pc_notify, NULL) < 0) {
+        close(infd);
+        infd = -1;
+    }
+    for (d = 0; d < ndirs; d++) {
+        wds[d] = infd >= 0 ? inotify_add_watch(infd, dirs[d], PC_EVENTS | IN_ONLYDIR) : -1;
+        pc_scan(d);
+    }
+    pc_sort();
+    built = 1;
+    return 0;
+}
+
+/*
+ * pathcache_range - Count the commands starting with prefix; the
+ * first is pathcache_name(*first), the rest follow it in order.
+ */
+int pathcache_range(const char *prefix, int *first)
+{
+    size_t len = strlen(prefix);
+    int i;
+
+    pathcache_build();
+    *first = i = pc_find(prefix);
+    while (i < nents && !strncmp(ents[i].name, prefix, len))
+        i++;
+    return i - *first;
+}
+
+/* pathcache_name - The ith command, in sorted order */
+const char *pathcache_name(int i)
+{
+    return i >= 0 && i < nents ? ents[i].name : NULL;
+}
+
+/*
+ * pathcache_resolve - The program to run for a command.  Names with a
+ * slash are used as they are; others are looked up on PATH, and fall
+ * back to a file of that name in the current directory, as before
+ * PATH searching was added.
+ */
+const char *pathcache_resolve(const char *name)
+{
+    static char path[MAXLINE];
+    int d;
+
+    if (strchr(name, '/') != NULL || *name == '\0')
+        return name;
+    pc_parse_path();
+    if (built) {
+        int i = pc_find(name);
+
+        if (i < nents && !strcmp(ents[i].name, name)) {
+            d = __builtin_ctzll(ents[i].dirs);
+            snprintf(path, sizeof(path), "%s/%s", dirs[d], name);
+            return path;
+        }
+        return name;
+    }
+    for (d = 0; d < ndirs; d++) {
+        snprintf(path, sizeof(path), "%s/%s", dirs[d], name);
+        if (access(path, X_OK) == 0)
+            return path;
+    }
+    return name;
+}
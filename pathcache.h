@@ -0,0 +1,22 @@
+//-*-c++-*-
+#ifndef _pathcache_h_
+#define _pathcache_h_
+
+/*
+ * Index of the commands on $PATH.  Built once, on the first lookup
+ * or completion that wants it, as a sorted array of names, each with
+ * the set of PATH directories that hold it.  From then on it is kept
+ * current through inotify watches on those directories, serviced by
+ * the event loop, so no keystroke ever rescans a directory.
+ *
+ * pathcache_resolve turns a command name without a slash into the
+ * path the shell should exec; it scans PATH directly until the index
+ * has been built, so non-interactive shells never build one.
+ */
+
+int         pathcache_build(void);
+int         pathcache_range(const char *prefix, int *first);
+const char *pathcache_name(int i);
+const char *pathcache_resolve(const char *name);
+
+#endif
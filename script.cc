@@ -0,0 +1,1085 @@
+#include "script.h"
+#include "expand.h"
+#include "vars.h"
+#include "input.h"
+#include "heredoc.h"
+#include "tsh.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include "tracing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#define SC_MAXLOOPS 64      /* loops nested in one function or script */
+#define SC_MAXCALLS 256     /* function calls nested */
+#define SC_FSLOTS   64      /* function hash chains, a power of two */
+
+static volatile sig_atomic_t interrupted;   /* ctrl-c: stop the script */
+
+
+/***********************************************
+ * Lexing
+ **********************************************/
+
+enum { T_WORD, T_SEMI, T_AMP, T_AND, T_OR, T_NL, T_LPAR, T_RPAR, T_EOF };
+
+struct node_t;
+
+struct parser_t {           /* The script being parsed */
+    const char *p;          /* what follows the current token */
+    int         tok;        /* the current token */
+    const char *start;      /* and its text */
+    size_t      len;
+    int         err;        /* a syntax error was reported */
+    int         more;       /* it ended too soon: read another line */
+};
+
+/* sc_close - The c that closes the bracket opened before p, or the end */
+static const char *sc_close(const char *p, char open, char c)
+{
+    int depth = 0;
+
+    for ( ; *p; p++) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            const char *q = strchr(p + 1, *p);
+            if (q == NULL)
+                break;
+            p = q;
+        }
+        else if (*p == open)
+            depth++;
+        else if (*p == c && depth-- == 0)
+            return p;
+    }
+    return p + strlen(p);
+}
+
+/* sc_wordend - The end of the word at p: quotes and $(...) may hold anything */
+static const char *sc_wordend(const char *p)
+{
+    while (*p && !strchr(" \t\n;&()", *p) && !(p[0] == '|' && p[1] == '|')) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            const char *q = strchr(p + 1, *p);
+            p = q != NULL ? q + 1 : p + strlen(p);
+        }
+        else if ((*p == '$' && (p[1] == '(' || p[1] == '{')) ||
+                 ((*p == '<' || *p == '>') && p[1] == '(')) {    /* or <(...), >(...) */
+            p = sc_close(p + 2, p[1], p[1] == '(' ? ')' : '}');
+            if (*p)
+                p++;
+        }
+        else
+            p++;
+    }
+    return p;
+}
+
+/* sc_next - Move to the next token */
+static void sc_next(struct parser_t *ps)
+{
+    const char *p = ps->p;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '#')                          /* a comment, to the end of the line */
+        p += strcspn(p, "\n");
+    ps->start = p;
+    ps->len = 1;
+    switch (*p) {
+    case '\0': ps->tok = T_EOF; ps->len = 0; break;
+    case '\n': ps->tok = T_NL; break;
+    case ';':  ps->tok = T_SEMI; break;
+    case '(':  ps->tok = T_LPAR; break;
+    case ')':  ps->tok = T_RPAR; break;
+    case '&':
+        ps->tok = p[1] == '&' ? T_AND : T_AMP;
+        ps->len = p[1] == '&' ? 2 : 1;
+        break;
+    default:
+        if (p[0] == '|' && p[1] == '|') {
+            ps->tok = T_OR;
+            ps->len = 2;
+            break;
+        }
+        ps->tok = T_WORD;
+        ps->len = sc_wordend(p) - p;
+        break;
+    }
+    ps->p = p + ps->len;
+}
+
+/* sc_is - Is the current token the word w? */
+static int sc_is(struct parser_t *ps, const char *w)
+{
+    return ps->tok == T_WORD && ps->len == strlen(w) && !memcmp(ps->start, w, ps->len);
+}
+
+/* sc_error - Report a syntax error at the current token, once */
+static struct node_t *sc_error(struct parser_t *ps)
+{
+    if (ps->tok == T_EOF)                   /* not an error yet: wants more */
+        ps->more = 1;
+    else if (!ps->err && !ps->more)
+        printf("syntax error near unexpected token '%.*s'\n",
+               ps->tok == T_NL ? 7 : (int)ps->len, ps->tok == T_NL ? "newline" : ps->start);
+    ps->err = 1;
+    return NULL;
+}
+
+/* sc_skipnl - Step over newlines */
+static void sc_skipnl(struct parser_t *ps)
+{
+    while (ps->tok == T_NL)
+        sc_next(ps);
+}
+
+
+/***********************************************
+ * Parsing
+ **********************************************/
+
+enum { N_CMD, N_SET, N_AND, N_OR, N_NOT, N_IF, N_WHILE, N_FOR, N_FUNC };
+
+struct span_t {             /* A word in the script's text */
+    const char *s;
+    size_t      n;
+};
+
+struct node_t {             /* The syntax tree */
+    int             kind;
+    struct node_t  *a, *b, *c;  /* condition, body, else; or the operands */
+    struct node_t  *next;       /* in a list */
+    struct span_t  *words;      /* N_CMD, N_SET, N_FOR (name, then the list) */
+    int             nwords;
+    struct span_t   text;       /* N_CMD: all of it */
+    int             flag;       /* N_CMD: &; N_WHILE: until; N_FOR: has "in" */
+};
+
+struct block_t {            /* Memory for the tree, freed all at once */
+    struct block_t *next;
+    size_t          used;
+    char            data[8192 - 2 * sizeof(void *)];
+};
+
+static struct block_t *blocks;
+
+/* sc_alloc - n zeroed bytes that last until sc_release */
+static void *sc_alloc(size_t n)
+{
+    n = (n + 15) & ~(size_t)15;
+    if (blocks == NULL || blocks->used + n > sizeof(blocks->data)) {
+        size_t size = n > sizeof(blocks->data) ? sizeof(struct block_t) + n : sizeof(struct block_t);
+        struct block_t *b = (struct block_t *)malloc(size);
+
+        if (b == NULL)
+            unix_error("malloc error");
+        b->used = 0;
+        b->next = blocks;
+        blocks = b;
+    }
+    void *m = blocks->data + blocks->used;
+    blocks->used += n;
+    return memset(m, 0, n);
+}
+
+/* sc_release - Free the tree */
+static void sc_release(void)
+{
+    while (blocks != NULL) {
+        struct block_t *b = blocks;
+        blocks = b->next;
+        free(b);
+    }
+}
+
+/* sc_node - A new node */
+static struct node_t *sc_node(int kind, struct node_t *a, struct node_t *b)
+{
+    struct node_t *n = (struct node_t *)sc_alloc(sizeof(*n));
+
+    n->kind = kind;
+    n->a = a;
+    n->b = b;
+    return n;
+}
+
+/* sc_reserved - Is the current token a word that ends a list? */
+static int sc_reserved(struct parser_t *ps)
+{
+    static const char *words[] = { "then", "elif", "else", "fi", "do", "done", "}" };
+
+    for (unsigned i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+        if (sc_is(ps, words[i]))
+            return 1;
+    return 0;
+}
+
+/* sc_assignment - Is the word name=value? */
+static int sc_assignment(const struct span_t *w)
+{
+    size_t n = var_name(w->s);
+
+    return n > 0 && n < w->n && w->s[n] == '=';
+}
+
+static struct node_t *sc_list(struct parser_t *ps);
+static struct node_t *sc_command(struct parser_t *ps);
+
+/* sc_expect - Take the word w, or report an error */
+static int sc_expect(struct parser_t *ps, const char *w)
+{
+    if (!sc_is(ps, w)) {
+        sc_error(ps);
+        return 0;
+    }
+    sc_next(ps);
+    return 1;
+}
+
+/* sc_simple - A simple command: words up to an operator */
+static struct node_t *sc_simple(struct parser_t *ps)
+{
+    struct node_t *n = sc_node(N_CMD, NULL, NULL);
+    struct parser_t save = *ps;
+    int i, all = 1;
+
+    while (ps->tok == T_WORD) {
+        n->nwords++;
+        sc_next(ps);
+    }
+    n->words = (struct span_t *)sc_alloc(n->nwords * sizeof(*n->words));
+    *ps = save;
+    for (i = 0; i < n->nwords; i++) {
+        n->words[i].s = ps->start;
+        n->words[i].n = ps->len;
+        all = all && sc_assignment(&n->words[i]);
+        sc_next(ps);
+    }
+    n->text.s = n->words[0].s;
+    n->text.n = n->words[i - 1].s + n->words[i - 1].n - n->text.s;
+    if (all)
+        n->kind = N_SET;
+    return n;
+}
+
+/* sc_if - if/elif list then list [elif...] [else list] fi, after the if */
+static struct node_t *sc_if(struct parser_t *ps)
+{
+    struct node_t *n = sc_node(N_IF, sc_list(ps), NULL);
+
+    if (ps->err || !sc_expect(ps, "then"))
+        return NULL;
+    if ((n->b = sc_list(ps)), ps->err)
+        return NULL;
+    if (sc_is(ps, "elif")) {
+        sc_next(ps);
+        n->c = sc_if(ps);                   /* it takes the fi */
+        return ps->err ? NULL : n;
+    }
+    if (sc_is(ps, "else")) {
+        sc_next(ps);
+        if ((n->c = sc_list(ps)), ps->err)
+            return NULL;
+    }
+    return sc_expect(ps, "fi") ? n : NULL;
+}
+
+/* sc_while - while/until list do list done, after the keyword */
+static struct node_t *sc_while(struct parser_t *ps, int until)
+{
+    struct node_t *n = sc_node(N_WHILE, sc_list(ps), NULL);
+
+    n->flag = until;
+    if (ps->err || !sc_expect(ps, "do"))
+        return NULL;
+    if ((n->b = sc_list(ps)), ps->err)
+        return NULL;
+    return sc_expect(ps, "done") ? n : NULL;
+}
+
+/* sc_for - for name [in word...]; do list done, after the for */
+static struct node_t *sc_for(struct parser_t *ps)
+{
+    struct node_t *n = sc_node(N_FOR, NULL, NULL);
+    struct parser_t save;
+    int i;
+
+    if (ps->tok != T_WORD || var_name(ps->start) != (int)ps->len)
+        return sc_error(ps);
+    save = *ps;
+    sc_next(ps);
+    sc_skipnl(ps);
+    n->nwords = 1;
+    if (sc_is(ps, "in")) {
+        n->flag = 1;
+        for (sc_next(ps); ps->tok == T_WORD; sc_next(ps))
+            n->nwords++;
+    }
+    n->words = (struct span_t *)sc_alloc(n->nwords * sizeof(*n->words));
+    *ps = save;
+    for (i = 0; i < n->nwords; i++) {
+        n->words[i].s = ps->start;
+        n->words[i].n = ps->len;
+        sc_next(ps);
+        if (i == 0) {
+            sc_skipnl(ps);
+            if (n->flag)
+                sc_next(ps);                /* the in */
+        }
+    }
+    if (ps->tok == T_SEMI)
+        sc_next(ps);
+    sc_skipnl(ps);
+    if (!sc_expect(ps, "do"))
+        return NULL;
+    if ((n->b = sc_list(ps)), ps->err)
+        return NULL;
+    return sc_expect(ps, "done") ? n : NULL;
+}
+
+/* sc_command - One command, simple or compound */
+static struct node_t *sc_command(struct parser_t *ps)
+{
+    struct node_t *n;
+
+    if (ps->tok != T_WORD || sc_reserved(ps))
+        return sc_error(ps);
+    if (sc_is(ps, "if") || sc_is(ps, "while") || sc_is(ps, "until") || sc_is(ps, "for") ||
+        sc_is(ps, "{")) {
+        char k = ps->start[0];
+
+        sc_next(ps);
+        if (k == 'i')
+            n = sc_if(ps);
+        else if (k == 'w' || k == 'u')
+            n = sc_while(ps, k == 'u');
+        else if (k == 'f')
+            n = sc_for(ps);
+        else {
+            n = sc_list(ps);
+            if (!ps->err && !sc_expect(ps, "}"))
+                return NULL;
+            if (n == NULL)                  /* { } does nothing */
+                n = sc_node(N_SET, NULL, NULL);
+        }
+        if (n != NULL && ps->tok == T_WORD)  /* nothing may follow fi, done or } */
+            return sc_error(ps);
+        return n;
+    }
+
+    const char *name = ps->start;
+    size_t len = ps->len;
+    struct parser_t save = *ps;
+
+    sc_next(ps);
+    if (ps->tok == T_LPAR && var_name(name) == (int)len) {  /* name() command */
+        sc_next(ps);
+        if (ps->tok != T_RPAR)
+            return sc_error(ps);
+        sc_next(ps);
+        sc_skipnl(ps);
+        n = sc_node(N_FUNC, sc_command(ps), NULL);
+        if (ps->err)
+            return NULL;
+        n->words = (struct span_t *)sc_alloc(sizeof(*n->words));
+        n->words[0].s = name;
+        n->words[0].n = len;
+        n->nwords = 1;
+        return n;
+    }
+    *ps = save;
+    return sc_simple(ps);
+}
+
+/* sc_pipeline - [!] command */
+static struct node_t *sc_pipeline(struct parser_t *ps)
+{
+    if (sc_is(ps, "!")) {
+        sc_next(ps);
+        struct node_t *n = sc_pipeline(ps);
+        return n != NULL ? sc_node(N_NOT, n, NULL) : NULL;
+    }
+    return sc_command(ps);
+}
+
+/* sc_andor - command [&& command | || command]... */
+static struct node_t *sc_andor(struct parser_t *ps)
+{
+    struct node_t *n = sc_pipeline(ps);
+
+    while (n != NULL && (ps->tok == T_AND || ps->tok == T_OR)) {
+        int kind = ps->tok == T_AND ? N_AND : N_OR;
+        struct node_t *m;
+
+        sc_next(ps);
+        sc_skipnl(ps);
+        if ((m = sc_pipeline(ps)) == NULL)
+            return NULL;
+        n = sc_node(kind, n, m);
+    }
+    return n;
+}
+
+/* sc_list - Commands separated by ;, & or newlines, up to a reserved word */
+static struct node_t *sc_list(struct parser_t *ps)
+{
+    struct node_t *first = NULL, **tail = &first;
+
+    for (;;) {
+        sc_skipnl(ps);
+        if (ps->tok == T_EOF || ps->tok == T_RPAR || sc_reserved(ps))
+            return first;
+
+        struct node_t *n = sc_andor(ps);
+        if (n == NULL)
+            return NULL;
+        *tail = n;
+        tail = &n->next;
+        if (ps->tok == T_AMP) {
+            if (n->kind != N_CMD) {
+                printf("only a simple command can run in the background\n");
+                ps->err = 1;
+                return NULL;
+            }
+            n->flag = 1;
+        }
+        if (ps->tok == T_SEMI || ps->tok == T_AMP || ps->tok == T_NL)
+            sc_next(ps);
+        else if (ps->tok != T_EOF && !sc_reserved(ps))
+            return sc_error(ps);
+    }
+}
+
+
+/***********************************************
+ * Bytecode
+ **********************************************/
+
+enum {
+    OP_CMD,     /* run cmds[arg] */
+    OP_SET,     /* do the assignments cmds[arg] */
+    OP_JMP,     /* go to arg */
+    OP_JF,      /* go to arg if the status is not 0 */
+    OP_JT,      /* go to arg if it is */
+    OP_NOT,     /* negate the status */
+    OP_TRUE,    /* status 0 */
+    OP_FOR,     /* start a loop over the words of cmds[arg] */
+    OP_NEXT,    /* next word of the loop, or end it and go to arg */
+    OP_POP,     /* end arg loops (break, continue) */
+    OP_FUNC,    /* define the function cmds[arg] */
+    OP_RET,     /* return with the status in cmds[arg], or as it is (-1) */
+};
+
+struct insn_t {
+    int op;
+    int arg;
+};
+
+struct unit_t;
+
+struct cmd_t {              /* What an instruction works on */
+    char          **words;  /* split, not yet expanded */
+    int             nwords;
+    char           *text;   /* the source and a newline, for the job list */
+    int             bg;
+    struct unit_t  *fn;     /* OP_FUNC: the body */
+    int            *here;   /* its here-documents' bodies (heredoc.h) */
+    int             nhere;
+};
+
+struct unit_t {             /* A compiled script or function body */
+    struct insn_t  *code;
+    int             ncode, capcode;
+    struct cmd_t   *cmds;
+    int             ncmds, capcmds;
+    int             refs;
+};
+
+struct loop_t {             /* A loop being compiled */
+    int isfor;              /* has a word list on the run-time stack */
+    int cont;               /* where continue goes */
+    int brk;                /* breaks to patch, chained through their args */
+};
+
+struct compiler_t {
+    struct unit_t *u;
+    struct loop_t  loops[SC_MAXLOOPS];
+    int            nloops;
+};
+
+/* un_put - Drop a reference to a unit, freeing it with the last */
+static void un_put(struct unit_t *u)
+{
+    if (u == NULL || --u->refs > 0)
+        return;
+    for (int i = 0; i < u->ncmds; i++) {
+        for (int j = 0; j < u->cmds[i].nwords; j++)
+            free(u->cmds[i].words[j]);
+        free(u->cmds[i].words);
+        free(u->cmds[i].text);
+        for (int j = 0; j < u->cmds[i].nhere; j++)
+            if (u->cmds[i].here[j] >= 0)
+                close(u->cmds[i].here[j]);
+        free(u->cmds[i].here);
+        un_put(u->cmds[i].fn);
+    }
+    free(u->cmds);
+    free(u->code);
+    free(u);
+}
+
+/* co_emit - Append an instruction; returns its address */
+static int co_emit(struct compiler_t *co, int op, int arg)
+{
+    struct unit_t *u = co->u;
+
+    if (u->ncode == u->capcode) {
+        u->capcode = u->capcode ? 2 * u->capcode : 32;
+        if ((u->code = (struct insn_t *)realloc(u->code, u->capcode * sizeof(*u->code))) == NULL)
+            unix_error("realloc error");
+    }
+    u->code[u->ncode].op = op;
+    u->code[u->ncode].arg = arg;
+    return u->ncode++;
+}
+
+/* co_cmd - Add an operand with copies of the words; returns its index */
+static int co_cmd(struct compiler_t *co, struct span_t *words, int n, struct span_t *text)
+{
+    struct unit_t *u = co->u;
+    struct cmd_t *c;
+
+    if (u->ncmds == u->capcmds) {
+        u->capcmds = u->capcmds ? 2 * u->capcmds : 8;
+        if ((u->cmds = (struct cmd_t *)realloc(u->cmds, u->capcmds * sizeof(*u->cmds))) == NULL)
+            unix_error("realloc error");
+    }
+    c = &u->cmds[u->ncmds];
+    memset(c, 0, sizeof(*c));
+    if ((c->words = (char **)malloc((n + 1) * sizeof(char *))) == NULL)
+        unix_error("malloc error");
+    for (int i = 0; i < n; i++)
+        if ((c->words[i] = strndup(words[i].s, words[i].n)) == NULL)
+            unix_error("malloc error");
+    c->words[n] = NULL;
+    c->nwords = n;
+    if (text != NULL) {
+        if ((c->text = (char *)malloc(text->n + 2)) == NULL)
+            unix_error("malloc error");
+        memcpy(c->text, text->s, text->n);
+        strcpy(c->text + text->n, "\n");
+        if (strstr(c->text, "<<") != NULL) {   /* here-documents: expand_line does those */
+            for (int i = 0; i < n; i++)
+                free(c->words[i]);
+            c->nwords = 0;
+            if ((c->nhere = heredoc_count(c->text)) > 0 &&
+                (c->here = (int *)malloc(c->nhere * sizeof(int))) == NULL)
+                unix_error("malloc error");
+            for (int i = 0; i < c->nhere; i++)
+                c->here[i] = heredoc_take();    /* read with the script, in order */
+        }
+    }
+    return u->ncmds++;
+}
+
+/* co_patch - Point the chain of jumps that starts at i at to */
+static void co_patch(struct compiler_t *co, int i, int to)
+{
+    while (i >= 0) {
+        int next = co->u->code[i].arg;
+        co->u->code[i].arg = to;
+        i = next;
+    }
+}
+
+static struct unit_t *co_unit(struct node_t *n);
+static void co_list(struct compiler_t *co, struct node_t *n);
+
+/* co_jump - break or continue out of the n'th enclosing loop */
+static void co_jump(struct compiler_t *co, struct node_t *n, int brk)
+{
+    int levels = n->nwords > 1 ? atoi(n->words[1].s) : 1, pops = 0;
+    struct loop_t *l;
+
+    if (co->nloops == 0 || levels < 1) {    /* nothing to leave */
+        co_emit(co, OP_TRUE, 0);
+        return;
+    }
+    if (levels > co->nloops)
+        levels = co->nloops;
+    for (int i = co->nloops - levels + !brk; i < co->nloops; i++)
+        pops += co->loops[i].isfor;
+    if (pops > 0)
+        co_emit(co, OP_POP, pops);
+    l = &co->loops[co->nloops - levels];
+    if (brk)
+        l->brk = co_emit(co, OP_JMP, l->brk);
+    else
+        co_emit(co, OP_JMP, l->cont);
+}
+
+/* co_loop - Enter a loop whose continue goes to cont */
+static struct loop_t *co_loop(struct compiler_t *co, int isfor, int cont)
+{
+    struct loop_t *l = &co->loops[co->nloops++];
+
+    l->isfor = isfor;
+    l->cont = cont;
+    l->brk = -1;
+    return l;
+}
+
+/* co_node - Compile one command */
+static void co_node(struct compiler_t *co, struct node_t *n)
+{
+    int j, k, top;
+
+    switch (n->kind) {
+    case N_CMD:
+        if (n->words[0].n == 5 && (!memcmp(n->words[0].s, "break", 5))) {
+            co_jump(co, n, 1);
+            break;
+        }
+        if (n->words[0].n == 8 && !memcmp(n->words[0].s, "continue", 8)) {
+            co_jump(co, n, 0);
+            break;
+        }
+        if (n->words[0].n == 6 && !memcmp(n->words[0].s, "return", 6)) {
+            co_emit(co, OP_RET, n->nwords > 1 ? co_cmd(co, n->words + 1, 1, NULL) : -1);
+            break;
+        }
+        k = co_cmd(co, n->words, n->nwords, &n->text);
+        co->u->cmds[k].bg = n->flag;
+        co_emit(co, OP_CMD, k);
+        break;
+    case N_SET:
+        if (n->nwords == 0)
+            co_emit(co, OP_TRUE, 0);
+        else
+            co_emit(co, OP_SET, co_cmd(co, n->words, n->nwords, NULL));
+        break;
+    case N_AND:
+    case N_OR:
+        co_node(co, n->a);
+        j = co_emit(co, n->kind == N_AND ? OP_JF : OP_JT, -1);
+        co_node(co, n->b);
+        co->u->code[j].arg = co->u->ncode;
+        break;
+    case N_NOT:
+        co_node(co, n->a);
+        co_emit(co, OP_NOT, 0);
+        break;
+    case N_IF:
+        co_list(co, n->a);
+        j = co_emit(co, OP_JF, -1);
+        co_list(co, n->b);
+        k = co_emit(co, OP_JMP, -1);
+        co->u->code[j].arg = co->u->ncode;
+        if (n->c != NULL)
+            co_list(co, n->c);
+        else
+            co_emit(co, OP_TRUE, 0);
+        co->u->code[k].arg = co->u->ncode;
+        break;
+    case N_WHILE:
+        if (co->nloops == SC_MAXLOOPS) {
+            printf("loops nested too deep\n");
+            co_emit(co, OP_TRUE, 0);
+            break;
+        }
+        top = co->u->ncode;
+        co_list(co, n->a);
+        j = co_emit(co, n->flag ? OP_JT : OP_JF, -1);
+        co_loop(co, 0, top);
+        co_list(co, n->b);
+        co_emit(co, OP_JMP, top);
+        co->u->code[j].arg = co->u->ncode;
+        co_patch(co, co->loops[--co->nloops].brk, co->u->ncode);
+        co_emit(co, OP_TRUE, 0);
+        break;
+    case N_FOR:
+        if (co->nloops == SC_MAXLOOPS) {
+            printf("loops nested too deep\n");
+            co_emit(co, OP_TRUE, 0);
+            break;
+        }
+        k = co_cmd(co, n->words, n->nwords, NULL);
+        co->u->cmds[k].bg = n->flag;        /* has a list: else "$@" */
+        co_emit(co, OP_FOR, k);
+        top = co_emit(co, OP_NEXT, -1);
+        co_loop(co, 1, top);
+        co_list(co, n->b);
+        co_emit(co, OP_JMP, top);
+        co->u->code[top].arg = co->u->ncode;
+        co_patch(co, co->loops[--co->nloops].brk, co->u->ncode);
+        co_emit(co, OP_TRUE, 0);
+        break;
+    case N_FUNC:
+        k = co_cmd(co, n->words, 1, NULL);
+        co->u->cmds[k].fn = co_unit(n->a);
+        co_emit(co, OP_FUNC, k);
+        break;
+    }
+}
+
+/* co_list - Compile a list of commands */
+static void co_list(struct compiler_t *co, struct node_t *n)
+{
+    if (n == NULL)
+        co_emit(co, OP_TRUE, 0);
+    for ( ; n != NULL; n = n->next)
+        co_node(co, n);
+}
+
+/* co_unit - Compile a script or function body */
+static struct unit_t *co_unit(struct node_t *n)
+{
+    struct compiler_t co;
+
+    if ((co.u = (struct unit_t *)calloc(1, sizeof(*co.u))) == NULL)
+        unix_error("calloc error");
+    co.u->refs = 1;
+    co.nloops = 0;
+    co_list(&co, n);
+    return co.u;
+}
+
+
+/***********************************************
+ * Functions
+ **********************************************/
+
+struct func_t {
+    struct func_t *next;
+    struct unit_t *body;
+    char           name[1];
+};
+
+static struct func_t *funcs[SC_FSLOTS];
+static int            nfuncs;
+static int            calls;        /* nesting depth */
+
+/* fn_slot - The chain for name */
+static struct func_t **fn_slot(const char *name)
+{
+    unsigned h = 2166136261u;
+
+    for (const char *s = name; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return &funcs[h & (SC_FSLOTS - 1)];
+}
+
+/* fn_find - The function called name, or NULL */
+static struct func_t *fn_find(const char *name)
+{
+    struct func_t *f;
+
+    for (f = *fn_slot(name); f != NULL; f = f->next)
+        if (!strcmp(f->name, name))
+            return f;
+    return NULL;
+}
+
+/* fn_define - Make body the function called name */
+static void fn_define(const char *name, struct unit_t *body)
+{
+    struct func_t *f = fn_find(name);
+
+    if (f == NULL) {
+        struct func_t **slot = fn_slot(name);
+
+        if ((f = (struct func_t *)malloc(sizeof(*f) + strlen(name))) == NULL)
+            unix_error("malloc error");
+        strcpy(f->name, name);
+        f->body = NULL;
+        f->next = *slot;
+        *slot = f;
+        nfuncs++;
+    }
+    body->refs++;
+    un_put(f->body);
+    f->body = body;
+}
+
+
+/***********************************************
+ * The interpreter
+ **********************************************/
+
+struct iter_t {             /* A for loop running */
+    char  **words;          /* the list, in one block with its strings */
+    int     n, i;
+    char   *name;
+};
+
+/* vm_words - Copy an expanded list to a block of its own */
+static char **vm_words(char **argv, int n)
+{
+    size_t size = (n + 1) * sizeof(char *);
+    char **w, *s;
+
+    for (int i = 0; i < n; i++)
+        size += strlen(argv[i]) + 1;
+    if ((w = (char **)malloc(size)) == NULL)
+        unix_error("malloc error");
+    s = (char *)(w + n + 1);
+    for (int i = 0; i < n; i++) {
+        w[i] = strcpy(s, argv[i]);
+        s += strlen(s) + 1;
+    }
+    w[n] = NULL;
+    return w;
+}
+
+/* vm_set - Do name=value assignments */
+static void vm_set(struct cmd_t *c)
+{
+    for (int i = 0; i < c->nwords; i++) {
+        const char *w = c->words[i];
+        size_t n = strchr(w, '=') - w;
+        const char *v = expand_value(w + n + 1);
+
+        var_set(w, n, v, strlen(v));
+    }
+    var_status(0);
+}
+
+/* vm_run - Run a unit; returns the status of the last command */
+static int vm_run(struct unit_t *u)
+{
+    struct iter_t *it = NULL;
+    int nit = 0, capit = 0, pc = 0, st = var_last_status();
+    char **argv;
+
+    u->refs++;
+    while (pc < u->ncode && !interrupted) {
+        struct insn_t *in = &u->code[pc++];
+        struct cmd_t *c = in->arg >= 0 ? &u->cmds[in->arg] : NULL;
+        int bg, n;
+
+        switch (in->op) {
+        case OP_CMD:
+            if (c->nwords > 0) {
+                bg = c->bg;
+                n = expand_words(c->words, c->nwords, &argv);
+            } else {
+                heredoc_give(c->here, c->nhere);
+                bg = expand_line(c->text, &argv) || c->bg;
+                heredoc_give(NULL, 0);
+                n = argv[0] != NULL;
+            }
+            if (n == 0)
+                var_status(0);
+            else
+                eval_argv(argv, bg, c->text, expand_stdin());
+            st = var_last_status();
+            break;
+        case OP_SET:
+            vm_set(c);
+            st = 0;
+            break;
+        case OP_JMP:
+            pc = in->arg;
+            break;
+        case OP_JF:
+            if (st != 0)
+                pc = in->arg;
+            break;
+        case OP_JT:
+            if (st == 0)
+                pc = in->arg;
+            break;
+        case OP_NOT:
+            var_status(st = !st);
+            break;
+        case OP_TRUE:
+            var_status(st = 0);
+            break;
+        case OP_FOR:
+            if (nit == capit) {
+                capit = capit ? 2 * capit : 4;
+                if ((it = (struct iter_t *)realloc(it, capit * sizeof(*it))) == NULL)
+                    unix_error("realloc error");
+            }
+            if (c->bg)
+                n = expand_words(c->words + 1, c->nwords - 1, &argv);
+            else
+                for (argv = var_param_list(), n = 0; argv[n]; n++)
+                    ;
+            it[nit].words = vm_words(argv, n);
+            it[nit].n = n;
+            it[nit].i = 0;
+            it[nit].name = c->words[0];
+            nit++;
+            break;
+        case OP_NEXT:
+            if (it[nit - 1].i < it[nit - 1].n) {
+                struct iter_t *t = &it[nit - 1];
+                const char *w = t->words[t->i++];
+
+                var_set(t->name, strlen(t->name), w, strlen(w));
+                break;
+            }
+            free(it[--nit].words);
+            pc = in->arg;
+            break;
+        case OP_POP:
+            for (n = 0; n < in->arg; n++)
+                free(it[--nit].words);
+            break;
+        case OP_FUNC:
+            fn_define(c->words[0], c->fn);
+            var_status(st = 0);
+            break;
+        case OP_RET:
+            if (c != NULL)
+                var_status(st = atoi(expand_value(c->words[0])) & 0xff);
+            pc = u->ncode;
+            break;
+        }
+    }
+    while (nit > 0)
+        free(it[--nit].words);
+    free(it);
+    un_put(u);
+    if (interrupted)
+        var_status(st = 128 + SIGINT);
+    return st;
+}
+
+/* script_interrupt - ctrl-c, or a job killed by it (signal safe) */
+void script_interrupt(void)
+{
+    interrupted = 1;
+}
+
+/*
+ * script_call - If argv[0] is a function, run it with argv[1]... as
+ * its parameters and return its status; otherwise -1.
+ */
+int script_call(char **argv)
+{
+    struct func_t *f;
+    char **saved, **params;
+    int st;
+
+    if (nfuncs == 0 || (f = fn_find(argv[0])) == NULL)
+        return -1;
+    if (calls == SC_MAXCALLS) {
+        printf("%s: maximum function nesting level exceeded (%d)\n", argv[0], SC_MAXCALLS);
+        var_status(1);
+        return 1;
+    }
+    if (calls++ == 0)
+        interrupted = 0;
+    for (st = 1; argv[st]; st++)
+        ;
+    params = vm_words(argv + 1, st - 1);   /* argv goes with the next expansion */
+    saved = var_params(params);
+    st = vm_run(f->body);
+    var_params(saved);
+    free(params);
+    calls--;
+    return st;
+}
+
+
+/***********************************************
+ * Reading scripts
+ **********************************************/
+
+/*
+ * script_wants - Is cmdline a script rather than a plain command: does
+ * it start with a keyword, an assignment, a function definition or a
+ * comment, or have ;, && or || outside quotes?
+ */
+int script_wants(const char *cmdline)
+{
+    static const char *words[] = { "if", "while", "until", "for", "{", "!", "break",
+                                   "continue", "return" };
+    const char *p = cmdline + strspn(cmdline, " \t");
+    size_t n = strcspn(p, " \t\n;&()");
+
+    if (*p == '#')                          /* a comment */
+        return 1;
+    for (unsigned i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+        if (n == strlen(words[i]) && !memcmp(p, words[i], n))
+            return 1;
+    if ((n = var_name(p)) > 0 && (p[n] == '=' || p[n + strspn(p + n, " \t")] == '('))
+        return 1;
+    for ( ; *p; p++) {
+        if (*p == '\'' || *p == '"') {
+            const char *q = strchr(p + 1, *p);
+            if (q == NULL)
+                return 0;
+            p = q;
+        }
+        else if (*p == ';' || (p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|'))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * script_line - Parse, compile and run the script that starts with
+ * cmdline; with more, lines are read until it is complete.  Returns
+ * its status.
+ */
+int script_line(const char *cmdline, int more)
+{
+    struct parser_t ps;
+    struct node_t *tree;
+    struct unit_t *u;
+    char *text, line[MAXLINE];
+    size_t len = strlen(cmdline), cap = len + MAXLINE;
+    int st, bodies = 0;
+
+    if ((text = (char *)malloc(cap)) == NULL)
+        unix_error("malloc error");
+    memcpy(text, cmdline, len + 1);
+    TRACE_BEGIN("script");
+    for (;;) {
+        memset(&ps, 0, sizeof(ps));
+        ps.p = text;
+        sc_next(&ps);
+        tree = sc_list(&ps);
+        if (!ps.err && ps.tok != T_EOF)
+            sc_error(&ps);                  /* a stray ) */
+        if (!ps.more)
+            break;
+        sc_release();
+        if (!more || readcmd(line, MAXLINE) == NULL) {
+            printf("syntax error: unexpected end of file\n");
+            break;
+        }
+        if (heredoc_more(line) < 0)         /* its here-documents' bodies follow it */
+            bodies = -1;
+        size_t n = strlen(line);
+        if (len + n + 1 > cap) {
+            cap = 2 * (len + n + 1);
+            if ((text = (char *)realloc(text, cap)) == NULL)
+                unix_error("realloc error");
+        }
+        memcpy(text + len, line, n + 1);
+        len += n;
+    }
+    if (ps.err || bodies < 0) {             /* a body that couldn't be kept, as in main */
+        sc_release();
+        free(text);
+        var_status(st = ps.err ? 2 : 1);
+        TRACE_END("script");
+        return st;
+    }
+
+    u = co_unit(tree);
+    sc_release();
+    free(text);
+    if (calls == 0)
+        interrupted = 0;
+    st = vm_run(u);
+    un_put(u);
+    TRACE_END("script");
+    return st;
+}
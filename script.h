@@ -0,0 +1,39 @@
+//-*-c++-*-
+#ifndef _script_h_
+#define _script_h_
+
+/*
+ * Shell scripts: lists and control flow.
+ *
+ *     cmd ; cmd        cmd && cmd       cmd || cmd       ! cmd
+ *     cmd &            { list }         name=value ...   # comment
+ *     if list then list [elif list then list]... [else list] fi
+ *     while list do list done           until list do list done
+ *     for name [in word...] do list done
+ *     name() command   (then "name args" runs it, with $1... = args)
+ *     break [n]        continue [n]     return [n]
+ *
+ * A command line that starts with one of these words, or has ;, &&
+ * or ||, is read as a script: if it isn't complete, more lines are
+ * read until it is.  Other lines are run by eval as they always were.
+ *
+ * The script is parsed once into a tree, which is compiled to bytecode
+ * for a small interpreter: jumps for the control flow, and simple
+ * commands already split into words, so a loop body runs again without
+ * being tokenized again.  Only the words that have
+ * something to expand ($x, quotes, globs...) are expanded each time.
+ * Function bodies are compiled once, when defined, and kept.  So are
+ * the bodies of a script's here-documents, which follow the lines
+ * they are on; a command in a loop reads its body afresh each time.
+ *
+ * A function runs in the shell, with or without a trailing &.  The
+ * status of a loop is 0.  There are no pipes, subshells or case.
+ * ctrl-c stops the whole script, as does a job killed by SIGINT.
+ */
+
+int  script_wants(const char *cmdline);
+int  script_line(const char *cmdline, int more);
+int  script_call(char **argv);
+void script_interrupt(void);
+
+#endif
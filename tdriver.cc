@@ -0,0 +1,419 @@
+/*
+ * tdriver.c - Trace-driven shell driver
+ *
+ * usage: tdriver [-hvg] [-j <n>] [-T <secs>] -s <shell> [-a <args>]
+ *                [-t <trace>] [<trace> ...]
+ *
+ * A native replacement for sdriver.pl.  It reads the same trace files,
+ * runs the shell as a child with its stdin and stdout on pipes, sends
+ * it commands and signals as the trace directs, and prints the comment
+ * lines of the trace followed by everything the shell wrote.
+ *
+ * Driver commands (first word of a trace line):
+ *     TSTP           Send a SIGTSTP signal to the shell
+ *     INT            Send a SIGINT signal to the shell
+ *     QUIT           Send a SIGQUIT signal to the shell
+ *     KILL           Send a SIGKILL signal to the shell
+ *     CLOSE          Close the shell's stdin (sends EOF)
+ *     WAIT           Wait for the shell to terminate
+ *     SLEEP <n>      Sleep for <n> seconds; <n> may be fractional or
+ *                    carry an "ms" suffix (SLEEP 0.25, SLEEP 250ms)
+ *     WAITFOR <re>   Wait until the shell's output, from where the last
+ *                    WAITFOR matched, matches the regular expression
+ *                    <re> (ECMAScript syntax); fails after -T seconds,
+ *                    and then the rest of the trace is skipped and
+ *                    the shell killed, as it may never see its EOF
+ *
+ * Several trace files run in parallel (-j, default: all of them, since
+ * traces spend most of their time sleeping); their output is still
+ * printed in the order given.  The exit status
+ * is 1 if any WAITFOR timed out.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int    verbose;
+static int    grade;
+static double waitfor_timeout = 10.0;
+static std::string shellprog;
+static std::vector<std::string> shellargs;
+
+/* now - Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * One trace run: the shell child, its pipes, and everything it has
+ * written so far.
+ */
+struct Run {
+    std::string trace;      /* trace file name */
+    std::string out;        /* what this run prints */
+    std::string shellout;   /* shell output captured so far */
+    size_t cursor = 0;      /* where the next WAITFOR starts looking */
+    pid_t pid = -1;
+    int to = -1;            /* shell's stdin */
+    int from = -1;          /* shell's stdout */
+    int status = 0;         /* 1 if a WAITFOR timed out */
+    bool reaped = false;
+
+    void note(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    bool start();
+    bool pump(double deadline, bool once = false);
+    void waitshell();
+    void sendsig(int sig, const char *name);
+    void run();
+};
+
+/* note - Append a driver message (shown with -v) to the output */
+void Run::note(const char *fmt, ...)
+{
+    char buf[1024];
+    va_list ap;
+
+    if (!verbose)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    out += "tdriver: ";
+    out += buf;
+    out += "\n";
+}
+
+/* start - Fork the shell with its stdin and stdout on pipes */
+bool Run::start()
+{
+    int in[2], outp[2];
+
+    if (pipe2(in, O_CLOEXEC) < 0 || pipe2(outp, O_CLOEXEC) < 0) {
+        out += std::string("tdriver: pipe: ") + strerror(errno) + "\n";
+        return false;
+    }
+    std::vector<char *> argv;
+    argv.push_back((char *)shellprog.c_str());
+    for (auto &a : shellargs)
+        argv.push_back((char *)a.c_str());
+    argv.push_back(NULL);
+
+    if ((pid = fork()) == 0) {
+        dup2(in[0], 0);
+        dup2(outp[1], 1);
+        execv(argv[0], argv.data());
+        fprintf(stderr, "tdriver: %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    close(in[0]);
+    close(outp[1]);
+    to = in[1];
+    from = outp[0];
+    if (pid < 0) {
+        out += std::string("tdriver: fork: ") + strerror(errno) + "\n";
+        return false;
+    }
+    if (grade)
+        out += "pid=" + std::to_string(pid) + "\n";
+    return true;
+}
+
+/*
+ * pump - Collect shell output until the deadline passes.  A deadline
+ * of 0 takes only what is ready now and a negative one reads to end of
+ * file.  With once set, return as soon as some output arrives.
+ * Returns false once the shell's stdout is closed.
+ */
+bool Run::pump(double deadline, bool once)
+{
+    char buf[65536];
+
+    while (from >= 0) {
+        struct pollfd pfd = { from, POLLIN, 0 };
+        int timeout = deadline < 0 ? -1 : 0;
+
+        if (deadline > 0) {
+            double left = deadline - now();
+            if (left <= 0)
+                return true;
+            timeout = (int)(left * 1000) + 1;
+        }
+        int n = poll(&pfd, 1, timeout);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0)
+            return true;
+        ssize_t r = read(from, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            close(from);
+            from = -1;
+            break;
+        }
+        shellout.append(buf, r);
+        if (once)
+            return true;
+    }
+    return false;
+}
+
+/* waitshell - Reap the shell, collecting its output meanwhile */
+void Run::waitshell()
+{
+    int st;
+
+    while (!reaped) {
+        pid_t p = waitpid(pid, &st, WNOHANG);
+        if (p == pid || (p < 0 && errno == ECHILD)) {
+            reaped = true;
+            break;
+        }
+        if (!pump(now() + 0.005) && from < 0) {
+            waitpid(pid, &st, 0);
+            reaped = true;
+        }
+    }
+}
+
+/* sendsig - Send a signal to the shell */
+void Run::sendsig(int sig, const char *name)
+{
+    note("Sending %s signal to process %d", name, pid);
+    kill(pid, sig);
+}
+
+/* parse_secs - Parse a SLEEP argument: seconds, fractional, or "ms" */
+static double parse_secs(const std::string &arg)
+{
+    char *end;
+    double v = strtod(arg.c_str(), &end);
+
+    if (!strcmp(end, "ms"))
+        v /= 1000;
+    return v < 0 ? 0 : v;
+}
+
+/* run - Play the trace file against a fresh shell */
+void Run::run()
+{
+    std::ifstream in(trace);
+    std::string line;
+
+    if (!in) {
+        out += "tdriver: ERROR: " + trace + " not found\n";
+        status = 1;
+        return;
+    }
+    if (!start()) {
+        status = 1;
+        return;
+    }
+
+    while (status == 0 && std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string cmd, arg;
+
+        words >> cmd;
+        std::getline(words >> std::ws, arg);
+        pump(0);    /* keep the pipe from filling up */
+
+        if (line.compare(0, 1, "#") == 0) {
+            out += line + "\n";
+        }
+        else if (cmd.empty()) {
+            note("Ignoring blank line");
+        }
+        else if (cmd == "TSTP") {
+            sendsig(SIGTSTP, "SIGTSTP");
+        }
+        else if (cmd == "INT") {
+            sendsig(SIGINT, "SIGINT");
+        }
+        else if (cmd == "QUIT") {
+            sendsig(SIGQUIT, "SIGQUIT");
+        }
+        else if (cmd == "KILL") {
+            sendsig(SIGKILL, "SIGKILL");
+        }
+        else if (cmd == "CLOSE") {
+            note("Closing output end of pipe to child %d", pid);
+            if (to >= 0)
+                close(to);
+            to = -1;
+        }
+        else if (cmd == "WAIT") {
+            note("Waiting for child %d", pid);
+            waitshell();
+            note("Child %d reaped", pid);
+        }
+        else if (cmd == "SLEEP") {
+            double secs = parse_secs(arg);
+            note("Sleeping %g secs", secs);
+            pump(now() + secs);
+        }
+        else if (cmd == "WAITFOR") {
+            std::regex re;
+            try {
+                re = std::regex(arg);
+            } catch (std::regex_error &e) {
+                out += "tdriver: bad WAITFOR pattern: " + arg + "\n";
+                status = 1;
+                continue;
+            }
+            note("Waiting for /%s/", arg.c_str());
+            double deadline = now() + waitfor_timeout;
+            std::smatch m;
+            for (;;) {
+                if (std::regex_search(shellout.cbegin() + cursor, shellout.cend(), m, re)) {
+                    cursor += m.position(0) + m.length(0);
+                    break;
+                }
+                if (from < 0 || now() >= deadline) {
+                    out += "tdriver: WAITFOR timed out: " + arg + "\n";
+                    status = 1;
+                    break;
+                }
+                pump(deadline, true);
+            }
+        }
+        else {
+            note("Sending :%s: to child %d", line.c_str(), pid);
+            line += "\n";
+            if (to >= 0 && write(to, line.data(), line.size()) < 0)
+                note("write: %s", strerror(errno));
+        }
+    }
+
+    /* A shell that missed a WAITFOR may never read its EOF */
+    if (status != 0 && !reaped)
+        sendsig(SIGKILL, "SIGKILL");
+
+    /* Send EOF, collect everything the shell and its jobs write, reap */
+    if (to >= 0)
+        close(to);
+    to = -1;
+    note("Reading data from child %d", pid);
+    pump(-1);
+    waitshell();
+    note("Shell terminated");
+    out += shellout;
+}
+
+/*
+ * usage - print help message and terminate
+ */
+static void usage(const char *msg)
+{
+    if (msg)
+        fprintf(stderr, "%s\n", msg);
+    fprintf(stderr, "Usage: tdriver [-hvg] [-j <n>] [-T <secs>] -s <shell> [-a <args>] "
+                    "[-t <trace>] [<trace> ...]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h            Print this message\n");
+    fprintf(stderr, "  -v            Be more verbose\n");
+    fprintf(stderr, "  -t <trace>    Trace file (may be repeated)\n");
+    fprintf(stderr, "  -s <shell>    Shell program to test\n");
+    fprintf(stderr, "  -a <args>     Shell arguments\n");
+    fprintf(stderr, "  -g            Generate output for autograder\n");
+    fprintf(stderr, "  -j <n>        Run up to <n> traces at once (default all)\n");
+    fprintf(stderr, "  -T <secs>     WAITFOR timeout (default 10)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> traces;
+    int jobs = 0;
+    int c;
+
+    signal(SIGPIPE, SIG_IGN);
+    while ((c = getopt(argc, argv, "hvgt:s:a:j:T:")) != EOF) {
+        switch (c) {
+        case 'v': verbose = 1; break;
+        case 'g': grade = 1; break;
+        case 't': traces.push_back(optarg); break;
+        case 's': shellprog = optarg; break;
+        case 'a': {
+            std::istringstream words(optarg);
+            std::string w;
+            while (words >> w)
+                shellargs.push_back(w);
+            break;
+        }
+        case 'j': jobs = atoi(optarg); break;
+        case 'T': waitfor_timeout = atof(optarg); break;
+        default: usage(NULL);
+        }
+    }
+    for (int i = optind; i < argc; i++)
+        traces.push_back(argv[i]);
+    if (traces.empty())
+        usage("Missing required -t argument");
+    if (shellprog.empty())
+        usage("Missing required -s argument");
+    if (access(shellprog.c_str(), X_OK) < 0) {
+        fprintf(stderr, "tdriver: ERROR: %s not found or not executable\n", shellprog.c_str());
+        exit(1);
+    }
+    if (jobs < 1)
+        jobs = traces.size();
+
+    /* Workers take traces in order; output is printed in that order too */
+    std::vector<Run> runs(traces.size());
+    std::vector<bool> done(traces.size());
+    std::atomic<size_t> next(0);
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < traces.size(); i++)
+        runs[i].trace = traces[i];
+    for (int w = 0; w < jobs && w < (int)traces.size(); w++) {
+        workers.emplace_back([&] {
+            size_t i;
+            while ((i = next++) < runs.size()) {
+                runs[i].run();
+                std::lock_guard<std::mutex> lk(mu);
+                done[i] = true;
+                cv.notify_all();
+            }
+        });
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < runs.size(); i++) {
+        std::unique_lock<std::mutex> lk(mu);
+        cv.wait(lk, [&] { return (bool)done[i]; });
+        lk.unlock();
+        fputs(runs[i].out.c_str(), stdout);
+        fflush(stdout);
+        status |= runs[i].status;
+    }
+    for (auto &t : workers)
+        t.join();
+    return status;
+}
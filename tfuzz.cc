@@ -0,0 +1,570 @@
+/*
+ * tfuzz.c - Differential fuzzer for the tiny shell
+ *
+ * usage: tfuzz [-hv] [-n <cases>] [-S <seed>] [-j <n>] [-l <len>]
+ *              [-d <ms>] [-o <dir>] [-s <shell>] [-r <shell>]
+ *              [-D <driver>] [<trace> ...]
+ *
+ * Generates random but valid traces -- mixes of myspin, mysplit,
+ * mystop and myint in the foreground and background, with jobs, fg,
+ * bg, TSTP and INT -- and plays each one through tdriver against both
+ * the shell under test and the reference shell.  The two outputs are
+ * compared after every pid is replaced by "(PID)" and the reports of
+ * background jobs that signal themselves at once are dropped: tshref
+ * races on those (see normalize).
+ *
+ * A case that diverges is run again; if it diverges twice it is
+ * delta-minimized: units of the trace (a command with its echo line
+ * and the signals that follow it) are removed as long as the shells
+ * still disagree.  The original and minimal traces are saved in the
+ * output directory as fuzz-<seed>-<case>.txt and .min.txt, with both
+ * shells' outputs for the minimal one.  Traces named on the command
+ * line are compared (and minimized) instead of generated ones.
+ *
+ * Every trace ends by bringing each live job to the foreground and
+ * interrupting it, so runs stay short and job messages stay ordered.
+ * The exit status is 1 if any case diverged reproducibly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAXJOBS 16      /* the shells' job table size (jobs.h) */
+
+static std::string driver = "./tdriver";
+static std::string shell = "./tsh";
+static std::string refshell = "./tshref";
+static std::string outdir = ".";
+static int delay_ms = 100;  /* settle time before a signal */
+static int verbose = 0;
+
+static std::mutex outmu;    /* serializes reports from the workers */
+
+/* One line group of a trace: removed as a whole when minimizing */
+typedef std::vector<std::string> Unit;
+typedef std::vector<Unit> Trace;
+
+
+/***********************************************
+ * Trace generation
+ **********************************************/
+
+enum Kind { SPIN, STOP };   /* runs until signaled / exits when continued */
+
+struct MJob {               /* The generator's model of a live job */
+    int jid;
+    Kind kind;
+    bool stopped;
+};
+
+/*
+ * Model - Tracks the job list the way jobs.cc does, so that every
+ * fg/bg the generator writes names a job that really exists.
+ */
+struct Model {
+    std::vector<MJob> jobs;
+    int nextjid = 1;
+
+    int add(Kind kind, bool stopped) {
+        int jid = nextjid++;
+        if (nextjid > MAXJOBS)
+            nextjid = 1;
+        jobs.push_back({ jid, kind, stopped });
+        return jid;
+    }
+    void remove(int jid) {
+        int max = 0;
+        for (size_t i = 0; i < jobs.size(); i++)
+            if (jobs[i].jid == jid)
+                jobs.erase(jobs.begin() + i--);
+        for (auto &j : jobs)
+            max = j.jid > max ? j.jid : max;
+        nextjid = max + 1;
+    }
+    MJob *find(int jid) {
+        for (auto &j : jobs)
+            if (j.jid == jid)
+                return &j;
+        return NULL;
+    }
+};
+
+struct Gen {
+    std::mt19937 rng;
+    Model m;
+    Trace t;
+
+    int pick(int n) { return std::uniform_int_distribution<int>(0, n - 1)(rng); }
+    std::string ms(int n) { return "SLEEP " + std::to_string(n) + "ms"; }
+
+    /* cmd - Start a unit with the usual echo line and the command */
+    Unit &cmd(const std::string &line) {
+        std::string echo = line;
+        size_t amp = echo.rfind('&');
+        if (amp != std::string::npos)
+            echo.replace(amp, 1, "\\046");
+        t.push_back({ "/bin/echo -e tsh> " + echo, line });
+        return t.back();
+    }
+
+    /* signal_fg - Stop or interrupt the foreground job jid */
+    void signal_fg(Unit &u, int jid) {
+        u.push_back(ms(delay_ms));
+        if (pick(2)) {
+            u.push_back("TSTP");
+            m.find(jid)->stopped = true;
+        } else {
+            u.push_back("INT");
+            m.remove(jid);
+        }
+    }
+
+    void step();
+    Trace generate(int len);
+};
+
+/* step - Append one random unit */
+void Gen::step()
+{
+    bool full = m.jobs.size() >= 6;
+    int secs = 10;      /* outlives the trace; cleanup interrupts it */
+
+    switch (pick(12)) {
+    case 0:
+    case 1:
+        if (!full) {        /* foreground spinner, stopped or killed */
+            const char *prog = pick(3) ? "./myspin" : "./mysplit";
+            Unit &u = cmd(std::string(prog) + " " + std::to_string(secs));
+            signal_fg(u, m.add(SPIN, false));
+            break;
+        }
+        /* fall through */
+    case 2:
+        if (!full) {
+            const char *prog = pick(3) ? "./myspin" : "./mysplit";
+            cmd(std::string(prog) + " " + std::to_string(secs) + " &");
+            m.add(SPIN, false);
+            break;
+        }
+        /* fall through */
+    case 3:
+        if (!full) {        /* stops itself, in the foreground or not */
+            bool bg = pick(2);
+            Unit &u = cmd(bg ? "./mystop 0 &" : "./mystop 0");
+            if (bg)
+                u.push_back(ms(delay_ms));
+            m.add(STOP, true);
+            break;
+        }
+        /* fall through */
+    case 4: {               /* interrupts itself */
+        bool bg = pick(2);
+        Unit &u = cmd(bg ? "./myint 0 &" : "./myint 0");
+        if (bg)
+            u.push_back(ms(delay_ms));
+        m.remove(m.add(SPIN, false));   /* added and deleted again */
+        break;
+    }
+    case 5:
+    case 6:
+        cmd("jobs");
+        break;
+    case 7:
+    case 8:
+    case 9: {
+        if (m.jobs.empty()) {
+            cmd(pick(2) ? "fg %" + std::to_string(1 + pick(MAXJOBS)) : "bg");
+            break;
+        }
+        MJob j = m.jobs[pick(m.jobs.size())];
+        bool fg = pick(2);
+        Unit &u = cmd((fg ? "fg %" : "bg %") + std::to_string(j.jid));
+        if (j.kind == STOP && j.stopped) {
+            u.push_back(ms(delay_ms));      /* it exits once continued */
+            m.remove(j.jid);
+        } else if (fg) {
+            m.find(j.jid)->stopped = false;
+            signal_fg(u, j.jid);
+        } else {
+            m.find(j.jid)->stopped = false;
+        }
+        break;
+    }
+    case 10: {              /* malformed fg/bg arguments */
+        static const char *bad[] = { "fg", "bg", "fg abc", "bg 99999", "fg %99", "bg %0" };
+        cmd(bad[pick(6)]);
+        break;
+    }
+    case 11:                /* signals with no foreground job */
+        if (pick(2)) {
+            cmd("/bin/echo hello");
+        } else {
+            t.push_back({ ms(delay_ms / 2), pick(2) ? "INT" : "TSTP" });
+        }
+        break;
+    }
+}
+
+/* generate - A random trace of about len units */
+Trace Gen::generate(int len)
+{
+    t.clear();
+    for (int i = 0; i < len; i++)
+        step();
+
+    /* Finish every live job so the shells exit promptly */
+    while (!m.jobs.empty()) {
+        MJob j = m.jobs.back();
+        Unit &u = cmd("fg %" + std::to_string(j.jid));
+        if (j.kind == STOP) {
+            u.push_back(ms(delay_ms));
+        } else {
+            u.push_back(ms(delay_ms));
+            u.push_back("INT");
+        }
+        m.remove(j.jid);
+    }
+    cmd("jobs");
+    return t;
+}
+
+
+/***********************************************
+ * Running and comparing
+ **********************************************/
+
+/* write_trace - Save a trace file */
+static bool write_trace(const std::string &path, const Trace &t, const std::string &title)
+{
+    std::ofstream f(path);
+
+    f << "#\n# " << title << "\n#\n";
+    for (auto &u : t)
+        for (auto &line : u)
+            f << line << "\n";
+    return (bool)f;
+}
+
+/* read_trace - Load a trace file, one unit per command */
+static bool read_trace(const std::string &path, Trace &t)
+{
+    std::ifstream f(path);
+    std::string line;
+    static const std::regex directive("^(TSTP|INT|QUIT|KILL|SLEEP|WAITFOR)\\b.*");
+
+    if (!f)
+        return false;
+    t.clear();
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        /* echo lines open a unit; directives join the one before */
+        bool attach = !t.empty() && std::regex_match(line, directive);
+        bool after_echo = !t.empty() && t.back().size() == 1 &&
+                          t.back()[0].compare(0, 10, "/bin/echo ") == 0 &&
+                          line.compare(0, 10, "/bin/echo ") != 0;
+        if (attach || after_echo)
+            t.back().push_back(line);
+        else
+            t.push_back({ line });
+    }
+    return true;
+}
+
+/* drive - Run a trace through tdriver against prog; return its output */
+static std::string drive(const std::string &prog, const std::string &trace)
+{
+    int fds[2];
+    std::string out;
+    char buf[65536];
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return "tfuzz: pipe: " + std::string(strerror(errno)) + "\n";
+    if ((pid = fork()) == 0) {
+        dup2(fds[1], 1);
+        execl(driver.c_str(), driver.c_str(), "-s", prog.c_str(), "-a", "-p",
+              "-t", trace.c_str(), (char *)NULL);
+        fprintf(stderr, "tfuzz: %s: %s\n", driver.c_str(), strerror(errno));
+        _exit(127);
+    }
+    close(fds[1]);
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        if (n > 0)
+            out.append(buf, n);
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return out;
+}
+
+/*
+ * normalize - Replace pids so the two shells' outputs can be compared.
+ *
+ * A background job that stops or interrupts itself at once ("./mystop
+ * 0 &", "./myint 0 &") is reported by tshref's sigchld_handler into
+ * its stdout buffer, so the report comes out late, is lost, or runs
+ * before the "[N]" line, which then says "[0]".  tsh reports it from
+ * the main loop, in order, every time.  That is the intended behavior,
+ * so those jobs' reports are dropped and their jids ignored.
+ */
+static std::string normalize(const std::string &out)
+{
+    static const std::regex pid("\\(\\d+\\)");
+    static const std::regex self("^\\[\\d+\\] (\\(\\d+\\)) \\./my(stop|int) 0 &$");
+    static const std::regex report("^Job \\[\\d+\\] (\\(\\d+\\)) (stopped|terminated) by signal \\d+$");
+    std::istringstream in(out);
+    std::vector<std::string> lines, racy;
+    std::string line, res;
+    std::smatch m;
+
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+        if (std::regex_match(line, m, self))
+            racy.push_back(m[1]);
+    }
+    for (auto &l : lines) {
+        if (std::regex_match(l, m, report) &&
+            std::find(racy.begin(), racy.end(), m[1].str()) != racy.end())
+            continue;
+        if (std::regex_match(l, m, self))
+            l = "[J] " + l.substr(l.find(' ') + 1);
+        res += l + "\n";
+    }
+    if (!out.empty() && out.back() != '\n')
+        res.pop_back();
+    return std::regex_replace(res, pid, "(PID)");
+}
+
+/* Outputs of one differential run */
+struct Result {
+    std::string out, refout;
+    bool diverged() const { return out != refout; }
+};
+
+/* compare - Run a trace against both shells at once */
+static Result compare(const Trace &t, const std::string &path)
+{
+    Result r;
+
+    write_trace(path, t, "tfuzz scratch trace");
+    std::thread ref([&] { r.refout = normalize(drive(refshell, path)); });
+    r.out = normalize(drive(shell, path));
+    ref.join();
+    return r;
+}
+
+/* first_diff - Describe where two outputs first differ */
+static std::string first_diff(const std::string &a, const std::string &b)
+{
+    std::istringstream sa(a), sb(b);
+    std::string la, lb;
+    int line = 0;
+
+    for (;;) {
+        bool ea = !std::getline(sa, la), eb = !std::getline(sb, lb);
+        line++;
+        if (ea && eb)
+            return "outputs equal";
+        if (ea || eb || la != lb) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "line %d:\n", line);
+            return buf + ("  " + shell + ": " + (ea ? "<end of output>" : la) + "\n") +
+                   ("  " + refshell + ": " + (eb ? "<end of output>" : lb) + "\n");
+        }
+    }
+}
+
+/*
+ * minimize - Delta debugging over units: try dropping chunks of the
+ * trace, halving the chunk size whenever nothing can be dropped.
+ */
+static Trace minimize(Trace t, const std::string &scratch, Result &last)
+{
+    size_t chunk = t.size() / 2;
+
+    while (chunk >= 1) {
+        bool progress = false;
+        for (size_t at = 0; at < t.size(); ) {
+            Trace cand(t.begin(), t.begin() + at);
+            size_t end = at + chunk < t.size() ? at + chunk : t.size();
+            cand.insert(cand.end(), t.begin() + end, t.end());
+            Result r;
+            if (!cand.empty() && (r = compare(cand, scratch)).diverged()) {
+                t = cand;
+                last = r;
+                progress = true;
+                if (verbose) {
+                    std::lock_guard<std::mutex> lk(outmu);
+                    printf("tfuzz: %s: %zu units\n", scratch.c_str(), t.size());
+                }
+            } else {
+                at += chunk;
+            }
+        }
+        if (!progress)
+            chunk /= 2;
+    }
+    return t;
+}
+
+/* save - Write a file into the output directory */
+static void save(const std::string &name, const std::string &data)
+{
+    std::ofstream(outdir + "/" + name) << data;
+}
+
+/*
+ * check - Compare one trace; minimize and report it if the shells
+ * disagree.  Returns 0 if they agree, 1 on a reproducible divergence
+ * and 2 on one that didn't happen again.
+ */
+static int check(const Trace &t, const std::string &name, const std::string &scratch)
+{
+    Result r = compare(t, scratch);
+    if (!r.diverged())
+        return 0;
+    std::string diff = first_diff(r.out, r.refout);
+    if (!compare(t, scratch).diverged()) {
+        std::lock_guard<std::mutex> lk(outmu);
+        printf("tfuzz: %s: flaky divergence (not reproduced) at %s", name.c_str(), diff.c_str());
+        write_trace(outdir + "/" + name + ".flaky.txt", t, name + " (flaky)");
+        return 2;
+    }
+
+    Trace min = minimize(t, scratch, r);
+    write_trace(outdir + "/" + name + ".txt", t, name);
+    write_trace(outdir + "/" + name + ".min.txt", min, name + " (minimized)");
+    save(name + ".min.tsh.out", r.out);
+    save(name + ".min.ref.out", r.refout);
+
+    std::lock_guard<std::mutex> lk(outmu);
+    printf("tfuzz: %s: divergence, minimized from %zu to %zu units at %s",
+           name.c_str(), t.size(), min.size(), first_diff(r.out, r.refout).c_str());
+    printf("tfuzz: saved %s/%s.min.txt\n", outdir.c_str(), name.c_str());
+    fflush(stdout);
+    return 1;
+}
+
+/*
+ * usage - print help message and terminate
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tfuzz [-hv] [-n <cases>] [-S <seed>] [-j <n>] [-l <len>] [-d <ms>]\n"
+                    "             [-o <dir>] [-s <shell>] [-r <shell>] [-D <driver>] [<trace> ...]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h            Print this message\n");
+    fprintf(stderr, "  -v            Report each case and minimization step\n");
+    fprintf(stderr, "  -n <cases>    Random traces to run (default 100)\n");
+    fprintf(stderr, "  -S <seed>     Random seed (default: time); case i uses seed+i\n");
+    fprintf(stderr, "  -j <n>        Cases to run at once (default 2 per cpu)\n");
+    fprintf(stderr, "  -l <len>      Units per random trace (default 20)\n");
+    fprintf(stderr, "  -d <ms>       Delay before each signal (default 100)\n");
+    fprintf(stderr, "  -o <dir>      Where to save diverging traces (default .)\n");
+    fprintf(stderr, "  -s <shell>    Shell under test (default ./tsh)\n");
+    fprintf(stderr, "  -r <shell>    Reference shell (default ./tshref)\n");
+    fprintf(stderr, "  -D <driver>   Trace driver (default ./tdriver)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long seed = time(NULL);
+    int ncases = 100, len = 20, workers = 0, c;
+
+    signal(SIGPIPE, SIG_IGN);
+    while ((c = getopt(argc, argv, "hvn:S:j:l:d:o:s:r:D:")) != EOF) {
+        switch (c) {
+        case 'v': verbose = 1; break;
+        case 'n': ncases = atoi(optarg); break;
+        case 'S': seed = strtoul(optarg, NULL, 0); break;
+        case 'j': workers = atoi(optarg); break;
+        case 'l': len = atoi(optarg); break;
+        case 'd': delay_ms = atoi(optarg); break;
+        case 'o': outdir = optarg; break;
+        case 's': shell = optarg; break;
+        case 'r': refshell = optarg; break;
+        case 'D': driver = optarg; break;
+        default: usage();
+        }
+    }
+    for (auto &p : { driver, shell, refshell }) {
+        if (access(p.c_str(), X_OK) < 0) {
+            fprintf(stderr, "tfuzz: %s: %s\n", p.c_str(), strerror(errno));
+            exit(1);
+        }
+    }
+    std::vector<std::string> files(argv + optind, argv + argc);
+    if (!files.empty())
+        ncases = files.size();
+    if (workers < 1)
+        workers = 2 * std::thread::hardware_concurrency();
+    if (workers < 2)
+        workers = 2;
+    if (files.empty())
+        printf("tfuzz: %d cases, seed %lu, %s against %s\n",
+               ncases, seed, shell.c_str(), refshell.c_str());
+    fflush(stdout);
+
+    std::atomic<int> next(0), diverged(0), flaky(0);
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers && w < ncases; w++) {
+        pool.emplace_back([&, w] {
+            std::string scratch = "/tmp/tfuzz." + std::to_string(getpid()) +
+                                  "." + std::to_string(w) + ".txt";
+            int i;
+            while ((i = next++) < ncases) {
+                Trace t;
+                std::string name;
+                if (!files.empty()) {
+                    name = files[i].substr(files[i].rfind('/') + 1);
+                    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0)
+                        name.resize(name.size() - 4);
+                    if (!read_trace(files[i], t)) {
+                        std::lock_guard<std::mutex> lk(outmu);
+                        fprintf(stderr, "tfuzz: %s: %s\n", files[i].c_str(), strerror(errno));
+                        continue;
+                    }
+                } else {
+                    Gen g;
+                    g.rng.seed(seed + i);
+                    t = g.generate(len);
+                    name = "fuzz-" + std::to_string(seed) + "-" + std::to_string(i);
+                }
+                int st = check(t, name, scratch);
+                diverged += st == 1;
+                flaky += st == 2;
+                if (verbose && st == 0) {
+                    std::lock_guard<std::mutex> lk(outmu);
+                    printf("tfuzz: %s: ok (%zu units)\n", name.c_str(), t.size());
+                    fflush(stdout);
+                }
+            }
+            unlink(scratch.c_str());
+        });
+    }
+    for (auto &t : pool)
+        t.join();
+
+    printf("tfuzz: %d cases, %d diverged, %d flaky\n", ncases, (int)diverged, (int)flaky);
+    return diverged > 0;
+}
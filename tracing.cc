@@ -0,0 +1,132 @@
+#include "tracing.h"
+
+#ifdef TSH_TRACE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+/***********************************************
+ * Lock-free trace ring buffer
+ **********************************************/
+
+#define TRACE_EVENTS 65536   /* ring size, must be a power of 2 */
+
+struct tevent_t {           /* One trace event */
+    uint64_t    seq;        /* slot index + 1, written last; 0 = being written */
+    uint64_t    tsc;        /* timestamp counter */
+    const char *name;       /* static string */
+    long        arg;
+    char        ph;         /* Chrome trace phase: B, E or i */
+    char        track;      /* TRACE_MAIN or TRACE_SIGNAL */
+};
+
+static struct tevent_t ring[TRACE_EVENTS];
+static uint64_t        head;           /* next slot to claim */
+static uint64_t        tsc0;           /* calibration point taken by */
+static int64_t         ns0;            /*   the first event */
+
+/* trace_tsc - Read the timestamp counter */
+static inline uint64_t trace_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* trace_ns - Monotonic clock in nanoseconds */
+static int64_t trace_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * trace_event - Append an event to the ring.  Slots are claimed with
+ * an atomic add, so a signal handler can trace while the main loop is
+ * in the middle of writing its own event.  Old events are overwritten.
+ */
+void trace_event(char ph, const char *name, long arg, int track)
+{
+    uint64_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    struct tevent_t *e = &ring[idx & (TRACE_EVENTS - 1)];
+
+    if (idx == 0) {
+        tsc0 = trace_tsc();
+        ns0 = trace_ns();
+    }
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    e->tsc = trace_tsc();
+    e->name = name;
+    e->arg = arg;
+    e->ph = ph;
+    e->track = track;
+    __atomic_store_n(&e->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * trace_dump - Write the events still in the ring to path as Chrome
+ * trace JSON.  Timestamps are converted from TSC ticks to microseconds
+ * using the clock rate seen since the first event.
+ */
+int trace_dump(const char *path)
+{
+    uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t start = end > TRACE_EVENTS ? end - TRACE_EVENTS : 0;
+    uint64_t i, n = 0;
+    double   ticks_per_us;
+    int64_t  ns = trace_ns();
+    FILE    *fp;
+
+    if (end == 0) {
+        printf("trace: no events\n");
+        return 0;
+    }
+    if ((fp = fopen(path, "w")) == NULL) {
+        printf("trace: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    ticks_per_us = ns > ns0 ? (double)(trace_tsc() - tsc0) * 1000.0 / (ns - ns0) : 1.0;
+    if (ticks_per_us <= 0)
+        ticks_per_us = 1.0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"main\"}},\n", getpid(), TRACE_MAIN);
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"signal\"}}", getpid(), TRACE_SIGNAL);
+    for (i = start; i < end; i++) {
+        struct tevent_t *e = &ring[i & (TRACE_EVENTS - 1)];
+
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != i + 1)
+            continue;   /* overwritten or still being written */
+        fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d",
+                e->name, e->ph, (double)(int64_t)(e->tsc - tsc0) / ticks_per_us,
+                getpid(), e->track);
+        if (e->ph == 'i')
+            fprintf(fp, ",\"s\":\"t\",\"args\":{\"arg\":%ld}", e->arg);
+        fprintf(fp, "}");
+        n++;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    printf("trace: %lu events written to %s\n", (unsigned long)n, path);
+    return 0;
+}
+
+#endif /* TSH_TRACE */
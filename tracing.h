@@ -0,0 +1,42 @@
+//-*-c++-*-
+#ifndef _tracing_h_
+#define _tracing_h_
+
+/*
+ * Event tracing for the shell's hot paths.  Build with "make TRACE=1"
+ * to define TSH_TRACE; otherwise every TRACE_* macro expands to
+ * nothing and the tracing code is not compiled at all.
+ *
+ * Events go into a lock-free ring buffer stamped with the TSC and are
+ * written out in Chrome trace (Perfetto) JSON by the "trace" builtin.
+ * Events from the SIGCHLD handler use their own track so they nest
+ * correctly when the handler interrupts the main loop.
+ */
+
+#define TRACE_MAIN   1   /* track for the main loop */
+#define TRACE_SIGNAL 2   /* track for signal handlers */
+
+#ifdef TSH_TRACE
+
+void trace_event(char ph, const char *name, long arg, int track);
+int  trace_dump(const char *path);
+
+#define TRACE_BEGIN(name)          trace_event('B', name, 0, TRACE_MAIN)
+#define TRACE_END(name)            trace_event('E', name, 0, TRACE_MAIN)
+#define TRACE_INSTANT(name, arg)   trace_event('i', name, arg, TRACE_MAIN)
+#define TRACE_SIG_BEGIN(name)      trace_event('B', name, 0, TRACE_SIGNAL)
+#define TRACE_SIG_END(name)        trace_event('E', name, 0, TRACE_SIGNAL)
+#define TRACE_SIG_INSTANT(name, arg) trace_event('i', name, arg, TRACE_SIGNAL)
+
+#else
+
+#define TRACE_BEGIN(name)          ((void)0)
+#define TRACE_END(name)            ((void)0)
+#define TRACE_INSTANT(name, arg)   ((void)0)
+#define TRACE_SIG_BEGIN(name)      ((void)0)
+#define TRACE_SIG_END(name)        ((void)0)
+#define TRACE_SIG_INSTANT(name, arg) ((void)0)
+
+#endif
+
+#endif
@@ -4,8 +4,6 @@
 // Nathan Bellowe 102343874 and Sarah Niemeyer 100027519
 //              34126 * 2999                  59083 * 1693
 
-using namespace std;
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,11 +13,34 @@ using namespace std;
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <errno.h>
-#include <string>
+#include <sys/resource.h>
+#include <stdio_ext.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <time.h>
 
 #include "globals.h"
 #include "jobs.h"
 #include "helper-routines.h"
+#include "tsh.h"
+#include "journal.h"
+#include "tracing.h"
+#include "evloop.h"
+#include "input.h"
+#include "metrics.h"
+#include "control.h"
+#include "history.h"
+#include "lineedit.h"
+#include "pathcache.h"
+#include "tty.h"
+#include "builtins.h"
+#include "utils.h"
+#include "expand.h"
+#include "heredoc.h"
+#include "vars.h"
+#include "script.h"
+#include "capture.h"
+#include "wildcard.h"
 
 static char prompt[] = "tsh> ";
 int         verbose  = 0;
@@ -28,19 +49,32 @@ int         verbose  = 0;
 // You need to implement the functions eval, builtin_cmd, do_bgfg,
 // waitfg, sigchld_handler, sigstp_handler, sigint_handler
 //
-// The code below provides the "prototypes" for those functions
-// so that earlier code can refer to them. You need to fill in the
-// function bodies below.
+// The "prototypes" for the shell routines are in tsh.h so that other
+// modules can call them; the signal handlers are declared below.
 //
 
-void eval(char *cmdline);
-int builtin_cmd(char **argv);
-void do_bgfg(char **argv);
-void waitfg(pid_t pid);
-
 void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
 void sigint_handler(int sig);
+static void reap_children(void);
+static void child_ready(int fd, unsigned int events, void *arg);
+static void waitcont(pid_t pid);
+
+static volatile sig_atomic_t child_pending; // SIGCHLD seen, not yet reaped
+static volatile sig_atomic_t wait_interrupted; // ctrl-c during the wait builtin
+static int chldpipe[2];                     // SIGCHLD wakes the event loop through this
+static pid_t last_stopped;                  // last job the reaper saw stop
+
+//
+// sync_events - Reap whatever the SIGCHLD handler has flagged, then
+//     bring the control clients up to date. Runs
+//     whenever the event loop wakes.
+//
+static void sync_events(void)
+{
+    reap_children();
+    control_poll();
+}
 
 //
 // main - The shell's main routine
@@ -48,6 +82,10 @@ void sigint_handler(int sig);
 int main(int argc, char **argv)
 {
     int emit_prompt = 1; // emit prompt (default)
+    char *journal = NULL; // job journal file (-j)
+    char *msock = NULL;   // metrics socket (-m)
+    char *csock = NULL;   // control socket (-c)
+    char *hfile = NULL;   // history file (-H)
 
     //
     // Redirect stderr to stdout (so that driver will get all output
@@ -57,7 +95,7 @@ int main(int argc, char **argv)
 
     /* Parse the command line */
     char c;
-    while ((c = getopt(argc, argv, "hvp")) != EOF)
+    while ((c = getopt(argc, argv, "hvpuClLj:m:c:H:o:O:w:")) != EOF)
     {
         switch (c)
         {
@@ -73,6 +111,49 @@ int main(int argc, char **argv)
             emit_prompt = 0; // handy for automatic testing
             break;
 
+        case 'u':            // run echo, test, sleep... in the shell
+            builtin_utils(1);
+            break;
+
+        case 'C':            // parse every line, without the parse cache
+            expand_cache(0);
+            break;
+
+        case 'j':            // keep a journal of job events
+            journal = optarg;
+            break;
+
+        case 'm':            // serve metrics on a unix socket
+            msock = optarg;
+            break;
+
+        case 'c':            // accept remote commands on a unix socket
+            csock = optarg;
+            break;
+
+        case 'H':            // keep command history in this file
+            hfile = optarg;
+            break;
+
+        case 'o':            // capture background jobs' output
+            if (capture_setup(optarg) < 0)
+                usage();
+            break;
+
+        case 'l':            // background jobs' output by whole lines
+        case 'L':            // each tagged with its job ID
+            capture_lines(c == 'L');
+            break;
+
+        case 'O':            // and keep all of it in this directory
+            if (capture_spill(optarg) < 0)
+                exit(1);
+            break;
+
+        case 'w':            // threads for a ** walk
+            wildcard_walkers(atoi(optarg));
+            break;
+
         default:
             usage();
         }
@@ -87,7 +168,7 @@ int main(int argc, char **argv)
     //
     Signal(SIGINT, sigint_handler);   // ctrl-c
     Signal(SIGTSTP, sigtstp_handler); // ctrl-z
-    Signal(SIGCHLD, sigchld_handler); // Terminated or stopped child
+    // SIGCHLD: launch installs sigchld_handler before the first fork
 
     //
     // This one provides a clean way to kill the shell
@@ -96,9 +177,43 @@ int main(int argc, char **argv)
     Signal(SIGQUIT, sigquit_handler); //ctrl-d, kills shell and all its children
 
     //
-    // Initialize the job list
+    // On a terminal, foreground jobs get the terminal and the kernel
+    // delivers ctrl-c/ctrl-z to them directly
+    //
+    tty_init();
+
+    //
+    // stdout gets a static buffer, so that the first printf doesn't
+    // malloc one and fstat stdout to choose its size
+    //
+    static char obuf[BUFSIZ];
+    setvbuf(stdout, obuf, isatty(1) ? _IOLBF : _IOFBF, sizeof(obuf));
+
+    //
+    // The job list is allocated when the first job starts (jobtable)
     //
-    initjobs(jobs);
+    if (journal)
+        journal_open(journal);
+    if (msock)
+        metrics_listen(msock);
+    if (csock)
+        control_listen(csock);
+    evloop_on_wake(sync_events);
+
+    //
+    // Interactive shells keep history in ~/.tsh_history by default;
+    // with -p (the test driver) only if -H asks for it
+    //
+    char hdefault[MAXLINE];
+    if (hfile == NULL && emit_prompt && getenv("HOME"))
+    {
+        snprintf(hdefault, sizeof(hdefault), "%s/.tsh_history", getenv("HOME"));
+        hfile = hdefault;
+    }
+    if (hfile)
+        history_open(hfile);
+    if (emit_prompt)
+        lineedit_open(prompt);   // only if stdin is a terminal
 
     //
     // Execute the shell's read/eval loop
@@ -108,6 +223,7 @@ int main(int argc, char **argv)
         //
         // Read command line
         //
+        TRACE_INSTANT("prompt", 0);
         if (emit_prompt)
         {
             printf("%s", prompt); //tsh>
@@ -116,23 +232,38 @@ int main(int argc, char **argv)
 
         char cmdline[MAXLINE];
 
-        if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-        {
-            app_error("fgets error");
-        }
         //
         // End of file? (did user type ctrl-d?)
         //
-        if (feof(stdin))
+        if (readcmd(cmdline, MAXLINE) == NULL)
         {
+            if (readcmd_error())
+                app_error("read error");
             fflush(stdout);
             exit(0);
         }
 
         //
-        // Evaluate command line
+        // Expand !-events and remember the line
         //
-        eval(cmdline);
+        if (history_expand(cmdline, MAXLINE) < 0)
+            continue;
+        history_add(cmdline);
+
+        //
+        // Read the bodies of any here-documents
+        //
+        if (heredoc_read(cmdline) < 0)
+            continue;
+
+        //
+        // Evaluate command line: a script, or one command
+        //
+        if (script_wants(cmdline))
+            script_line(cmdline, 1);
+        else
+            eval(cmdline);
+        sync_events();
         fflush(stdout);
         fflush(stdout);
     }
@@ -157,74 +288,230 @@ void eval(char *cmdline)
 {
     /* Parse command line */
     //
-    // The 'argv' vector is filled in by the parseline
-    // routine below. It provides the arguments needed
+    // The 'argv' vector is filled in by the expand_line
+    // routine below (expand.h), which runs any command
+    // substitutions. It provides the arguments needed
     // for the execve() routine, which you'll need to
     // use below to launch a process.
     //
-    char  *argv[MAXARGS];
-    pid_t pid;
+    char  **argv;
     //
     // The 'bg' variable is TRUE if the job should run
     // in background mode or FALSE if it should run in FG
     //
-    int bg = parseline(cmdline, argv);
+    TRACE_BEGIN("eval");
+    int bg = expand_line(cmdline, &argv);
 
-    if (argv[0] == NULL)
+    if (argv[0] != NULL)    /* ignore empty lines */
+        eval_argv(argv, bg, cmdline, expand_stdin());
+    TRACE_END("eval");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// eval_argv - Run the expanded command argv, in the background if bg:
+//     a function (script.h), a builtin, or a program launched as a
+//     job with infd (-1 for none) as its stdin. cmdline is what the
+//     job list shows. Returns the status, which is also $? now. The
+//     <(...) and >(...) of the expansion only run with a job.
+//
+int eval_argv(char **argv, int bg, char *cmdline, int infd)
+{
+    pid_t pid;
+    int status;
+
+    if ((status = script_call(argv)) >= 0) // a function
     {
-        return;   /* ignore empty lines */
+        expand_psubs_drop();
+        return status;
     }
 
-    if (builtin_cmd(argv)) // Handle if the first arg is quit/fg/bg/jobs
-        return;
+    if (builtin_cmd(argv, bg)) // Handle if the first arg is quit/fg/bg/jobs/...
+    {
+        expand_psubs_drop();
+        return var_last_status();
+    }
 
-    if( access( argv[0], F_OK ) == -1 ){ //if the file in arg[0] doesn't exists
-        printf("%s: Command not found\n", argv[0]);
-        return;
+    if (builtin_find(argv[0]) == NULL)             //a builtin here runs as a job
+    {
+        argv[0] = (char *)pathcache_resolve(argv[0]); //bare names are looked up on PATH
+        if( access( argv[0], F_OK ) == -1 ){ //if the file in arg[0] doesn't exists
+            printf("%s: Command not found\n", argv[0]);
+            expand_psubs_drop();
+            var_status(127);
+            return 127;
+        }
     }
 
-    sigset_t mask;
+    //if the first word is not a builtin command, it must be a program.
+    fflush(stdout);                             //a script's earlier output goes first
+    if ((pid = launch(argv, (bg ? BG : FG), cmdline, infd)) <= 0)
+    {
+        if (pid < 0)
+            printf("Fork error: %s\n", strerror(errno));
+        var_status(126);
+        return 126;
+    }
+    if (!bg)                                    //If its a foreground task
+        waitfg(pid);                            //Foreground tasks need to wait until they are finished.
+    else
+    {
+        printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
+        var_status(0);
+    }
+    return var_last_status();                   //the reaper set it for a foreground job
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// child_signals - In a new child of the shell: put back the default
+//     dispositions of the signals the shell catches or ignores. An
+//     exec resets the caught ones, but SIGTTIN and SIGTTOU stay
+//     ignored across it, and a child that never execs keeps them all.
+//
+void child_signals(void)
+{
+    Signal(SIGINT, SIG_DFL);
+    Signal(SIGTSTP, SIG_DFL);
+    Signal(SIGTTIN, SIG_DFL);
+    Signal(SIGTTOU, SIG_DFL);
+    Signal(SIGCHLD, SIG_DFL);
+    Signal(SIGQUIT, SIG_DFL);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// run_builtin - In a new child: if argv[0] is a builtin, run it as the
+//     whole job and exit with its status. The job gets the signal
+//     dispositions an exec would have given it, and none of the
+//     shell's unwritten output.
+//
+static void run_builtin(char **argv)
+{
+    const struct builtin_t *b = builtin_find(argv[0]);
+
+    if (b == NULL)
+        return;
+    __fpurge(stdout);
+    child_signals();
+    int status = b->fn(argv);
+    fflush(stdout);
+    _exit(status);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// launch - Fork a child that runs argv in its own process group and
+//     add it to the job list with the given state. Its stdin is infd
+//     if that isn't -1, and the commands of the line's <(...) and
+//     >(...) join its group, on the job record. With tsh -o, -l or
+//     -L, a background job writes into a capture pipe. Returns the child's
+//     pid, -1 with errno set if fork failed, or 0 if the job list was
+//     full (addjob says so), when the child is killed and reaped at
+//     once and never becomes a job. The caller's signal
+//     mask is restored on return, so this is safe to call from event
+//     loop handlers while waitfg has SIGCHLD blocked. The SIGCHLD
+//     handler and its wakeup pipe are set up by the first call,
+//     keeping them out of startup.
+//
+pid_t launch(char **argv, int state, char *cmdline, int infd)
+{
+    static int reaping = 0;
+    sigset_t mask, prev;
+    pid_t pid, subs[MAXPSUBS];
+    int n, ofd = state == BG ? capture_start() : -1;
+
+    if (!reaping)                    //no children before the first one,
+    {                                //so nothing to reap until now
+        if (pipe2(chldpipe, O_NONBLOCK | O_CLOEXEC) < 0)
+            unix_error("pipe error");
+        evloop_add(chldpipe[0], EPOLLIN, child_ready, NULL);
+        Signal(SIGCHLD, sigchld_handler);
+        reaping = 1;
+    }
     Sigemptyset(&mask);              //mask sigchild signal until after job is
     Sigaddset(&mask, SIGCHLD);       //added so as to not delete non-existent
-    Sigprocmask(SIG_BLOCK, &mask, 0);
+    Sigaddset(&mask, SIGINT);        //and ctrl-c/ctrl-z, so that they reach
+    Sigaddset(&mask, SIGTSTP);       //the job once it is one
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
 
-    //if the first word is not a builtin command, it must be a program.
-    if ((pid = Fork()) == 0)                    //Therefore, fork a child program.
+    if ((pid = fork()) == 0)                    //Therefore, fork a child program.
     {                                           // Fork() returns 0 and enters this block if it is the child.
+        child_signals();                        //a ctrl-c from now on is the job's
         Sigprocmask(SIG_UNBLOCK, &mask, 0);     //unblock in child (but not parent until job is added)
         setpgid(0, 0);                          // assign to new pgid so Signals don't kill shell?
         //Sarah I don't understand this pgid. Lets talk about it before the meeting.
+        tty_child(getpid(), state == FG);       //take the terminal if we're in the foreground
+        if (infd >= 0)
+            dup2(infd, 0);                      //a here-document for input
+        if (ofd >= 0)
+        {
+            dup2(ofd, 1);                       //output into the capture pipe
+            dup2(ofd, 2);
+        }
+        expand_psubs_child();                   //keep the /dev/fd/N of <(...) open
+        run_builtin(argv);                      //returns only if argv[0] isn't one
         Execve(argv[0], argv, NULL);
-        return;                                 //don't want child process becoming a shell! :)
     }
-    addjob(jobs, pid, (bg ? BG : FG), cmdline); //Add to jobs as BG state
-    Sigprocmask(SIG_UNBLOCK, &mask, 0);         //after job is added unblock SIGCHLD
-    if (!bg)                                    //If its a foreground task
-        waitfg(pid);                            //Foreground tasks need to wait until they are finished.
-    else
-        printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
+    if (pid < 0)                                //out of processes: count it and carry on
+    {
+        int err = errno;
+        expand_psubs_drop();
+        capture_job(ofd, -1, 0);
+        metrics_note_fork_failure();
+        Sigprocmask(SIG_SETMASK, &prev, 0);
+        errno = err;
+        return -1;
+    }
+    setpgid(pid, pid);                          //also in the parent, so the group exists before we signal it
+    if (!addjob(jobs, pid, state, cmdline))     //Add to jobs; if the table is full,
+    {                                           //the child goes before it gets far
+        kill(-pid, SIGKILL);
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+        if (state == FG)
+            tty_reclaim(pid);                   //it may have taken the terminal
+        expand_psubs_drop();
+        capture_job(ofd, -1, 0);
+        Sigprocmask(SIG_SETMASK, &prev, 0);
+        return 0;
+    }
+    metrics_note_spawn();
+    journal_add(getjobpid(jobs, pid));
+    capture_job(ofd, pid, pid2jid(pid));        //drained by the event loop from now on
+    n = expand_psubs_start(pid, subs);          //now the group exists for <(...) to join
+    for (int i = 0; i < n; i++)
+    {
+        addjobsub(getjobpid(jobs, pid), subs[i]);
+        metrics_note_spawn();
+    }
+    if (state == FG)
+        tty_give(getjobpid(jobs, pid));         //hand it the terminal (no-op without one)
+    TRACE_INSTANT("fork", pid);
+    Sigprocmask(SIG_SETMASK, &prev, 0);         //after job is added unblock SIGCHLD
+    return pid;
 }
 
 
 /////////////////////////////////////////////////////////////////////////////
 //
 // builtin_cmd - If the user has typed a built-in command then execute
-// it immediately. The command name would be in argv[0] and
-// is ia C string. We've cast this to a C++ string type to simplify
-// string comparisons; however, the do_bgfg routine will need
-// to use the argv array as well to look for a job number.
+// it immediately. The command name is the C string in argv[0]; it is
+// looked up in the builtin table (builtins.h), which hands the whole
+// argv to the builtin. A builtin that may run in the background is
+// left to launch when the line ends in &, and a BI_JOB one always is.
 //
-int builtin_cmd(char **argv)
+int builtin_cmd(char **argv, int bg)
 {
-    if (!strcmp(argv[0], "quit"))                              // if the input is 'quit'
-        exit(0);                                               //exit shell
-    else if (!strcmp(argv[0], "jobs"))                         // if its jobs
-        listjobs(jobs);                                        //list running jobs.
-    else if (!strcmp(argv[0], "fg") || !strcmp(argv[0], "bg")) //if its 'fg' or 'bg'
-        do_bgfg(argv);
-    else
-        return 0;/* not a builtin command */
+    const struct builtin_t *b = builtin_find(argv[0]);
 
+    if (b == NULL || (b->flags & BI_JOB) || (bg && (b->flags & BI_BG)))
+        return 0; /* not a builtin command, or one to run as a job */
+    var_status(b->fn(argv));
     return 1;
 }
 
@@ -268,17 +555,29 @@ void do_bgfg(char **argv)
         printf("%s: argument must be a PID or %%jobid\n", argv[0]);
         return;
     }
+    TRACE_BEGIN("do_bgfg");
 
     //BEGIN OUR CODE
 
     pid_t pid = jobp->pid;
-    jobp->state = !strcmp(argv[0], "fg") ? FG : BG;
-    //if the job has stopped we need to send a signal to continue.
-    kill(-pid, SIGCONT);      //kill sends signal to continue program
-    if (jobp->state == FG)    //if its a foreground job
+    if (!strcmp(argv[0], "fg"))
+    {
+        jobp->state = FG;     //waitfg watches for it to leave FG
+        journal_state(jobp);
+        tty_give(jobp);       //terminal and saved modes go with it
+        kill(-pid, SIGCONT);  //if the job has stopped it needs a signal to continue
         waitfg(pid);          //wait for task to complete because 'fg'
+    }
     else
+    {
         printf("[%d] (%d) %s",jobp -> jid, jobp -> pid, jobp->cmdline);
+        if (jobp->state == ST)
+        {
+            kill(-pid, SIGCONT);
+            waitcont(pid);    //the reaper moves it to BG when the kernel says so
+        }
+    }
+    TRACE_END("do_bgfg");
 }
 
 
@@ -286,10 +585,204 @@ void do_bgfg(char **argv)
 //
 // waitfg - Block until process pid is no longer the foreground process
 //
+// SIGCHLD stays blocked except while evloop_wait sleeps, so a child
+// that changes state between the test and the wait still wakes us.
+// Sockets keep being served while the foreground job runs.
+//
 void waitfg(pid_t pid)
 {
-    while (fgpid(jobs) == pid) //spin while the inputted pid is still the fg pid
-        Sleep(10);             //blocking call to sleep.
+    sigset_t mask, prev;
+
+    TRACE_BEGIN("waitfg");
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGCHLD);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    while (fgpid(jobs) == pid) //wait while the inputted pid is still the fg pid
+        evloop_wait(-1);       //sleeps until a signal or socket event
+    tty_reclaim(pid);          //stopped or gone: the terminal is ours again
+    Sigprocmask(SIG_SETMASK, &prev, 0);
+    TRACE_END("waitfg");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_wait - Execute the builtin wait command:
+//     wait [-n] [--timeout secs] [%jid|pid ...]
+//     Sleeps in the event loop, as waitfg does, until the jobs named
+//     (by default every running background job) have finished, or
+//     with -n the first of them. The reaper keeps each background
+//     job's status, so one that is already gone is answered at once.
+//     Returns the status of the last job named (the first to finish
+//     with -n, or the oldest that finished unwaited-for before the
+//     wait; 0 for all jobs), which the caller makes $?. 127 if a
+//     job doesn't exist, 124 after the timeout, 130 after ctrl-c. A
+//     stopped job counts as finished, with 148.
+//
+struct wjob_t                 // A job wait is waiting for
+{
+    pid_t pid;
+    int jid;
+    int status;               // -1 while it runs
+};
+
+int do_wait(char **argv)
+{
+    struct wjob_t *w;
+    int nw = 0, next = 0, status = 0, named, i;
+    long long deadline = -1;  // ms, CLOCK_MONOTONIC
+    sigset_t mask, prev;
+    struct timespec ts;
+
+    for (i = 1; argv[i] && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-n"))
+            next = 1;
+        else if (!strcmp(argv[i], "--timeout") && argv[i + 1])
+        {
+            char *end;
+            double secs = strtod(argv[++i], &end);
+
+            if (*end || secs < 0)
+            {
+                printf("wait: %s: bad timeout\n", argv[i]);
+                return 2;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            deadline = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000 + (long long)(secs * 1000);
+        }
+        else if (!strcmp(argv[i], "--"))
+        {
+            i++;
+            break;
+        }
+        else
+        {
+            printf("wait: usage: wait [-n] [--timeout secs] [%%jid|pid ...]\n");
+            return 2;
+        }
+    }
+
+    for (named = 0; argv[i + named]; named++)
+        ;
+    if ((w = (struct wjob_t *)malloc((MAXJOBS + named) * sizeof(*w))) == NULL)
+        unix_error("malloc error");
+    if (!named)               // every running background job
+    {
+        for (int j = 0; jobs != NULL && j < MAXJOBS; j++)
+            if (jobs[j].pid != 0 && jobs[j].state == BG)
+            {
+                w[nw].pid = jobs[j].pid;
+                w[nw].jid = jobs[j].jid;
+                w[nw++].status = -1;
+            }
+        if (next && (status = jobdone(0, 0)) >= 0)
+            nw = 0;           // one that finished already goes first
+        else if (nw == 0 && next)
+            status = 127;     // nothing to wait for
+        else
+            status = 0;
+    }
+    for ( ; argv[i]; i++)     // or the ones named
+    {
+        struct job_t *jobp = argv[i][0] == '%' ? getjobjid(jobs, atoi(argv[i] + 1))
+                                               : getjobpid(jobs, atoi(argv[i]));
+
+        w[nw].pid = jobp ? jobp->pid : argv[i][0] == '%' ? 0 : atoi(argv[i]);
+        w[nw].jid = jobp ? jobp->jid : argv[i][0] == '%' ? atoi(argv[i] + 1) : 0;
+        w[nw].status = -1;
+        if (jobp == NULL && (w[nw].status = jobdone(w[nw].pid, w[nw].jid)) < 0)
+        {
+            printf("wait: %s: no such job\n", argv[i]);
+            w[nw].status = 127;
+        }
+        nw++;
+    }
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGCHLD);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    wait_interrupted = 0;
+    for (;;)
+    {
+        int running = 0, first = -1, timeout = -1;
+
+        for (i = 0; i < nw; i++)
+        {
+            struct job_t *jobp;
+
+            if (w[i].status < 0 && (jobp = getjobpid(jobs, w[i].pid)) != NULL)
+            {
+                if (jobp->state != ST)
+                {
+                    running++;
+                    continue;
+                }
+                w[i].status = 128 + SIGTSTP;
+            }
+            else if (w[i].status < 0 && (w[i].status = jobdone(w[i].pid, 0)) < 0)
+                w[i].status = 127;      // reaped, but its status was dropped
+            if (first < 0)
+                first = i;
+        }
+        if (next && first >= 0)
+        {
+            status = w[first].status;
+            break;
+        }
+        if (running == 0)
+        {
+            if (named && !next)
+                status = w[nw - 1].status;
+            break;
+        }
+        if (wait_interrupted)
+        {
+            status = 128 + SIGINT;
+            break;
+        }
+        if (deadline >= 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            if ((timeout = (int)(deadline - (ts.tv_sec * 1000LL + ts.tv_nsec / 1000000))) <= 0)
+            {
+                status = 124;
+                break;
+            }
+        }
+        evloop_wait(timeout);   // the reaper runs when it wakes
+    }
+    Sigprocmask(SIG_SETMASK, &prev, 0);
+    free(w);
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// waitcont - Wait for a stopped job that has been sent SIGCONT to
+//     report that it is running again. The kernel's CLD_CONTINUED
+//     normally arrives at once, unless the job is stopped again
+//     first, in which case only the new stop is reported. If neither
+//     has come within about a second, take the signal's word for it.
+//
+static void waitcont(pid_t pid)
+{
+    struct job_t *jobp;
+
+    last_stopped = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        if ((jobp = getjobpid(jobs, pid)) == NULL || jobp->state != ST ||
+            last_stopped == pid)
+            return;
+        evloop_wait(10);
+    }
+    if ((jobp = getjobpid(jobs, pid)) != NULL && jobp->state == ST)
+    {
+        jobp->state = BG;
+        journal_state(jobp);
+    }
 }
 
 
@@ -302,38 +795,156 @@ void waitfg(pid_t pid)
 /////////////////////////////////////////////////////////////////////////////
 //
 // sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
-//     a child job terminates (becomes a zombie), or stops because it
-//     received a SIGSTOP or SIGTSTP signal. The handler reaps all
-//     available zombie children, but doesn't wait for any other
-//     currently running children to terminate.
+//     a child job terminates (becomes a zombie), stops because it
+//     received a SIGSTOP or SIGTSTP signal, or continues. The handler
+//     only notes that there is something to reap and wakes the event
+//     loop; reap_children does the work in the main loop, so a burst
+//     of signals costs one pass and job messages are never printed
+//     from signal context.
 //
 void sigchld_handler(int sig)
 {
-    pid_t pid;
-    int   CODE;
+    int olderrno = errno;
+
+    TRACE_SIG_INSTANT("sigchld", 0);
+    metrics_note_sigchld();
+    if (!child_pending)              //one byte wakes the loop; more would
+    {                                //only be drained again
+        child_pending = 1;
+        if (write(chldpipe[1], "", 1) < 0)
+            ;                        //full pipe: a wakeup is already queued
+    }
+    errno = olderrno;
+}
+
 
-    while (1)
+/////////////////////////////////////////////////////////////////////////////
+//
+// child_ready - Event loop handler for the SIGCHLD pipe. The reaping
+//     itself happens in sync_events, which runs after every wakeup.
+//
+static void child_ready(int fd, unsigned int events, void *arg)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// wstatus - The wait status that waitpid would have reported for si
+//
+static int wstatus(const siginfo_t *si)
+{
+    switch (si->si_code)
     {
-        //get zombies -- nohang & untraced
-	//WNOHANG: don't wait for the children's process to finish
-	//WUNTRACED: 
-        pid = waitpid(-1, &CODE, WNOHANG | WUNTRACED);
-        if (pid <= 0)                                  //Base case when there are no more zombies
-            return;
+    case CLD_EXITED:    return W_EXITCODE(si->si_status, 0);
+    case CLD_KILLED:    return si->si_status;
+    case CLD_DUMPED:    return si->si_status | WCOREFLAG;
+    case CLD_CONTINUED: return 0xffff;
+    default:            return W_STOPCODE(si->si_status); //stopped or trapped
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// reap_children - Collect every child state change the kernel has
+//     queued and update the job list. One waitid per event, and one
+//     more to find there are none left; the raw syscall is used
+//     because it also returns the child's rusage for the journal.
+//     Jobs are stopped, continued (bg, or a SIGCONT from elsewhere)
+//     and deleted here, from what the kernel reports. A job with
+//     process substitutions is deleted once they have exited too;
+//     they speak for it only when its own process is gone, and a
+//     producer killed by SIGPIPE is not news.
+//
+static void reap_children(void)
+{
+    siginfo_t si;
+    struct rusage ru;
+    int printed = 0;
+
+    if (!child_pending)
+        return;
+    child_pending = 0;               //before waitid, so no event is missed
+    metrics_note_pass();
+    TRACE_BEGIN("reap");
+    for (;;)
+    {
+        si.si_pid = 0;
+        if (syscall(SYS_waitid, P_ALL, 0, &si,
+                    WEXITED | WSTOPPED | WCONTINUED | WNOHANG, &ru) < 0 ||
+            si.si_pid == 0)          //no children, or none with news
+            break;
+
+        pid_t pid = si.si_pid;
+        int   CODE = wstatus(&si);
+        struct job_t *jobp = getjobpid(jobs, pid);
+        int   sub = jobp == NULL && (jobp = getjobsub(jobs, pid)) != NULL;
+        int   jid = jobp ? jobp->jid : 0;
 
-        if (WIFEXITED(CODE))
-            deletejob(jobs, pid);   // Delete job off of job list if finished.
-        else if (WIFSIGNALED(CODE)) //If killed
+        TRACE_INSTANT("reap", pid);
+        if (sub)                     //a <(...) or >(...) of the job
         {
-            printf("Job [%d] (%d) terminated by signal %d\n", pid2jid(pid), pid, WTERMSIG(CODE));
-            deletejob(jobs, pid); // Delete job off of job list if finished.
+            if (si.si_code == CLD_EXITED || si.si_code == CLD_KILLED ||
+                si.si_code == CLD_DUMPED)
+            {
+                metrics_note_reap();
+                if (deletejobsub(jobp, pid) == 0 && jobp->exited)
+                    deletejob(jobs, jobp->pid);  //the last of the job
+                continue;
+            }
+            if (!jobp->exited)
+                continue;            //its stops follow the job's own
         }
-        if (WIFSTOPPED(CODE))     //If stopped, change the state.
+        else if (jobp != NULL && jobp->state == FG) //$? is the foreground job's status
         {
-            getjobpid(jobs, pid)->state = ST;
-            printf("Job [%d] (%d) stopped by signal %d\n", pid2jid(pid), pid, WSTOPSIG(CODE));
+            var_status(si.si_code == CLD_EXITED ? si.si_status : 128 + si.si_status);
+            if (si.si_code == CLD_KILLED && si.si_status == SIGINT)
+                script_interrupt();  //ctrl-c ends a script, not just its job
+        }
+        switch (si.si_code)
+        {
+        case CLD_KILLED:
+        case CLD_DUMPED:
+            printf("Job [%d] (%d) terminated by signal %d\n", jid, pid, si.si_status);
+            printed = 1;
+            //fall through
+        case CLD_EXITED:
+            metrics_note_reap();
+            journal_note(JR_REAP, pid, jid, UNDEF, CODE, &ru);
+            if (jobp != NULL && jobp->state != FG) //kept for the wait builtin
+                notejobdone(pid, jid, si.si_code == CLD_EXITED ? si.si_status
+                                                               : 128 + si.si_status);
+            if (jobp != NULL && jobp->nsubs > 0)
+                jobp->exited = 1;    //done once its <(...) are
+            else
+                deletejob(jobs, pid);    //Delete job off of job list if finished.
+            break;
+        case CLD_STOPPED:
+        case CLD_TRAPPED:
+            if (jobp == NULL)
+                break;
+            jobp->state = ST;
+            last_stopped = pid;
+            journal_note(JR_STATE, pid, jid, ST, CODE, NULL);
+            printf("Job [%d] (%d) stopped by signal %d\n", jid, pid, si.si_status);
+            printed = 1;
+            break;
+        case CLD_CONTINUED:
+            if (jobp == NULL || jobp->state != ST)
+                break;               //fg already made it FG
+            jobp->state = BG;
+            journal_note(JR_STATE, pid, jid, BG, CODE, NULL);
+            break;
         }
     }
+    if (printed)
+        fflush(stdout);
+    TRACE_END("reap");
 }
 
 
@@ -341,14 +952,23 @@ void sigchld_handler(int sig)
 //
 // sigint_handler - The kernel sends a SIGINT to the shell whenver the
 //    user types ctrl-c at the keyboard.  Catch it and send it along
-//    to the foreground job.
+//    to the foreground job. With terminal job control (tty.h) the
+//    kernel signals the job directly and this only runs for the
+//    driver's pipes.
 //
 void sigint_handler(int sig) //ctrl-c
 {
     pid_t fg = fgpid(jobs);
 
+    script_interrupt();    //any script running in the shell stops too,
+                           //even if its job is already a zombie
     if (fg != 0)           //if there is fg
         kill(-fg, SIGINT); //kill it.
+    else
+    {
+        util_interrupt();  //or end an in-shell sleep (tsh -u)
+        wait_interrupted = 1; //or the wait builtin
+    }
 }
 
 
@@ -356,7 +976,8 @@ void sigint_handler(int sig) //ctrl-c
 //
 // sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
 //     the user types ctrl-z at the keyboard. Catch it and suspend the
-//     foreground job by sending it a SIGTSTP.
+//     foreground job by sending it a SIGTSTP. As with ctrl-c, only
+//     needed when there is no terminal to hand the job.
 //
 void sigtstp_handler(int sig)
 {
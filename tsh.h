@@ -0,0 +1,17 @@
+//-*-c++-*-
+#ifndef _tsh_h_
+#define _tsh_h_
+
+#include <sys/types.h>
+
+/* Shell routines in tsh.cc that other modules call */
+void  eval(char *cmdline);
+int   eval_argv(char **argv, int bg, char *cmdline, int infd);
+int   builtin_cmd(char **argv, int bg);
+void  do_bgfg(char **argv);
+void  waitfg(pid_t pid);
+int   do_wait(char **argv);
+pid_t launch(char **argv, int state, char *cmdline, int infd);
+void  child_signals(void);
+
+#endif
@@ -0,0 +1,730 @@
+/*
+ * tshbench.c - Stress and throughput benchmarks for job control
+ *
+ * usage: tshbench [-h] [-s <shell>]... [-n <count>] [-k <k1,k2,...>]
+ *                 [-r <reps>] [-l <launches>] [-m <mb>] [-B <us>] [-b <bench,...>]
+ *
+ * Drives each shell (default: ./tsh and ./tshref) over pipes, the way
+ * tdriver does, and measures:
+ *
+ *     spawn   foreground jobs per second (<count> runs of ./mynop)
+ *     script  trace-style lines per second: <count> commands, each
+ *             announced by /bin/echo as the trace files do, half of
+ *             them ./mynop and half the jobs builtin
+ *     reap    time from <k> background children exiting together
+ *             (./mywait on a shared fifo) until the shell has reaped
+ *             all of them, for each <k> in the -k list
+ *     fgbg    fg/bg round trips on a stopped ./myspin: time for the
+ *             job to be running again after "fg %1" and "bg %1"
+ *     signal  ctrl-c and ctrl-z delivery: time from the shell getting
+ *             SIGINT/SIGTSTP to it reporting the foreground job
+ *             terminated/stopped
+ *     startup time from fork to the shell answering its first command,
+ *             over <launches> launches of "shell -p"
+ *     footprint  resident memory (rss, pss, anonymous) of an idle
+ *             shell and of one holding a background job
+ *     mux     aggregate output of 8 background ./mylines jobs, <mb>
+ *             megabytes each, through the shell's stdout: MB/s, and
+ *             how many lines came out torn by another job's (run it on
+ *             "./tsh -l" or "./tsh -L" to see line mode)
+ *
+ * A shell given with options ("-s './tsh -u'") is run with them.
+ * Children are observed through /proc, so the numbers don't depend on
+ * when a shell chooses to flush its output.  Results are printed one
+ * JSON object per line so runs can be compared by a script.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static double timeout_secs = 60.0;
+
+/* now - Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* proc_state - State letter of a process from /proc (0 if gone) */
+static char proc_state(pid_t pid)
+{
+    char path[64], buf[512];
+    int fd, n;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    char *p = strrchr(buf, ')');
+    return p && p[1] && p[2] ? p[2] : 0;
+}
+
+/* proc_mem - Rss, Pss and anonymous memory of pid in KB (false if gone) */
+static bool proc_mem(pid_t pid, long *rss, long *pss, long *priv)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    std::ifstream f(path);
+    std::string key;
+    long kb;
+    int found = 0;
+
+    std::getline(f, key);                  /* the [rollup] mapping line */
+    while (f >> key >> kb) {
+        if (key == "Rss:")
+            *rss = kb, found++;
+        else if (key == "Pss:")
+            *pss = kb, found++;
+        else if (key == "Anonymous:")
+            *priv = kb, found++;
+        f.ignore(64, '\n');
+    }
+    return found == 3;
+}
+
+/*
+ * A shell under test, with its stdin and stdout on pipes.
+ */
+struct Shell {
+    std::string prog;
+    pid_t pid = -1;
+    int to = -1, from = -1;
+    std::string out;        /* everything it wrote */
+    size_t cursor = 0;      /* where the next waitfor looks */
+
+    bool start();
+    void pump(double secs);
+    void send(const std::string &line);
+    bool waitfor(const std::string &re, std::smatch *m = NULL);
+    std::vector<pid_t> children();
+    void finish();
+};
+
+bool Shell::start()
+{
+    int in[2], outp[2];
+
+    if (pipe2(in, O_CLOEXEC) < 0 || pipe2(outp, O_CLOEXEC) < 0)
+        return false;
+    if ((pid = fork()) == 0) {
+        std::istringstream words(prog);         /* "./tsh -u": program and options */
+        std::vector<std::string> args;
+        std::vector<char *> argv;
+        std::string w;
+
+        while (words >> w)
+            args.push_back(w);
+        args.push_back("-p");
+        for (auto &a : args)
+            argv.push_back(&a[0]);
+        argv.push_back(NULL);
+        dup2(in[0], 0);
+        dup2(outp[1], 1);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(in[0]);
+    close(outp[1]);
+    to = in[1];
+    from = outp[0];
+    fcntl(to, F_SETFL, O_NONBLOCK);
+    out.clear();
+    cursor = 0;
+    return pid > 0;
+}
+
+/* pump - Collect output for up to secs seconds (0: only what's ready) */
+void Shell::pump(double secs)
+{
+    char buf[65536];
+    double deadline = now() + secs;
+
+    while (from >= 0) {
+        struct pollfd pfd = { from, POLLIN, 0 };
+        int left = secs > 0 ? (int)((deadline - now()) * 1000) : 0;
+        if (left < 0)
+            return;
+        int n = poll(&pfd, 1, left);
+        if (n <= 0)
+            return;
+        ssize_t r = read(from, buf, sizeof(buf));
+        if (r <= 0) {
+            close(from);
+            from = -1;
+            return;
+        }
+        out.append(buf, r);
+        if (secs > 0)
+            return;
+    }
+}
+
+/* send - Write a command line, draining output while the pipe is full */
+void Shell::send(const std::string &line)
+{
+    size_t off = 0;
+
+    while (off < line.size() && to >= 0) {
+        ssize_t n = write(to, line.data() + off, line.size() - off);
+        if (n > 0)
+            off += n;
+        else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return;
+        else
+            pump(0.001);
+    }
+}
+
+/* waitfor - Wait until the output past cursor matches re */
+bool Shell::waitfor(const std::string &re, std::smatch *m)
+{
+    std::regex r(re);
+    std::smatch local;
+    double deadline = now() + timeout_secs;
+
+    if (m == NULL)
+        m = &local;
+    for (;;) {
+        if (std::regex_search(out.cbegin() + cursor, out.cend(), *m, r)) {
+            cursor += m->position(0) + m->length(0);
+            return true;
+        }
+        if (from < 0 || now() > deadline)
+            return false;
+        pump(0.05);
+    }
+}
+
+/* children - The shell's child processes, zombies included */
+std::vector<pid_t> Shell::children()
+{
+    std::vector<pid_t> kids;
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, pid);
+    std::ifstream f(path);
+    pid_t p;
+    while (f >> p)
+        kids.push_back(p);
+    return kids;
+}
+
+/* finish - Kill anything left over and reap the shell */
+void Shell::finish()
+{
+    for (pid_t k : children())
+        kill(-k, SIGKILL);
+    if (to >= 0)
+        close(to);
+    to = -1;
+    double deadline = now() + 5;
+    while (from >= 0 && now() < deadline)
+        pump(0.1);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    if (from >= 0)
+        close(from);
+    from = -1;
+}
+
+/* Summary statistics over a set of samples */
+struct Stats {
+    std::vector<double> v;
+
+    void add(double x) { v.push_back(x); }
+    double pct(double q) {
+        if (v.empty())
+            return 0;
+        std::sort(v.begin(), v.end());
+        size_t i = (size_t)(q * (v.size() - 1) + 0.5);
+        return v[i];
+    }
+    double mean() {
+        double s = 0;
+        for (double x : v)
+            s += x;
+        return v.empty() ? 0 : s / v.size();
+    }
+};
+
+/* report - Print one result line */
+static void report(const std::string &shell, const char *bench, const std::string &fields)
+{
+    printf("{\"shell\":\"%s\",\"bench\":\"%s\",%s}\n", shell.c_str(), bench, fields.c_str());
+    fflush(stdout);
+}
+
+/* us - Format a Stats object in microseconds */
+static std::string us(Stats &s)
+{
+    char buf[256];
+
+    snprintf(buf, sizeof(buf), "\"n\":%zu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f",
+             s.v.size(), s.mean() * 1e6, s.pct(0.5) * 1e6, s.pct(0.99) * 1e6);
+    return buf;
+}
+
+/* wait_running - Wait until pid is running (or sleeping), not stopped */
+static bool wait_state(Shell &sh, pid_t pid, bool stopped)
+{
+    double deadline = now() + timeout_secs;
+
+    for (;;) {
+        char st = proc_state(pid);
+        if (st == 0)
+            return false;
+        if ((st == 'T' || st == 't') == stopped)
+            return true;
+        if (now() > deadline)
+            return false;
+        sh.pump(0);
+    }
+}
+
+/* bench_spawn - Foreground jobs per second */
+static void bench_spawn(const std::string &prog, int n)
+{
+    Shell sh;
+    std::string script;
+
+    sh.prog = prog;
+    for (int i = 0; i < n; i++)
+        script += "./mynop\n";
+    double t0 = now();
+    if (!sh.start())
+        return;
+    sh.send(script);
+    close(sh.to);
+    sh.to = -1;
+    while (sh.from >= 0)
+        sh.pump(1);
+    waitpid(sh.pid, NULL, 0);
+    double t = now() - t0;
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "\"n\":%d,\"seconds\":%.4f,\"per_sec\":%.1f", n, t, n / t);
+    report(prog, "spawn", buf);
+}
+
+/* bench_script - Lines per second of a trace-style script */
+static void bench_script(const std::string &prog, int n)
+{
+    Shell sh;
+    std::string script;
+
+    sh.prog = prog;
+    for (int i = 0; i < n; i++)
+        script += i % 2 ? "/bin/echo -e tsh\\076 jobs\njobs\n"
+                        : "/bin/echo -e tsh\\076 ./mynop\n./mynop\n";
+    double t0 = now();
+    if (!sh.start())
+        return;
+    sh.send(script);
+    close(sh.to);
+    sh.to = -1;
+    while (sh.from >= 0)
+        sh.pump(1);
+    waitpid(sh.pid, NULL, 0);
+    double t = now() - t0;
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "\"lines\":%d,\"seconds\":%.4f,\"lines_per_sec\":%.1f",
+             2 * n, t, 2 * n / t);
+    report(prog, "script", buf);
+}
+
+/* bench_reap - Time to reap k children that exit together */
+static void bench_reap(const std::string &prog, int k)
+{
+    char fifo[64];
+    Shell sh;
+    int fd;
+
+    snprintf(fifo, sizeof(fifo), "/tmp/tshbench.%d.fifo", getpid());
+    unlink(fifo);
+    if (mkfifo(fifo, 0600) < 0 || (fd = open(fifo, O_RDWR | O_CLOEXEC)) < 0) {
+        perror(fifo);
+        return;
+    }
+    sh.prog = prog;
+    if (!sh.start())
+        return;
+
+    std::string line = std::string("./mywait ") + fifo + " &\n";
+    double t0 = now();
+    for (int i = 0; i < k; i++)
+        sh.send(line);
+    bool ok = false;
+    while (now() - t0 < timeout_secs) {
+        if ((int)sh.children().size() >= k) {
+            ok = true;
+            break;
+        }
+        sh.pump(0.001);
+    }
+    double spawned = now() - t0;
+
+    double t1 = now(), t2 = 0;
+    close(fd);          /* every mywait sees EOF now */
+    while (ok) {
+        if (sh.children().empty()) {
+            t2 = now();
+            break;
+        }
+        if (now() - t1 > timeout_secs)
+            ok = false;
+        sh.pump(0);
+    }
+    unlink(fifo);
+    sh.finish();
+
+    char buf[160];
+    if (ok)
+        snprintf(buf, sizeof(buf), "\"children\":%d,\"spawn_seconds\":%.4f,\"reap_ms\":%.3f",
+                 k, spawned, (t2 - t1) * 1e3);
+    else
+        snprintf(buf, sizeof(buf), "\"children\":%d,\"error\":\"timeout\"", k);
+    report(prog, "reap", buf);
+}
+
+/* start_spin - Start ./myspin in the background and return its pid */
+static pid_t start_spin(Shell &sh)
+{
+    std::smatch m;
+
+    sh.send("./myspin 1000 &\n");
+    if (!sh.waitfor("\\[\\d+\\] \\((\\d+)\\)", &m))
+        return -1;
+    return atoi(m[1].str().c_str());
+}
+
+/* bench_fgbg - fg/bg round trips on a stopped job */
+static void bench_fgbg(const std::string &prog, int reps)
+{
+    Shell sh;
+    Stats fg, bg;
+    pid_t child;
+
+    sh.prog = prog;
+    if (!sh.start() || (child = start_spin(sh)) < 0) {
+        sh.finish();
+        return;
+    }
+    kill(child, SIGSTOP);
+    for (int i = 0; i < reps; i++) {
+        if (!wait_state(sh, child, true))
+            break;
+        double t0 = now();
+        sh.send("fg %1\n");
+        if (!wait_state(sh, child, false))
+            break;
+        fg.add(now() - t0);
+        kill(sh.pid, SIGTSTP);             /* ctrl-z the foreground job */
+        if (!sh.waitfor("stopped by signal"))
+            break;
+
+        t0 = now();
+        sh.send("bg %1\n");
+        if (!wait_state(sh, child, false))
+            break;
+        bg.add(now() - t0);
+        kill(child, SIGSTOP);
+    }
+    sh.finish();
+    report(prog, "fg", us(fg));
+    report(prog, "bg", us(bg));
+}
+
+/* bench_signal - ctrl-c and ctrl-z delivery to a foreground job */
+static void bench_signal(const std::string &prog, int reps)
+{
+    Shell sh;
+    Stats intr, tstp;
+
+    sh.prog = prog;
+    if (!sh.start())
+        return;
+    for (int i = 0; i < reps; i++) {
+        for (int sig : { SIGINT, SIGTSTP }) {
+            std::vector<pid_t> kids;
+            double t0 = now();
+
+            sh.send("./myspin 1000\n");
+            while ((kids = sh.children()).empty() && now() - t0 < timeout_secs)
+                sh.pump(0);
+            if (kids.empty() || !wait_state(sh, kids[0], false))
+                goto out;
+            /* the shell must be waiting on it, not still in fork/exec */
+            if (proc_state(kids[0]) == 0)
+                goto out;
+            usleep(1000);
+            t0 = now();
+            kill(sh.pid, sig);
+            if (!sh.waitfor(sig == SIGINT ? "terminated by signal 2" : "stopped by signal 20"))
+                goto out;
+            (sig == SIGINT ? intr : tstp).add(now() - t0);
+            if (sig == SIGTSTP) {
+                kill(-kids[0], SIGKILL);
+                while (!sh.children().empty() && now() - t0 < timeout_secs)
+                    sh.pump(0.001);
+                sh.send("jobs\n");   /* flush the "terminated" report */
+                sh.waitfor("terminated by signal 9|\\n");
+            }
+        }
+    }
+out:
+    sh.finish();
+    report(prog, "ctrl-c", us(intr));
+    report(prog, "ctrl-z", us(tstp));
+}
+
+/*
+ * bench_startup - Time from fork to the answer to the first command.
+ * The command is in the pipe before the shell starts, so this is all
+ * the shell's own startup plus one read and one write.  Returns the
+ * median in microseconds (-1 on failure).
+ */
+static double bench_startup(const std::string &prog, int launches)
+{
+    Stats startup;
+
+    for (int i = 0; i < launches; i++) {
+        Shell sh;
+        bool ok = true;
+
+        sh.prog = prog;
+        double t0 = now();
+        if (!sh.start())
+            return -1;
+        sh.send("bg\n");                   /* a builtin that answers */
+        while (sh.out.find("requires PID") == std::string::npos && (ok = sh.from >= 0))
+            sh.pump(timeout_secs);
+        if (ok)
+            startup.add(now() - t0);
+        sh.finish();
+        if (!ok)
+            break;
+    }
+    report(prog, "startup", us(startup));
+    return startup.v.empty() ? -1 : startup.pct(0.5) * 1e6;
+}
+
+/* bench_footprint - Resident memory, idle and with a background job */
+static void bench_footprint(const std::string &prog)
+{
+    long rss = 0, pss = 0, anon = 0, jrss = 0, jpss = 0, janon = 0;
+    Shell sh;
+    bool ok;
+
+    sh.prog = prog;
+    if (!sh.start())
+        return;
+    sh.send("bg\n");
+    ok = sh.waitfor("requires PID") && proc_mem(sh.pid, &rss, &pss, &anon);
+    ok = ok && start_spin(sh) > 0 && proc_mem(sh.pid, &jrss, &jpss, &janon);
+    sh.finish();
+
+    char buf[256];
+    if (ok)
+        snprintf(buf, sizeof(buf), "\"rss_kb\":%ld,\"pss_kb\":%ld,\"anon_kb\":%ld,"
+                 "\"job_rss_kb\":%ld,\"job_pss_kb\":%ld,\"job_anon_kb\":%ld",
+                 rss, pss, anon, jrss, jpss, janon);
+    else
+        snprintf(buf, sizeof(buf), "\"error\":\"no /proc/<pid>/smaps_rollup\"");
+    report(prog, "footprint", buf);
+}
+
+/* mux_line - Is the line at s (n bytes, no newline) one whole ./mylines line? */
+static bool mux_line(const char *s, size_t n, size_t len)
+{
+    size_t i = 0;
+
+    if (n > 0 && s[0] == '[') {             /* a "[jid] " tag */
+        const char *t = (const char *)memchr(s, ' ', n);
+        if (t == NULL)
+            return false;
+        i = t + 1 - s;
+    }
+    if (n - i != len - 1)
+        return false;
+    while (i < n && s[i] >= '0' && s[i] <= '9')
+        i++;
+    if (i == n || s[i] != ':')
+        return false;
+    while (++i < n)
+        if (s[i] != 'x')
+            return false;
+    return true;
+}
+
+/*
+ * bench_mux - Aggregate output of concurrent background jobs through
+ * the shell, and how many of their lines were torn
+ */
+static void bench_mux(const std::string &prog, int mb)
+{
+    const int jobs = 8, len = 80;
+    long per = ((long)mb << 20) / len + (((long)mb << 20) % len != 0);
+    long want = jobs * per, lines = 0, torn = 0;
+    std::string script, carry;
+    static char buf[1 << 20];
+    double last = 0;
+    Shell sh;
+
+    sh.prog = prog;
+    for (int i = 0; i < jobs; i++)
+        script += "./mylines " + std::to_string(mb) + " " + std::to_string(len) + " &\n";
+    double t0 = now();
+    if (!sh.start())
+        return;
+    sh.send(script);
+    while (lines + torn < want) {
+        struct pollfd pfd = { sh.from, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)(timeout_secs * 1000)) <= 0)
+            break;
+        ssize_t r = read(sh.from, buf, sizeof(buf));
+        if (r <= 0)
+            break;
+        last = now();
+        const char *s = buf, *end = buf + r, *nl;
+        while ((nl = (const char *)memchr(s, '\n', end - s)) != NULL) {
+            const char *l = s;
+            size_t n = nl - s;
+            if (!carry.empty()) {
+                carry.append(s, n);
+                l = carry.data();
+                n = carry.size();
+            }
+            if (mux_line(l, n, len))
+                lines++;
+            else if (std::string(l, n).find("./mylines") == std::string::npos)
+                torn++;                     /* not the shell's "[1] (pid) ./mylines" */
+            carry.clear();
+            s = nl + 1;
+        }
+        carry.append(s, end - s);
+    }
+    sh.finish();
+
+    char out[256];
+    double t = last - t0;
+    snprintf(out, sizeof(out), "\"jobs\":%d,\"mb\":%d,\"seconds\":%.4f,\"mb_per_sec\":%.1f,"
+             "\"lines\":%ld,\"torn\":%ld", jobs, jobs * mb, t,
+             t > 0 ? jobs * mb * (double)lines / want / t : 0, lines, torn);
+    report(prog, "mux", out);
+}
+
+/*
+ * usage - print help message and terminate
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tshbench [-h] [-s <shell>]... [-n <count>] [-k <k1,k2,...>] "
+                    "[-r <reps>] [-l <launches>] [-m <mb>] [-B <us>] [-b <bench,...>]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h            Print this message\n");
+    fprintf(stderr, "  -s <shell>    Shell to measure, with any options (repeatable;\n");
+    fprintf(stderr, "                default ./tsh and ./tshref)\n");
+    fprintf(stderr, "  -n <count>    Commands for the spawn and script benchmarks (default 2000)\n");
+    fprintf(stderr, "  -k <list>     Concurrent children for the reap benchmark\n");
+    fprintf(stderr, "                (default 1,10,100,1000,10000)\n");
+    fprintf(stderr, "  -r <reps>     Repetitions for fgbg and signal (default 200)\n");
+    fprintf(stderr, "  -l <launches> Launches for the startup benchmark (default 10000)\n");
+    fprintf(stderr, "  -m <mb>       Megabytes per job for the mux benchmark (default 64)\n");
+    fprintf(stderr, "  -B <us>       Exit with status 2 if a shell's median startup exceeds <us>\n");
+    fprintf(stderr, "  -b <list>     Benchmarks to run\n");
+    fprintf(stderr, "                (default spawn,script,reap,fgbg,signal,startup,footprint,mux)\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> shells;
+    std::vector<int> ks = { 1, 10, 100, 1000, 10000 };
+    std::string benches = "spawn,script,reap,fgbg,signal,startup,footprint,mux";
+    int n = 2000, reps = 200, launches = 10000, mb = 64, c, status = 0;
+    double budget = 0;
+
+    signal(SIGPIPE, SIG_IGN);
+    while ((c = getopt(argc, argv, "hs:n:k:r:l:m:B:b:")) != EOF) {
+        switch (c) {
+        case 's': shells.push_back(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'l': launches = atoi(optarg); break;
+        case 'm': mb = atoi(optarg); break;
+        case 'B': budget = atof(optarg); break;
+        case 'b': benches = optarg; break;
+        case 'k': {
+            std::istringstream list(optarg);
+            std::string k;
+            ks.clear();
+            while (std::getline(list, k, ','))
+                ks.push_back(atoi(k.c_str()));
+            break;
+        }
+        default: usage();
+        }
+    }
+    if (shells.empty())
+        shells = { "./tsh", "./tshref" };
+    auto want = [&](const char *b) {
+        return ("," + benches + ",").find(std::string(",") + b + ",") != std::string::npos;
+    };
+
+    for (auto &sh : shells) {
+        std::string prog = sh.substr(0, sh.find(' '));
+        if (access(prog.c_str(), X_OK) < 0) {
+            fprintf(stderr, "tshbench: %s: %s\n", prog.c_str(), strerror(errno));
+            continue;
+        }
+        if (want("spawn"))
+            bench_spawn(sh, n);
+        if (want("script"))
+            bench_script(sh, n);
+        if (want("reap"))
+            for (int k : ks)
+                bench_reap(sh, k);
+        if (want("fgbg"))
+            bench_fgbg(sh, reps);
+        if (want("signal"))
+            bench_signal(sh, reps);
+        if (want("startup")) {
+            double p50 = bench_startup(sh, launches);
+            if (budget > 0 && (p50 < 0 || p50 > budget)) {
+                fprintf(stderr, "tshbench: %s: median startup %.1f us is over the %.1f us budget\n",
+                        sh.c_str(), p50, budget);
+                status = 2;
+            }
+        }
+        if (want("footprint"))
+            bench_footprint(sh);
+        if (want("mux"))
+            bench_mux(sh, mb);
+    }
+    return status;
+}
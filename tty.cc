@@ -0,0 +1,90 @@
+#include "tty.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+
+
+/***********************************************
+ * Handing the terminal to foreground jobs
+ **********************************************/
+
+static int            active;    /* stdin is our controlling terminal */
+static pid_t          shell_pgid;
+static struct termios shell_modes;
+
+
+/*
+ * tty_init - Take control of the terminal if stdin is one.  A shell
+ * started in the background waits (stopped by SIGTTIN) until it is
+ * brought to the foreground, then puts itself in its own process
+ * group and makes that the terminal's foreground group.
+ */
+int tty_init(void)
+{
+    if (!isatty(0))
+        return -1;
+    while (tcgetpgrp(0) != (shell_pgid = getpgrp()))
+        kill(-shell_pgid, SIGTTIN);
+
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);   /* tcsetpgrp from a background group */
+    shell_pgid = getpid();
+    if (getpgrp() != shell_pgid && setpgid(0, shell_pgid) < 0)
+        return -1;
+    if (tcsetpgrp(0, shell_pgid) < 0 || tcgetattr(0, &shell_modes) < 0)
+        return -1;
+    active = 1;
+    return 0;
+}
+
+/* tty_active - Is terminal job control on? */
+int tty_active(void)
+{
+    return active;
+}
+
+/*
+ * tty_child - Called in a new child after it has joined process group
+ * pgid.  A foreground child takes the terminal itself too, so that it
+ * never runs a moment without it; either way the job control signals
+ * the shell ignores go back to their defaults before exec.
+ */
+void tty_child(pid_t pgid, int fg)
+{
+    if (!active)
+        return;
+    if (fg)
+        tcsetpgrp(0, pgid);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+}
+
+/*
+ * tty_give - Make job the terminal's foreground group, with the
+ * terminal modes it had when it was stopped.
+ */
+void tty_give(struct job_t *job)
+{
+    if (!active || job == NULL)
+        return;
+    tcsetpgrp(0, job->pid);
+    if (job->has_tmodes)
+        tcsetattr(0, TCSADRAIN, &job->tmodes);
+}
+
+/*
+ * tty_reclaim - Take the terminal back after the foreground job pid
+ * stopped or exited.  A stopped job's modes are kept for tty_give.
+ */
+void tty_reclaim(pid_t pid)
+{
+    struct job_t *job = getjobpid(jobs, pid);
+
+    if (!active)
+        return;
+    tcsetpgrp(0, shell_pgid);
+    if (job != NULL && job->state == ST)
+        job->has_tmodes = tcgetattr(0, &job->tmodes) == 0;
+    tcsetattr(0, TCSADRAIN, &shell_modes);
+}
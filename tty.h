@@ -0,0 +1,24 @@
+//-*-c++-*-
+#ifndef _tty_h_
+#define _tty_h_
+
+#include "jobs.h"
+
+/*
+ * Terminal job control.  When the shell's stdin is its controlling
+ * terminal, the foreground job's process group owns the terminal
+ * (tcsetpgrp), so ctrl-c and ctrl-z go from the kernel straight to
+ * the job.  The shell takes the terminal back when the job stops or
+ * exits, keeping a stopped job's terminal modes to restore on fg.
+ *
+ * Without a terminal (the test drivers use pipes) none of this
+ * applies, and the shell forwards SIGINT and SIGTSTP itself.
+ */
+
+int  tty_init(void);
+int  tty_active(void);
+void tty_child(pid_t pgid, int fg);
+void tty_give(struct job_t *job);
+void tty_reclaim(pid_t pid);
+
+#endif
@@ -0,0 +1,504 @@
+#include "utils.h"
+#include "jobs.h"
+#include "evloop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+
+
+/***********************************************
+ * echo, true and false
+ **********************************************/
+
+/* echo_escapes - Print s, interpreting backslash escapes; -1 after \c */
+static int echo_escapes(const char *s)
+{
+    while (*s) {
+        int c = (unsigned char)*s++;
+
+        if (c == '\\' && *s) {
+            switch (c = (unsigned char)*s++) {
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'c': return -1;              /* no more output */
+            case 'e': c = 0x1b; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            case 'x':
+                if (!isxdigit((unsigned char)*s)) {
+                    putchar('\\');
+                    break;
+                }
+                c = 0;
+                for (int i = 0; i < 2 && isxdigit((unsigned char)*s); i++, s++)
+                    c = c * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower(*s) - 'a' + 10);
+                break;
+            case '0':                         /* \0nnn */
+                c = 0;
+                for (int i = 0; i < 3 && *s >= '0' && *s <= '7'; i++)
+                    c = c * 8 + (*s++ - '0');
+                c &= 0xff;
+                break;
+            case '\\':
+                break;
+            default:                          /* not an escape */
+                putchar('\\');
+                break;
+            }
+        }
+        putchar(c);
+    }
+    return 0;
+}
+
+/*
+ * util_echo - echo [-neE] [string ...].  As in coreutils, an option
+ * word must consist only of n, e and E, or it is printed.
+ */
+int util_echo(char **argv)
+{
+    int i, first, nl = 1, esc = 0;
+
+    for (i = 1; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *p = argv[i] + 1;
+
+        if (p[strspn(p, "neE")] != '\0')
+            break;
+        for (; *p; p++) {
+            if (*p == 'n')
+                nl = 0;
+            else
+                esc = *p == 'e';
+        }
+    }
+    for (first = i; argv[i]; i++) {
+        if (i > first)
+            putchar(' ');
+        if (!esc)
+            fputs(argv[i], stdout);
+        else if (echo_escapes(argv[i]) < 0)
+            return 0;
+    }
+    if (nl)
+        putchar('\n');
+    return 0;
+}
+
+/* util_true - true: succeed */
+int util_true(char **argv)
+{
+    return 0;
+}
+
+/* util_false - false: fail */
+int util_false(char **argv)
+{
+    return 1;
+}
+
+
+/***********************************************
+ * test and [
+ **********************************************/
+
+static char      **targ;   /* next word of the expression */
+static char      **tend;   /* one past its last word */
+static const char *tname;  /* as invoked, for messages */
+static int         terr;   /* a syntax error was reported */
+
+static int t_or(void);
+
+/* t_error - Report a syntax error once; the expression is then false */
+static int t_error(const char *fmt, const char *arg)
+{
+    if (!terr) {
+        printf("%s: ", tname);
+        printf(fmt, arg);
+        printf("\n");
+    }
+    terr = 1;
+    return 0;
+}
+
+/* t_int - An integer operand */
+static long long t_int(const char *s)
+{
+    char *end;
+    long long v;
+
+    errno = 0;
+    v = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (end == s || *end != '\0' || errno == ERANGE)
+        t_error("invalid integer '%s'", s);
+    return v;
+}
+
+/* t_isbinary - Is s a binary operator? */
+static int t_isbinary(const char *s)
+{
+    static const char *ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt",
+                                 "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL };
+
+    for (int i = 0; ops[i]; i++)
+        if (!strcmp(s, ops[i]))
+            return 1;
+    return 0;
+}
+
+/* t_binary - a op b */
+static int t_binary(const char *a, const char *op, const char *b)
+{
+    struct stat sa, sb;
+
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+        return !strcmp(a, b);
+    if (!strcmp(op, "!="))
+        return strcmp(a, b) != 0;
+    if (!strcmp(op, "<"))
+        return strcmp(a, b) < 0;
+    if (!strcmp(op, ">"))
+        return strcmp(a, b) > 0;
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef")) {
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+
+        if (!strcmp(op, "-ef"))
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (!strcmp(op, "-ot")) {
+            struct stat st = sa;
+            int h = ha;
+            sa = sb, ha = hb, sb = st, hb = h;
+        }
+        if (!ha || !hb)
+            return ha && !hb;
+        return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+               (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec);
+    }
+
+    long long x = t_int(a), y = t_int(b);
+
+    if (!strcmp(op, "-eq")) return x == y;
+    if (!strcmp(op, "-ne")) return x != y;
+    if (!strcmp(op, "-lt")) return x < y;
+    if (!strcmp(op, "-le")) return x <= y;
+    if (!strcmp(op, "-gt")) return x > y;
+    return x >= y;                           /* -ge */
+}
+
+/* t_unary - op arg, or -1 if op isn't a unary operator */
+static int t_unary(const char *op, const char *arg)
+{
+    struct stat st;
+
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0')
+        return -1;
+    switch (op[1]) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    case 't': return isatty((int)t_int(arg));
+    case 'r': return access(arg, R_OK) == 0;
+    case 'w': return access(arg, W_OK) == 0;
+    case 'x': return access(arg, X_OK) == 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if (!strchr("efdsbcpSugk", op[1]))
+        return -1;
+    if (stat(arg, &st) < 0)
+        return 0;
+    switch (op[1]) {
+    case 'e': return 1;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    default:  return (st.st_mode & S_ISVTX) != 0;   /* -k */
+    }
+}
+
+/* t_primary - ( expr ) | a op b | -op a | string */
+static int t_primary(void)
+{
+    int v;
+
+    if (targ >= tend)
+        return t_error("missing argument after '%s'", targ[-1]);
+    if (tend - targ >= 3 && t_isbinary(targ[1])) {
+        v = t_binary(targ[0], targ[1], targ[2]);
+        targ += 3;
+        return v;
+    }
+    if (!strcmp(*targ, "(") && tend - targ >= 2) {
+        targ++;
+        v = t_or();
+        if (targ >= tend || strcmp(*targ, ")"))
+            return t_error("%s", "')' expected");
+        targ++;
+        return v;
+    }
+    if (tend - targ >= 2 && (v = t_unary(targ[0], targ[1])) >= 0) {
+        targ += 2;
+        return v;
+    }
+    return *targ++[0] != '\0';
+}
+
+/* t_not - ! expr | primary */
+static int t_not(void)
+{
+    if (targ < tend && !strcmp(*targ, "!") && tend - targ >= 2 &&
+        !(tend - targ == 3 && t_isbinary(targ[1]))) {  /* "! = !" compares */
+        targ++;
+        return !t_not();
+    }
+    return t_primary();
+}
+
+/* t_and - not [-a not]... */
+static int t_and(void)
+{
+    int v = t_not();
+
+    while (targ < tend && !strcmp(*targ, "-a")) {
+        targ++;
+        v = t_not() && v;
+    }
+    return v;
+}
+
+/* t_or - and [-o and]... */
+static int t_or(void)
+{
+    int v = t_and();
+
+    while (targ < tend && !strcmp(*targ, "-o")) {
+        targ++;
+        v = t_and() || v;
+    }
+    return v;
+}
+
+/*
+ * util_test - test expr, [ expr ].  Exit status 0 if expr is true, 1
+ * if false, 2 on a syntax error.
+ */
+int util_test(char **argv)
+{
+    const char *base = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    int argc, v;
+
+    tname = argv[0];
+    for (argc = 0; argv[argc]; argc++)
+        ;
+    if (!strcmp(base, "[") && (argc-- < 2 || strcmp(argv[argc], "]"))) {
+        printf("%s: missing ']'\n", tname);
+        return 2;
+    }
+    targ = argv + 1;
+    tend = argv + argc;
+    terr = 0;
+    if (targ == tend)
+        return 1;
+    v = t_or();
+    if (targ < tend)
+        t_error("extra argument '%s'", *targ);
+    return terr ? 2 : !v;
+}
+
+
+/***********************************************
+ * sleep and kill
+ **********************************************/
+
+static volatile sig_atomic_t interrupted;   /* ctrl-c during a sleep */
+
+/* util_interrupt - ctrl-c with no foreground job (signal safe) */
+void util_interrupt(void)
+{
+    interrupted = 1;
+}
+
+/*
+ * util_sleep - sleep number[smhd]...  The times are added up.  The
+ * sleep waits in the event loop, so sockets and capture pipes are
+ * served and background jobs reaped meanwhile; SIGCHLD stays blocked
+ * outside the wait, as in waitfg.  A ctrl-c ends it early.
+ */
+int util_sleep(char **argv)
+{
+    struct timespec ts;
+    sigset_t mask, prev;
+    long long deadline, left;
+    double secs = 0;
+    int i;
+
+    if (argv[1] == NULL) {
+        printf("%s: missing operand\n", argv[0]);
+        printf("Try '%s --help' for more information.\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; argv[i]; i++) {
+        char *end;
+        double d = strtod(argv[i], &end);
+        double mult = *end == 'm' ? 60 : *end == 'h' ? 3600 : *end == 'd' ? 86400 : 1;
+
+        if (end == argv[i] || d < 0 || (*end && (strchr("smhd", *end) == NULL || end[1]))) {
+            printf("%s: invalid time interval '%s'\n", argv[0], argv[i]);
+            printf("Try '%s --help' for more information.\n", argv[0]);
+            return 1;
+        }
+        secs += d * mult;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    interrupted = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    deadline = ts.tv_sec * 1000000000LL + ts.tv_nsec +
+               (secs < 9e9 ? (long long)(secs * 1e9) : 9000000000000000000LL);
+    while (!interrupted) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if ((left = deadline - (ts.tv_sec * 1000000000LL + ts.tv_nsec)) <= 0)
+            break;
+        left = (left + 999999) / 1000000;     /* whole ms, rounded up */
+        evloop_wait(left < INT_MAX ? (int)left : INT_MAX);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return interrupted ? 128 + SIGINT : 0;
+}
+
+/* sig_number - Signal number from a name (INT, SIGINT) or number */
+static int sig_number(const char *s)
+{
+    if (isdigit((unsigned char)*s)) {
+        char *end;
+        long n = strtol(s, &end, 10);
+
+        return *end == '\0' && n >= 0 && n < NSIG ? (int)n : -1;
+    }
+    if (!strncasecmp(s, "SIG", 3))
+        s += 3;
+    for (int n = 1; n < NSIG; n++) {
+        const char *name = sigabbrev_np(n);
+
+        if (name && !strcasecmp(s, name))
+            return n;
+    }
+    return -1;
+}
+
+/* kill_list - kill -l [signal]: names of all signals, or convert one */
+static int kill_list(const char *prog, const char *arg)
+{
+    int n, col = 0;
+
+    if (arg != NULL) {
+        if ((n = sig_number(arg)) <= 0) {
+            printf("%s: unknown signal name %s\n", prog, arg);
+            return 1;
+        }
+        if (isdigit((unsigned char)*arg))
+            printf("%s\n", sigabbrev_np(n));
+        else
+            printf("%d\n", n);
+        return 0;
+    }
+    for (n = 1; n < SIGRTMIN; n++) {
+        const char *name = sigabbrev_np(n);
+
+        if (name == NULL)
+            continue;
+        if (col > 0 && col + 1 + strlen(name) > 79) {
+            printf("\n");
+            col = 0;
+        }
+        col += printf("%s%s", col ? " " : "", name);
+    }
+    printf("\n");
+    return 0;
+}
+
+/*
+ * util_kill - kill [-s sig | -sig] pid|%job...  kill -l [sig].  A
+ * %job is signalled as a process group, the way the shell signals
+ * jobs.  Default signal TERM.  Messages follow procps-ng's kill.
+ */
+int util_kill(char **argv)
+{
+    const char *name = "TERM";
+    int i = 1, sig, status = 0;
+
+    if (argv[1] && !strcmp(argv[1], "-l"))
+        return kill_list(argv[0], argv[2]);
+    if (argv[i] && !strcmp(argv[i], "-s") && argv[i + 1]) {
+        name = argv[i + 1];
+        i += 2;
+    }
+    else if (argv[i] && argv[i][0] == '-' && !isdigit((unsigned char)argv[i][1]) &&
+             strcmp(argv[i], "--")) {
+        name = argv[i] + 1;
+        i++;
+    }
+    else if (argv[i] && argv[i][0] == '-' && argv[i + 1]) {   /* -9 pid */
+        name = argv[i] + 1;
+        i++;
+    }
+    if (argv[i] && !strcmp(argv[i], "--"))
+        i++;
+    if ((sig = sig_number(name)) < 0) {
+        printf("%s: unknown signal name %s\n", argv[0], name);
+        return 1;
+    }
+    if (argv[i] == NULL) {
+        printf("Usage: %s [-s signal | -signal] pid|%%job...\n", argv[0]);
+        return 1;
+    }
+    for (; argv[i]; i++) {
+        pid_t pid;
+
+        if (argv[i][0] == '%') {
+            struct job_t *job = getjobjid(jobs, atoi(argv[i] + 1));
+
+            if (job == NULL) {
+                printf("%s: %s: No such job\n", argv[0], argv[i]);
+                status = 1;
+                continue;
+            }
+            pid = -job->pid;
+        }
+        else {
+            char *end;
+            long v = strtol(argv[i], &end, 10);
+
+            if (end == argv[i] || *end != '\0') {
+                printf("%s: failed to parse argument: '%s'\n", argv[0], argv[i]);
+                status = 1;
+                continue;
+            }
+            pid = (pid_t)v;
+        }
+        if (kill(pid, sig) < 0) {
+            printf("%s: (%s): %s\n", argv[0], argv[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
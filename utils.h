@@ -0,0 +1,27 @@
+//-*-c++-*-
+#ifndef _utils_h_
+#define _utils_h_
+
+/*
+ * Common utilities run inside the shell (tsh -u): echo, true, false,
+ * test and [, sleep and kill.  They save a fork and exec per command
+ * and stand in for /bin/<name> and /usr/bin/<name> as well as the
+ * bare name.  Output matches coreutils (procps-ng for kill) for the
+ * usual options; --help and --version are not implemented.
+ *
+ * In the foreground they run in the shell itself, so ctrl-c ends a
+ * sleep early (util_interrupt) but ctrl-z can't stop it.  A sleep
+ * waits in the event loop, which keeps serving sockets meanwhile.  With a
+ * trailing & they run in a child, as a normal background job.
+ */
+
+int  util_echo(char **argv);
+int  util_true(char **argv);
+int  util_false(char **argv);
+int  util_test(char **argv);
+int  util_sleep(char **argv);
+int  util_kill(char **argv);
+
+void util_interrupt(void);
+
+#endif
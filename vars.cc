@@ -0,0 +1,384 @@
+#include "vars.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define VA_SLOTS 256        /* hash chains, a power of two */
+
+struct var_t {              /* A variable */
+    struct var_t *next;     /* in its chain */
+    char         *value;    /* '\0'-terminated */
+    size_t        vcap;     /* bytes at value */
+    size_t        nlen;
+    char          name[1];  /* and the rest of it */
+};
+
+static struct var_t *vars[VA_SLOTS];
+static int           status;        /* $? */
+static char         *noparams[] = { NULL };
+static char        **params = noparams;   /* $1 ..., NULL-terminated */
+
+
+/***********************************************
+ * Variables
+ **********************************************/
+
+/* va_hash - FNV-1a of a name */
+static unsigned va_hash(const char *s, size_t n)
+{
+    unsigned h = 2166136261u;
+
+    while (n-- > 0)
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h & (VA_SLOTS - 1);
+}
+
+/* va_find - The variable with the n-byte name at s, or NULL */
+static struct var_t *va_find(const char *s, size_t n)
+{
+    struct var_t *v;
+
+    for (v = vars[va_hash(s, n)]; v != NULL; v = v->next)
+        if (v->nlen == n && !memcmp(v->name, s, n))
+            return v;
+    return NULL;
+}
+
+/* var_name - Length of the variable name at the start of s, 0 if none */
+int var_name(const char *s)
+{
+    int n = 0;
+
+    if (!isalpha((unsigned char)*s) && *s != '_')
+        return 0;
+    while (isalnum((unsigned char)s[n]) || s[n] == '_')
+        n++;
+    return n;
+}
+
+/* var_get - The value of the len-byte name, or NULL if it is unset */
+const char *var_get(const char *name, size_t len)
+{
+    struct var_t *v = va_find(name, len);
+
+    return v != NULL ? v->value : NULL;
+}
+
+/*
+ * var_set - Set the len-byte name to the vlen bytes at value.  The
+ * value's storage is reused when it is big enough, so a loop counter
+ * costs no allocation.
+ */
+void var_set(const char *name, size_t len, const char *value, size_t vlen)
+{
+    struct var_t *v = va_find(name, len);
+
+    if (v == NULL) {
+        unsigned h = va_hash(name, len);
+
+        if ((v = (struct var_t *)malloc(sizeof(*v) + len)) == NULL)
+            unix_error("malloc error");
+        memcpy(v->name, name, len);
+        v->name[len] = '\0';
+        v->nlen = len;
+        v->value = NULL;
+        v->vcap = 0;
+        v->next = vars[h];
+        vars[h] = v;
+    }
+    if (vlen + 1 > v->vcap) {
+        v->vcap = vlen + 1 < 16 ? 16 : 2 * (vlen + 1);
+        if ((v->value = (char *)realloc(v->value, v->vcap)) == NULL)
+            unix_error("realloc error");
+    }
+    memmove(v->value, value, vlen);
+    v->value[vlen] = '\0';
+}
+
+
+/***********************************************
+ * $? and the positional parameters
+ **********************************************/
+
+/* var_status - Set $? */
+void var_status(int st)
+{
+    status = st;
+}
+
+/* var_last_status - $? */
+int var_last_status(void)
+{
+    return status;
+}
+
+/*
+ * var_params - Make p (NULL-terminated, or NULL for none) the
+ * positional parameters; returns the ones they replace.
+ */
+char **var_params(char **p)
+{
+    char **old = params;
+
+    params = p != NULL ? p : noparams;
+    return old;
+}
+
+/* var_param_list - The positional parameters, NULL-terminated */
+char **var_param_list(void)
+{
+    return params;
+}
+
+
+/***********************************************
+ * Arithmetic
+ **********************************************/
+
+struct arith_t {            /* The expression being evaluated */
+    const char *p, *end;
+    const char *expr;       /* all of it, for messages */
+    size_t      len;
+    int         err;
+};
+
+static long long ar_assign(struct arith_t *a);
+
+/* ar_error - Report a problem, once */
+static long long ar_error(struct arith_t *a, const char *msg)
+{
+    if (!a->err)
+        printf("%.*s: %s\n", (int)a->len, a->expr, msg);
+    a->err = 1;
+    return 0;
+}
+
+/* ar_skip - Step over blanks */
+static void ar_skip(struct arith_t *a)
+{
+    while (a->p < a->end && isspace((unsigned char)*a->p))
+        a->p++;
+}
+
+/* ar_op - Take the operator op if it comes next (and isn't the start of a longer one) */
+static int ar_op(struct arith_t *a, const char *op)
+{
+    size_t n = strlen(op);
+
+    ar_skip(a);
+    if ((size_t)(a->end - a->p) < n || memcmp(a->p, op, n))
+        return 0;
+    if (a->p + n < a->end) {                /* & is not &&, < is not <= or << */
+        char c = a->p[n];
+
+        if (c == '=' && strcmp(op, "=") && strcmp(op, "==") && strcmp(op, "!=") &&
+            strcmp(op, "<=") && strcmp(op, ">="))
+            return 0;
+        if (n == 1 && strchr("&|<>=", *op) && c == *op)
+            return 0;
+        if (!strcmp(op, "=") && c == '=')
+            return 0;
+    }
+    a->p += n;
+    return 1;
+}
+
+/* ar_number - A value as a number; unset or empty is 0 */
+static long long ar_number(struct arith_t *a, const char *v)
+{
+    char *end;
+    long long x;
+
+    if (v == NULL || *v == '\0')
+        return 0;
+    x = strtoll(v, &end, 0);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (*end != '\0')
+        return ar_error(a, "not a number");
+    return x;
+}
+
+/* ar_value - A variable's value as a number */
+static long long ar_value(struct arith_t *a, const char *name, size_t n)
+{
+    return ar_number(a, var_get(name, n));
+}
+
+/* ar_primary - number, name, $name, $1... or (expr) */
+static long long ar_primary(struct arith_t *a)
+{
+    long long x;
+    int n;
+
+    ar_skip(a);
+    if (a->p == a->end)
+        return ar_error(a, "syntax error: operand expected");
+    if (*a->p == '(') {
+        a->p++;
+        x = ar_assign(a);
+        if (!ar_op(a, ")"))
+            return ar_error(a, "missing ')'");
+        return x;
+    }
+    if (isdigit((unsigned char)*a->p)) {
+        char *end;
+
+        x = strtoll(a->p, &end, 0);
+        if (end > a->end || isalnum((unsigned char)*end) || *end == '_')
+            return ar_error(a, "value too great for base");
+        a->p = end;
+        return x;
+    }
+    if (*a->p == '$' && a->p + 1 < a->end && isdigit((unsigned char)a->p[1])) {
+        int i = a->p[1] - '0', k = 0;
+
+        a->p += 2;
+        while (k < i && params[k])
+            k++;
+        return i > 0 && k == i ? ar_number(a, params[i - 1]) : 0;
+    }
+    if (*a->p == '$')
+        a->p++;
+    if ((n = var_name(a->p)) == 0 || a->p + n > a->end)
+        return ar_error(a, "syntax error: operand expected");
+    a->p += n;
+    return ar_value(a, a->p - n, n);
+}
+
+/* ar_unary - - + ! ~ */
+static long long ar_unary(struct arith_t *a)
+{
+    if (ar_op(a, "-"))
+        return -ar_unary(a);
+    if (ar_op(a, "+"))
+        return ar_unary(a);
+    if (ar_op(a, "!"))
+        return !ar_unary(a);
+    if (ar_op(a, "~"))
+        return ~ar_unary(a);
+    return ar_primary(a);
+}
+
+/* ar_binary - Binary operators of precedence level and tighter */
+static long long ar_binary(struct arith_t *a, int level)
+{
+    static const char *ops[][5] = {
+        { "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" },
+        { "<=", ">=", "<", ">" }, { "<<", ">>" }, { "+", "-" }, { "*", "/", "%" },
+    };
+    long long x;
+    int i;
+
+    if (level == (int)(sizeof(ops) / sizeof(ops[0])))
+        return ar_unary(a);
+    x = ar_binary(a, level + 1);
+    for (;;) {
+        const char *op = NULL;
+
+        for (i = 0; i < 5 && ops[level][i] != NULL && op == NULL; i++)
+            if (ar_op(a, ops[level][i]))
+                op = ops[level][i];
+        if (op == NULL)
+            return x;
+
+        long long y = ar_binary(a, level + 1);
+        switch (op[0] * 256 + op[1]) {
+        case '|' * 256 + '|': x = x || y; break;
+        case '&' * 256 + '&': x = x && y; break;
+        case '|' * 256:       x |= y; break;
+        case '^' * 256:       x ^= y; break;
+        case '&' * 256:       x &= y; break;
+        case '=' * 256 + '=': x = x == y; break;
+        case '!' * 256 + '=': x = x != y; break;
+        case '<' * 256 + '=': x = x <= y; break;
+        case '>' * 256 + '=': x = x >= y; break;
+        case '<' * 256:       x = x < y; break;
+        case '>' * 256:       x = x > y; break;
+        case '<' * 256 + '<': x = (long long)((unsigned long long)x << (y & 63)); break;
+        case '>' * 256 + '>': x >>= (y & 63); break;
+        case '+' * 256:       x = (long long)((unsigned long long)x + y); break;
+        case '-' * 256:       x = (long long)((unsigned long long)x - y); break;
+        case '*' * 256:       x = (long long)((unsigned long long)x * y); break;
+        default:                                    /* / and % */
+            if (y == 0)
+                return ar_error(a, "division by 0");
+            if (y == -1)
+                x = op[0] == '/' ? (long long)(0 - (unsigned long long)x) : 0;
+            else
+                x = op[0] == '/' ? x / y : x % y;
+            break;
+        }
+    }
+}
+
+/* ar_assign - name = expr, name op= expr, or an expression */
+static long long ar_assign(struct arith_t *a)
+{
+    static const char *aops[] = { "=", "+=", "-=", "*=", "/=", "%=", "<<=", ">>=",
+                                  "&=", "^=", "|=" };
+    const char *save;
+    long long x;
+    char buf[32];
+    int n;
+
+    ar_skip(a);
+    save = a->p;
+    if ((n = var_name(a->p)) > 0 && a->p + n <= a->end) {
+        const char *name = a->p;
+
+        a->p += n;
+        for (unsigned i = 0; i < sizeof(aops) / sizeof(aops[0]); i++) {
+            if (!ar_op(a, aops[i]))
+                continue;
+            x = ar_assign(a);
+            if (i > 0) {                    /* name op= expr: name op expr */
+                long long y = x, v = ar_value(a, name, n);
+
+                switch (aops[i][0]) {
+                case '+': x = (long long)((unsigned long long)v + y); break;
+                case '-': x = (long long)((unsigned long long)v - y); break;
+                case '*': x = (long long)((unsigned long long)v * y); break;
+                case '/':
+                case '%':
+                    if (y == 0)
+                        return ar_error(a, "division by 0");
+                    x = y == -1 ? (aops[i][0] == '/' ? (long long)(0 - (unsigned long long)v) : 0)
+                                : aops[i][0] == '/' ? v / y : v % y;
+                    break;
+                case '<': x = (long long)((unsigned long long)v << (y & 63)); break;
+                case '>': x = v >> (y & 63); break;
+                case '&': x = v & y; break;
+                case '^': x = v ^ y; break;
+                case '|': x = v | y; break;
+                }
+            }
+            if (!a->err) {
+                int len = snprintf(buf, sizeof(buf), "%lld", x);
+                var_set(name, n, buf, len);
+            }
+            return x;
+        }
+        a->p = save;
+    }
+    return ar_binary(a, 0);
+}
+
+/* var_arith - Evaluate the len-byte expression at expr into *result */
+int var_arith(const char *expr, size_t len, long long *result)
+{
+    struct arith_t a = { expr, expr + len, expr, len, 0 };
+
+    ar_skip(&a);
+    if (a.p == a.end) {                     /* $(( )) is 0 */
+        *result = 0;
+        return 0;
+    }
+    *result = ar_assign(&a);
+    ar_skip(&a);
+    if (!a.err && a.p != a.end)
+        ar_error(&a, "syntax error in expression");
+    return a.err ? -1 : 0;
+}
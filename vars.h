@@ -0,0 +1,36 @@
+//-*-c++-*-
+#ifndef _vars_h_
+#define _vars_h_
+
+#include <stddef.h>
+
+/*
+ * Shell variables.  NAME=value sets one, and $NAME or ${NAME} expands
+ * to it (expand.h); an unset variable is empty.  The shell's commands
+ * run with an empty environment, as they always have, so variables
+ * are never exported.
+ *
+ * Also kept here: $?, the status of the last command, and the
+ * positional parameters $1...$9, $#, $@ and $*, which a function call
+ * replaces for the length of the call (script.h).
+ *
+ * var_arith evaluates the integer expression of $((...)): C's
+ * operators and precedence, without ++, -- and ?:, on 64-bit
+ * integers.  Names (and $name, $1...) are variables, read as numbers;
+ * name = expr (or +=, -=, ...) assigns.  It returns 0, or -1 after
+ * printing what was wrong.
+ */
+
+const char *var_get(const char *name, size_t len);
+void        var_set(const char *name, size_t len, const char *value, size_t vlen);
+int         var_name(const char *s);
+
+void        var_status(int status);
+int         var_last_status(void);
+
+char      **var_params(char **params);
+char      **var_param_list(void);
+
+int         var_arith(const char *expr, size_t len, long long *result);
+
+#endif
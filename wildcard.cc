@@ -0,0 +1,428 @@
+#include "wildcard.h"
+#include "helper-routines.h"
+#include "tracing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+
+/***********************************************
+ * Pattern components
+ **********************************************/
+
+#define WC_BUFSIZE    (256 * 1024)   /* getdents64 buffer of each walker */
+#define WC_MAXWALKERS 8              /* threads for a ** walk */
+#define WC_MAXCOMPS   128            /* components in a pattern */
+
+#define WC_LITERAL 0   /* a name, matched by looking it up */
+#define WC_ALL     1   /* *  */
+#define WC_PREFIX  2   /* abc*  */
+#define WC_SUFFIX  3   /* *abc  */
+#define WC_MATCH   4   /* anything else: fnmatch */
+#define WC_RECURSE 5   /* **  */
+
+struct wcomp_t {            /* One component of the pattern */
+    char  *text;            /* pattern; the name, prefix or suffix for the others */
+    size_t len;             /* of text */
+    int    kind;
+};
+
+static struct wcomp_t comps[WC_MAXCOMPS];
+static int            ncomps;
+static int            dirsonly;     /* pattern ends in '/' */
+static wildcard_emit_fn *emitfn;
+static long           ncpu;         /* threads for **: one per CPU, or tsh -w */
+
+
+/* wc_meta - Does s (n bytes) have an unescaped *, ? or [ ? */
+static int wc_meta(const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '\\')
+            i++;
+        else if (s[i] == '*' || s[i] == '?' || s[i] == '[')
+            return 1;
+    }
+    return 0;
+}
+
+/* wc_plain - Is s (n bytes) free of metacharacters and escapes? */
+static int wc_plain(const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        if (s[i] == '\\' || s[i] == '*' || s[i] == '?' || s[i] == '[')
+            return 0;
+    return 1;
+}
+
+/* wc_comp - Classify the component s (n bytes, writable) */
+static void wc_comp(struct wcomp_t *c, char *s, size_t n)
+{
+    c->text = s;
+    c->len = n;
+    if (n == 2 && s[0] == '*' && s[1] == '*')
+        c->kind = WC_RECURSE;
+    else if (!wc_meta(s, n)) {                  /* unescape it */
+        size_t j = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (s[i] == '\\' && i + 1 < n)
+                i++;
+            s[j++] = s[i];
+        }
+        s[j] = '\0';
+        c->len = j;
+        c->kind = WC_LITERAL;
+    }
+    else if (s[0] == '*' && wc_plain(s + 1, n - 1)) {
+        c->text = s + 1;
+        c->len = n - 1;
+        c->kind = n == 1 ? WC_ALL : WC_SUFFIX;
+    }
+    else if (s[n - 1] == '*' && wc_plain(s, n - 1)) {
+        s[n - 1] = '\0';
+        c->len = n - 1;
+        c->kind = WC_PREFIX;
+    }
+    else
+        c->kind = WC_MATCH;
+}
+
+/* wc_match - Does name match the (non-literal) component c? */
+static int wc_match(const struct wcomp_t *c, const char *name)
+{
+    size_t n;
+
+    switch (c->kind) {
+    case WC_ALL:
+        return name[0] != '.';
+    case WC_PREFIX:
+        return (name[0] != '.' || c->text[0] == '.') && !strncmp(name, c->text, c->len);
+    case WC_SUFFIX:
+        n = strlen(name);
+        return name[0] != '.' && n >= c->len && !memcmp(name + n - c->len, c->text, c->len);
+    default:
+        return fnmatch(c->text, name, FNM_PERIOD) == 0;
+    }
+}
+
+
+/***********************************************
+ * Walkers and their queues of directories
+ **********************************************/
+
+struct task_t {             /* A directory to match comps[comp] in */
+    char *path;
+    int   comp;
+};
+
+struct walker_t {
+    pthread_mutex_t lock;   /* guards the queue */
+    struct task_t  *q;      /* the owner takes from the end, thieves from head */
+    int             head, tail, cap;
+    char           *buf;    /* getdents64 buffer */
+    char            path[PATH_MAX];
+    char           *out;    /* matches, '\0'-separated, when not emitting directly */
+    size_t          outlen, outcap;
+    int             nfound;
+    pthread_t       tid;
+};
+
+static struct walker_t walkers[WC_MAXWALKERS];
+static int             nwalkers;      /* in this walk */
+static int             pending;       /* tasks queued or running */
+
+
+/* wc_join - Append name (n bytes) to the path of length dlen; 0 if too long */
+static size_t wc_join(char *path, size_t dlen, const char *name, size_t n)
+{
+    if (dlen > 0 && path[dlen - 1] != '/')
+        path[dlen++] = '/';
+    if (dlen + n >= PATH_MAX)
+        return 0;
+    memcpy(path + dlen, name, n);
+    path[dlen + n] = '\0';
+    return dlen + n;
+}
+
+/* wc_found - Record a match: w->path extended by name */
+static void wc_found(struct walker_t *w, size_t dlen, const char *name, size_t n)
+{
+    size_t len = n ? wc_join(w->path, dlen, name, n) : dlen;
+
+    if (len == 0 || (dirsonly && (len = wc_join(w->path, len, "", 0)) == 0))
+        return;
+    w->nfound++;
+    if (nwalkers == 1)
+        emitfn(w->path, len);           /* straight into the caller's words */
+    else {
+        if (w->outlen + len + 1 > w->outcap) {
+            w->outcap = w->outcap ? 2 * w->outcap + len : 65536 + len;
+            if ((w->out = (char *)realloc(w->out, w->outcap)) == NULL)
+                unix_error("realloc error");
+        }
+        memcpy(w->out + w->outlen, w->path, len + 1);
+        w->outlen += len + 1;
+    }
+    w->path[dlen] = '\0';
+}
+
+/* wc_push - Queue the directory w->path/name for component comp */
+static void wc_push(struct walker_t *w, size_t dlen, const char *name, size_t n, int comp)
+{
+    size_t len = wc_join(w->path, dlen, name, n);
+    char *path;
+
+    if (len == 0 || (path = strdup(w->path)) == NULL) {
+        w->path[dlen] = '\0';
+        return;
+    }
+    w->path[dlen] = '\0';
+    __atomic_add_fetch(&pending, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&w->lock);
+    if (w->tail == w->cap) {
+        if (w->head > 0) {                      /* slide down over taken tasks */
+            memmove(w->q, w->q + w->head, (w->tail - w->head) * sizeof(*w->q));
+            w->tail -= w->head;
+            w->head = 0;
+        }
+        if (w->tail == w->cap) {
+            w->cap = w->cap ? 2 * w->cap : 256;
+            if ((w->q = (struct task_t *)realloc(w->q, w->cap * sizeof(*w->q))) == NULL)
+                unix_error("realloc error");
+        }
+    }
+    w->q[w->tail].path = path;
+    w->q[w->tail].comp = comp;
+    w->tail++;
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* wc_take - Take a task: the newest of our own, else the oldest of another's */
+static int wc_take(struct walker_t *w, struct task_t *t)
+{
+    int self = w - walkers;
+
+    for (int k = 0; k < nwalkers; k++) {
+        struct walker_t *v = &walkers[(self + k) % nwalkers];
+        int got = 0;
+
+        pthread_mutex_lock(&v->lock);
+        if (v->head < v->tail) {
+            *t = v == w ? v->q[--v->tail] : v->q[v->head++];
+            got = 1;
+        }
+        if (v->head == v->tail)
+            v->head = v->tail = 0;
+        pthread_mutex_unlock(&v->lock);
+        if (got)
+            return 1;
+    }
+    return 0;
+}
+
+/* wc_isdir - Is the entry d of the directory fd a directory? */
+static int wc_isdir(int fd, const struct dirent64 *d, int follow)
+{
+    struct stat st;
+
+    if (d->d_type != DT_UNKNOWN && (d->d_type != DT_LNK || !follow))
+        return d->d_type == DT_DIR;
+    return fstatat(fd, d->d_name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISDIR(st.st_mode);
+}
+
+/*
+ * wc_scan - Read the directory w->path (dlen bytes) once, matching
+ * comps[i] against its names.  Directories to go on with are queued,
+ * never visited from here, so one buffer per walker is enough.
+ */
+static void wc_scan(struct walker_t *w, size_t dlen, int i)
+{
+    const struct wcomp_t *c = &comps[i];
+    int last = i == ncomps - 1;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(dlen ? w->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return;
+    while ((n = getdents64(fd, w->buf, WC_BUFSIZE)) > 0) {
+        for (ssize_t off = 0; off < n; ) {
+            struct dirent64 *d = (struct dirent64 *)(w->buf + off);
+            const char *name = d->d_name;
+
+            off += d->d_reclen;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            if (c->kind == WC_RECURSE) {
+                if (name[0] != '.' && wc_isdir(fd, d, 0))   /* links aren't followed */
+                    wc_push(w, dlen, name, strlen(name), i);
+            }
+            else if (wc_match(c, name)) {
+                if (last) {
+                    if (!dirsonly || wc_isdir(fd, d, 1))
+                        wc_found(w, dlen, name, strlen(name));
+                }
+                else if (d->d_type == DT_DIR || d->d_type == DT_LNK || d->d_type == DT_UNKNOWN)
+                    wc_push(w, dlen, name, strlen(name), i + 1);
+            }
+        }
+    }
+    close(fd);
+}
+
+/* wc_visit - Match comps[i..] below the directory w->path (dlen bytes) */
+static void wc_visit(struct walker_t *w, size_t dlen, int i)
+{
+    size_t len = dlen;
+    struct stat st;
+
+    while (i < ncomps && comps[i].kind == WC_LITERAL) {     /* no need to read */
+        if ((len = wc_join(w->path, len, comps[i].text, comps[i].len)) == 0)
+            goto out;
+        i++;
+    }
+    if (i == ncomps) {
+        if (dirsonly ? stat(w->path, &st) == 0 && S_ISDIR(st.st_mode) :
+            fstatat(AT_FDCWD, w->path, &st, AT_SYMLINK_NOFOLLOW) == 0)
+            wc_found(w, len, "", 0);
+        goto out;
+    }
+    if (comps[i].kind == WC_RECURSE) {
+        wc_visit(w, len, i + 1);        /* ** matching no directories */
+        w->path[len] = '\0';
+    }
+    wc_scan(w, len, i);
+out:
+    w->path[dlen] = '\0';
+}
+
+/* wc_work - A walker: run tasks until there are none left anywhere */
+static void *wc_work(void *arg)
+{
+    struct walker_t *w = (struct walker_t *)arg;
+    struct task_t t;
+
+    for (;;) {
+        if (wc_take(w, &t)) {
+            size_t len = strlen(t.path);
+
+            memcpy(w->path, t.path, len + 1);
+            free(t.path);
+            wc_visit(w, len, t.comp);
+            __atomic_sub_fetch(&pending, 1, __ATOMIC_ACQ_REL);
+        }
+        else if (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) == 0)
+            return NULL;
+        else
+            sched_yield();
+    }
+}
+
+
+/***********************************************
+ * Expansion
+ **********************************************/
+
+/* wildcard_walkers - tsh -w <n>: walk ** with n threads, whatever the CPUs */
+void wildcard_walkers(int n)
+{
+    ncpu = n < 1 ? 1 : n;
+}
+
+/*
+ * wildcard_expand - Call emit for each path matching pattern; returns
+ * the number of matches.
+ */
+int wildcard_expand(const char *pattern, wildcard_emit_fn *emit)
+{
+    char *pat, *s, *e;
+    int recurse = 0, found = 0;
+    struct walker_t *w0 = &walkers[0];
+
+    if ((pat = strdup(pattern)) == NULL)
+        return 0;
+    TRACE_BEGIN("glob");
+
+    /* split into components, dropping empty ones; ** last means ** / * */
+    ncomps = 0;
+    dirsonly = pattern[0] != '\0' && pattern[strlen(pattern) - 1] == '/';
+    for (s = pat; *s; s = e) {
+        while (*s == '/')
+            s++;
+        for (e = s; *e && *e != '/'; e++)
+            if (*e == '\\' && e[1])
+                e++;
+        if (e == s)
+            break;
+        if (ncomps == WC_MAXCOMPS - 1)
+            goto done;
+        if (*e)
+            *e++ = '\0';
+        wc_comp(&comps[ncomps], s, strlen(s));
+        recurse |= comps[ncomps++].kind == WC_RECURSE;
+    }
+    if (ncomps > 0 && comps[ncomps - 1].kind == WC_RECURSE)
+        wc_comp(&comps[ncomps++], (char *)"*", 1);
+    emitfn = emit;
+
+    if (ncpu == 0 && (ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        ncpu = 1;
+    nwalkers = recurse ? (ncpu < WC_MAXWALKERS ? ncpu : WC_MAXWALKERS) : 1;
+    for (int k = 0; k < nwalkers; k++) {
+        struct walker_t *w = &walkers[k];
+
+        if (w->buf == NULL) {
+            pthread_mutex_init(&w->lock, NULL);
+            if ((w->buf = (char *)malloc(WC_BUFSIZE)) == NULL)
+                unix_error("malloc error");
+        }
+        w->head = w->tail = 0;
+        w->outlen = 0;
+        w->nfound = 0;
+    }
+
+    /* the first task is the top directory */
+    strcpy(w0->path, pattern[0] == '/' ? "/" : "");
+    wc_visit(w0, strlen(w0->path), 0);
+    if (nwalkers > 1) {
+        sigset_t all, prev;
+
+        sigfillset(&all);               /* signals stay with the main thread */
+        pthread_sigmask(SIG_SETMASK, &all, &prev);
+        for (int k = 1; k < nwalkers; k++)
+            if (pthread_create(&walkers[k].tid, NULL, wc_work, &walkers[k]) != 0)
+                walkers[k].tid = 0;
+        pthread_sigmask(SIG_SETMASK, &prev, NULL);
+    }
+    wc_work(w0);
+    for (int k = 1; k < nwalkers; k++)
+        if (walkers[k].tid != 0)
+            pthread_join(walkers[k].tid, NULL);
+
+    for (int k = 0; k < nwalkers; k++) {
+        struct walker_t *w = &walkers[k];
+
+        found += w->nfound;
+        if (nwalkers > 1)
+            for (size_t off = 0; off < w->outlen; ) {
+                size_t len = strlen(w->out + off);
+
+                emit(w->out + off, len);
+                off += len + 1;
+            }
+    }
+done:
+    free(pat);
+    TRACE_END("glob");
+    return found;
+}
@@ -0,0 +1,31 @@
+//-*-c++-*-
+#ifndef _wildcard_h_
+#define _wildcard_h_
+
+#include <stddef.h>
+
+/*
+ * Pathname expansion: *, ?, [...] and ** (any number of directories,
+ * hidden ones excepted).  A backslash makes the next character
+ * literal.  Names starting with '.' match only a pattern component
+ * that starts with '.' too, and . and .. never match.  A pattern that
+ * ends in '/' matches only directories.
+ *
+ * Directories are read with getdents64 into large buffers and only
+ * names whose type the kernel didn't report are stat'ed.  Components
+ * like *.log, data* and * are matched without fnmatch.  A pattern
+ * with ** is walked by one thread per CPU (up to WC_MAXWALKERS), each
+ * with its own queue of directories and stealing from the others when
+ * it runs dry.  wildcard_walkers (tsh -w) sets the number of threads
+ * instead, still at most WC_MAXWALKERS.
+ *
+ * wildcard_expand calls emit for each path that matches, in no
+ * particular order, and returns how many did.
+ */
+
+typedef void wildcard_emit_fn(const char *path, size_t len);
+
+int  wildcard_expand(const char *pattern, wildcard_emit_fn *emit);
+void wildcard_walkers(int n);
+
+#endif